@@ -0,0 +1,319 @@
+// Scene BVH benchmark: scatters boxes over a flat, city sized world, then times
+// building and refitting the tree and frustum, box and ray queries against it, each
+// next to a linear scan over every box so the difference in scaling shows. Frustum
+// and box queries also get a scan with the SIMD kernels of AABBArray.
+//
+//   bench-bvh [--objects N] [--queries N] [--reps N] [--warmup N] [--out results.json]
+
+#include "benchmark.hpp"
+#include "frustum.hpp"
+#include "scene-bvh.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef CPM_GLM_AABB_NS::AABB AABB;
+typedef CPM_GLM_AABB_NS::AABBArray AABBArray;
+
+const float WORLD_SIZE = 2000.0f;
+const float WORLD_HEIGHT = 100.0f;
+const float VIEW_DISTANCE = 400.0f;
+const float QUERY_BOX_SIZE = 40.0f;
+const float RAY_LENGTH = 500.0f;
+const float MOVING_FRACTION = 0.1f; // of the objects, per refit repetition
+
+struct Queries
+{
+	std::vector<Frustum> frustums;
+	std::vector<AABB> boxes;
+	std::vector<glm::vec3> ray_origins;
+	std::vector<glm::vec3> ray_directions;
+};
+
+// mostly small props with the odd building, all resting on the ground
+std::vector<AABB> makeObjects(int count, std::mt19937* rng)
+{
+	std::uniform_real_distribution<float> position(0.0f, WORLD_SIZE);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<AABB> objects(count);
+	for (AABB& object : objects)
+	{
+		float size = 0.5f + 4.0f * unit(*rng);
+		float height = unit(*rng) < 0.05f ? 10.0f + 40.0f * unit(*rng) : size;
+		glm::vec3 min(position(*rng), 0.0f, position(*rng));
+		object = AABB(min, min + glm::vec3(size, height, size));
+	}
+	return objects;
+}
+
+Queries makeQueries(int count, std::mt19937* rng)
+{
+	std::uniform_real_distribution<float> position(0.0f, WORLD_SIZE);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, VIEW_DISTANCE);
+	Queries queries;
+	for (int i = 0; i < count; ++i)
+	{
+		// eye height looking around, the usual first person view
+		glm::vec3 eye(position(*rng), 1.8f, position(*rng));
+		float yaw = angle(*rng);
+		glm::vec3 forward(cosf(yaw), -0.1f, sinf(yaw));
+		queries.frustums.push_back(makeFrustum(projection * glm::lookAt(eye, eye + forward, glm::vec3(0, 1, 0))));
+
+		glm::vec3 min(position(*rng), WORLD_HEIGHT * 0.1f * unit(*rng), position(*rng));
+		queries.boxes.push_back(AABB(min, min + glm::vec3(QUERY_BOX_SIZE)));
+
+		float pitch = -0.5f * unit(*rng);
+		queries.ray_origins.push_back(glm::vec3(position(*rng), WORLD_HEIGHT * unit(*rng), position(*rng)));
+		queries.ray_directions.push_back(glm::normalize(glm::vec3(cosf(yaw) * cosf(pitch), sinf(pitch), sinf(yaw) * cosf(pitch))));
+	}
+	return queries;
+}
+
+size_t countBits(const std::vector<uint32_t>& mask)
+{
+	size_t count = 0;
+	for (uint32_t word : mask) count += std::bitset<32>(word).count();
+	return count;
+}
+
+bool overlaps(const AABB& a, const AABB& b)
+{
+	glm::vec3 a_min = a.getMin(), a_max = a.getMax(), b_min = b.getMin(), b_max = b.getMax();
+	return a_min.x <= b_max.x && a_max.x >= b_min.x && a_min.y <= b_max.y && a_max.y >= b_min.y
+		&& a_min.z <= b_max.z && a_max.z >= b_min.z;
+}
+
+bool intersectsRay(const AABB& box, const glm::vec3& origin, const glm::vec3& inverse, float max_distance)
+{
+	glm::vec3 t0 = (box.getMin() - origin) * inverse;
+	glm::vec3 t1 = (box.getMax() - origin) * inverse;
+	glm::vec3 t_min = glm::min(t0, t1);
+	glm::vec3 t_max = glm::max(t0, t1);
+	float enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.0f));
+	float exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_distance));
+	return enter <= exit;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: bench-bvh [--objects N] [--queries N] [--reps N] [--warmup N] [--out results.json]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	int object_count = 100000;
+	int query_count = 1000;
+	std::string out_path;
+	int repetitions = 20;
+	int warmup = 2;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (strcmp(arg, "--objects") == 0) object_count = atoi(value);
+		else if (strcmp(arg, "--queries") == 0) query_count = atoi(value);
+		else if (strcmp(arg, "--reps") == 0) repetitions = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0) warmup = atoi(value);
+		else if (strcmp(arg, "--out") == 0) out_path = value;
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (repetitions < 1 || object_count < 1 || query_count < 1)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 rng(1234);
+	std::vector<AABB> objects = makeObjects(object_count, &rng);
+	Queries queries = makeQueries(query_count, &rng);
+	printf("synthetic world: %d objects over %.0f x %.0f units, %d queries of each kind\n",
+		object_count, WORLD_SIZE, WORLD_SIZE, query_count);
+
+	enum { BUILD, UPDATE, REFIT, FRUSTUM, FRUSTUM_SCAN, FRUSTUM_SIMD, BOX, BOX_SCAN, BOX_SIMD, RAY, RAY_SCAN, STAGE_COUNT };
+	std::vector<BenchmarkStage> stages(STAGE_COUNT);
+	stages[BUILD].name = "build";
+	stages[UPDATE].name = "update moving";
+	stages[REFIT].name = "refit all";
+	stages[FRUSTUM].name = "frustum";
+	stages[FRUSTUM_SCAN].name = "frustum scan";
+	stages[FRUSTUM_SIMD].name = "frustum simd scan";
+	stages[BOX].name = "box";
+	stages[BOX_SCAN].name = "box scan";
+	stages[BOX_SIMD].name = "box simd scan";
+	stages[RAY].name = "ray";
+	stages[RAY_SCAN].name = "ray scan";
+
+	SceneBVH bvh;
+	std::vector<int> results;
+	AABBArray moved_array;
+	std::vector<uint32_t> outside, inside;
+	size_t found[STAGE_COUNT] = {};
+	float build_cost = 0, refit_cost = 0;
+	std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+	for (int rep = -warmup; rep < repetitions; ++rep)
+	{
+		double times[STAGE_COUNT] = {};
+		BenchmarkTimer timer;
+		bvh.build(objects.data(), object_count);
+		times[BUILD] = timer.milliseconds();
+		build_cost = bvh.getCost();
+
+		// a tenth of the objects wander a little every repetition, the tree gets no rebuild
+		// in between, so the queries below see it as refitting leaves it
+		int moving_count = (int)(object_count * MOVING_FRACTION);
+		std::vector<AABB> moved = objects;
+		timer.restart();
+		for (int i = 0; i < moving_count; ++i)
+		{
+			moved[i].translate(glm::vec3(step(rng), 0.0f, step(rng)) * 5.0f);
+			bvh.updateObject(i, moved[i]);
+		}
+		times[UPDATE] = timer.milliseconds();
+		timer.restart();
+		bvh.refit(moved.data());
+		times[REFIT] = timer.milliseconds();
+		refit_cost = bvh.getCost();
+
+		std::fill(found, found + STAGE_COUNT, 0);
+		timer.restart();
+		for (const Frustum& frustum : queries.frustums)
+		{
+			results.clear();
+			bvh.queryFrustum(frustum, &results);
+			found[FRUSTUM] += results.size();
+		}
+		times[FRUSTUM] = timer.milliseconds();
+		timer.restart();
+		for (const Frustum& frustum : queries.frustums)
+		{
+			for (const AABB& object : moved) found[FRUSTUM_SCAN] += frustum.intersectsBox(object.getMin(), object.getMax());
+		}
+		times[FRUSTUM_SCAN] = timer.milliseconds();
+		moved_array.clear();
+		for (const AABB& object : moved) moved_array.push_back(object);
+		outside.resize(moved_array.getMaskSize());
+		inside.resize(moved_array.getMaskSize());
+		timer.restart();
+		for (const Frustum& frustum : queries.frustums)
+		{
+			moved_array.classify(frustum.planes, 6, outside.data(), inside.data());
+			found[FRUSTUM_SIMD] += object_count - countBits(outside);
+		}
+		times[FRUSTUM_SIMD] = timer.milliseconds();
+
+		timer.restart();
+		for (const AABB& box : queries.boxes)
+		{
+			results.clear();
+			bvh.queryBox(box, &results);
+			found[BOX] += results.size();
+		}
+		times[BOX] = timer.milliseconds();
+		timer.restart();
+		for (const AABB& box : queries.boxes)
+		{
+			for (const AABB& object : moved) found[BOX_SCAN] += overlaps(box, object);
+		}
+		times[BOX_SCAN] = timer.milliseconds();
+		timer.restart();
+		for (const AABB& box : queries.boxes)
+		{
+			moved_array.overlaps(box, inside.data());
+			found[BOX_SIMD] += countBits(inside);
+		}
+		times[BOX_SIMD] = timer.milliseconds();
+
+		timer.restart();
+		for (int q = 0; q < query_count; ++q)
+		{
+			results.clear();
+			bvh.queryRay(queries.ray_origins[q], queries.ray_directions[q], RAY_LENGTH, &results);
+			found[RAY] += results.size();
+		}
+		times[RAY] = timer.milliseconds();
+		timer.restart();
+		for (int q = 0; q < query_count; ++q)
+		{
+			glm::vec3 inverse = glm::vec3(1.0f) / queries.ray_directions[q];
+			for (const AABB& object : moved) found[RAY_SCAN] += intersectsRay(object, queries.ray_origins[q], inverse, RAY_LENGTH);
+		}
+		times[RAY_SCAN] = timer.milliseconds();
+
+		if (rep >= 0)
+		{
+			for (int s = 0; s < STAGE_COUNT; ++s) stages[s].samples.push_back(times[s]);
+		}
+	}
+
+	// both sides test the same boxes the same way, any difference is a bug
+	bool match = found[FRUSTUM] == found[FRUSTUM_SCAN] && found[FRUSTUM] == found[FRUSTUM_SIMD]
+		&& found[BOX] == found[BOX_SCAN] && found[BOX] == found[BOX_SIMD] && found[RAY] == found[RAY_SCAN];
+	printf("%d nodes, depth %d, SAH cost %.1f after build, %.1f after refit\n",
+		bvh.getNodeCount(), bvh.getDepth(), build_cost, refit_cost);
+	printf("found per query: frustum %.1f, box %.1f, ray %.1f, %s the scans\n",
+		(double)found[FRUSTUM] / query_count, (double)found[BOX] / query_count, (double)found[RAY] / query_count,
+		match ? "same as" : "MISMATCH with");
+	printf("%d repetitions after %d warmup, AABBArray kernels: %s\n", repetitions, warmup, AABBArray::getISA());
+	printStages(stages);
+	printf("median per query, tree vs scan vs simd scan: frustum %.2f vs %.2f vs %.2f us, box %.2f vs %.2f vs %.2f us, ray %.2f vs %.2f us\n",
+		computeStats(stages[FRUSTUM].samples).median * 1e3 / query_count,
+		computeStats(stages[FRUSTUM_SCAN].samples).median * 1e3 / query_count,
+		computeStats(stages[FRUSTUM_SIMD].samples).median * 1e3 / query_count,
+		computeStats(stages[BOX].samples).median * 1e3 / query_count,
+		computeStats(stages[BOX_SCAN].samples).median * 1e3 / query_count,
+		computeStats(stages[BOX_SIMD].samples).median * 1e3 / query_count,
+		computeStats(stages[RAY].samples).median * 1e3 / query_count,
+		computeStats(stages[RAY_SCAN].samples).median * 1e3 / query_count);
+
+	if (!out_path.empty())
+	{
+		picojson::object config;
+		config["objects"] = picojson::value((double)object_count);
+		config["queries"] = picojson::value((double)query_count);
+		config["repetitions"] = picojson::value((double)repetitions);
+		config["warmup"] = picojson::value((double)warmup);
+		config["aabb_array_isa"] = picojson::value(std::string(AABBArray::getISA()));
+
+		picojson::object result;
+		result["benchmark"] = picojson::value(std::string("bvh"));
+		result["config"] = picojson::value(config);
+		result["nodes"] = picojson::value((double)bvh.getNodeCount());
+		result["depth"] = picojson::value((double)bvh.getDepth());
+		result["build_cost"] = picojson::value((double)build_cost);
+		result["refit_cost"] = picojson::value((double)refit_cost);
+		result["results_match"] = picojson::value(match);
+		result["stages"] = stagesToJson(stages);
+		if (!writeJson(out_path, picojson::value(result)))
+		{
+			fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
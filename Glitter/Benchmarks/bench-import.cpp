@@ -0,0 +1,237 @@
+// Import stage benchmark: generates a synthetic binary FBX in memory and times
+// each importer stage separately over several repetitions.
+//
+//   bench-import [--vertices N] [--meshes N] [--materials N] [--attributes nutc]
+//                [--bones N] [--frames N]
+//                [--reps N] [--warmup N] [--threads N] [--out results.json]
+//
+// --attributes picks the vertex streams: n(ormals) u(vs) t(angents) c(olors).
+// --bones skins the meshes to a chain of bones and --frames animates them, so the
+// animations stage samples and reduces a take; 0 for either leaves it out.
+
+#include "benchmark.hpp"
+#include "fbx-generator.hpp"
+#include "fbx-importer.hpp"
+#include "vertex-transform.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the bounds pass on its own: transforms the source positions of every
+// geometry with the importer scale and reduces their AABB
+void computeBounds(const FBXImporter& importer, std::vector<float>* scratch)
+{
+	static const float identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+	const ofbx::Mesh* previous = nullptr;
+	for (const FBXImporter::ImportMesh& mesh : importer.meshes)
+	{
+		if (mesh.fbx == previous) continue;
+		previous = mesh.fbx;
+		const ofbx::Geometry* geom = mesh.fbx->getGeometry();
+
+		VertexTransformInput input;
+		input.positions = &geom->getVertices()->x;
+		input.count = geom->getVertexCount();
+		scratch->resize(3 * (size_t)input.count);
+		VertexTransformOutput output;
+		output.positions = scratch->data();
+		output.stride = 3 * sizeof(float);
+		transformVertices(input, identity, importer.mesh_scale, &output);
+	}
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: bench-import [--vertices N] [--meshes N] [--materials N] [--attributes nutc]\n"
+		"                    [--bones N] [--frames N]\n"
+		"                    [--reps N] [--warmup N] [--threads N] [--out results.json]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	SyntheticSceneDesc desc;
+	desc.bone_count = 32;
+	desc.animation_frames = 300;
+	std::string attributes = "nu";
+	std::string out_path;
+	int repetitions = 10;
+	int warmup = 1;
+	int max_threads = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (strcmp(arg, "--vertices") == 0) desc.vertex_count = atoi(value);
+		else if (strcmp(arg, "--meshes") == 0) desc.mesh_count = atoi(value);
+		else if (strcmp(arg, "--materials") == 0) desc.material_count = atoi(value);
+		else if (strcmp(arg, "--attributes") == 0) attributes = value;
+		else if (strcmp(arg, "--bones") == 0) desc.bone_count = atoi(value);
+		else if (strcmp(arg, "--frames") == 0) desc.animation_frames = atoi(value);
+		else if (strcmp(arg, "--reps") == 0) repetitions = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0) warmup = atoi(value);
+		else if (strcmp(arg, "--threads") == 0) max_threads = atoi(value);
+		else if (strcmp(arg, "--out") == 0) out_path = value;
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	desc.normals = attributes.find('n') != std::string::npos;
+	desc.uvs = attributes.find('u') != std::string::npos;
+	desc.tangents = attributes.find('t') != std::string::npos;
+	desc.colors = attributes.find('c') != std::string::npos;
+	if (repetitions < 1 || desc.mesh_count < 1 || desc.vertex_count < 1 || desc.bone_count < 0
+		|| desc.bone_count > INT16_MAX || desc.animation_frames < 0)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	BenchmarkTimer generate_timer;
+	std::vector<uint8_t> fbx = generateSyntheticFbx(desc);
+	printf("synthetic scene: %d meshes x %d vertices, %d materials, attributes '%s', %d bones, %d frames, %.1f MB (generated in %.0f ms)\n",
+		desc.mesh_count, desc.vertex_count, desc.material_count, attributes.c_str(), desc.bone_count,
+		desc.animation_frames, fbx.size() / (1024.0 * 1024.0), generate_timer.milliseconds());
+	printf("transform kernel: %s\n", getVertexTransformISA());
+	if (fbx.size() > INT_MAX)
+	{
+		fprintf(stderr, "Scene too large for OpenFBX\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<BenchmarkStage> stages(6);
+	stages[0].name = "load";
+	stages[1].name = "gather";
+	stages[2].name = "animations";
+	stages[3].name = "postprocess";
+	stages[4].name = "optimize";
+	stages[5].name = "bounds";
+
+	size_t vertex_count = 0, index_count = 0;
+	int bone_count = 0, clip_count = 0, track_count = 0, frame_count = 0, unskinned_meshes = 0;
+	size_t key_count = 0;
+	std::vector<float> scratch;
+	for (int rep = -warmup; rep < repetitions; ++rep)
+	{
+		double times[6];
+		BenchmarkTimer timer;
+		ofbx::IScene* scene = ofbx::load(fbx.data(), (int)fbx.size());
+		times[0] = timer.milliseconds();
+		if (!scene)
+		{
+			fprintf(stderr, "ofbx::load failed: %s\n", ofbx::getError());
+			return EXIT_FAILURE;
+		}
+
+		FBXImporter importer;
+		importer.max_threads = max_threads;
+		importer.scenes.push_back(scene);
+		timer.restart();
+		importer.gatherMeshes(scene);
+		times[1] = timer.milliseconds();
+		timer.restart();
+		importer.gatherAnimations(scene);
+		importer.importAnimations();
+		times[2] = timer.milliseconds();
+		timer.restart();
+		importer.postprocessMeshes();
+		times[3] = timer.milliseconds();
+		timer.restart();
+		importer.optimizeMeshes();
+		times[4] = timer.milliseconds();
+		timer.restart();
+		computeBounds(importer, &scratch);
+		times[5] = timer.milliseconds();
+
+		vertex_count = index_count = 0;
+		unskinned_meshes = 0;
+		for (const FBXImporter::ImportMesh& mesh : importer.meshes)
+		{
+			vertex_count += mesh.getVertexCount();
+			index_count += mesh.indices.size();
+			unskinned_meshes += !mesh.layout.has(VERTEX_JOINTS);
+		}
+		bone_count = (int)importer.bones.size();
+		clip_count = track_count = 0;
+		key_count = 0;
+		for (const FBXImporter::ImportAnimation& animation : importer.animations)
+		{
+			for (const FBXImporter::AnimationClip& clip : animation.clips)
+			{
+				++clip_count;
+				frame_count = clip.frame_count;
+				track_count += (int)clip.tracks.size();
+				for (const FBXImporter::BoneTrack& track : clip.tracks) key_count += track.translations.size() + track.rotations.size();
+			}
+		}
+		importer.clearSources();
+
+		if (rep < 0) continue;
+		for (int i = 0; i < 6; ++i) stages[i].samples.push_back(times[i]);
+	}
+
+	printf("imported %zu vertices, %zu indices, %d bones, %d clips with %d tracks and %zu keys; %d repetitions after %d warmup\n",
+		vertex_count, index_count, bone_count, clip_count, track_count, key_count, repetitions, warmup);
+	printStages(stages);
+
+	// the generator knows what the file holds: every bone skins the meshes and has a
+	// rotation curve, and the one take keys every frame
+	bool skinned = desc.bone_count == 0 || (bone_count >= desc.bone_count && unskinned_meshes == 0);
+	bool animated = desc.bone_count == 0 || desc.animation_frames == 0
+		? clip_count == 0
+		: clip_count == 1 && track_count == desc.bone_count && frame_count == desc.animation_frames;
+	if (!skinned || !animated)
+	{
+		printf("MISMATCH with the generated scene: %d unskinned meshes, %d frames in the last clip\n",
+			unskinned_meshes, frame_count);
+	}
+
+	if (!out_path.empty())
+	{
+		picojson::object config;
+		config["meshes"] = picojson::value((double)desc.mesh_count);
+		config["vertices_per_mesh"] = picojson::value((double)desc.vertex_count);
+		config["materials_per_mesh"] = picojson::value((double)desc.material_count);
+		config["attributes"] = picojson::value(attributes);
+		config["bones"] = picojson::value((double)desc.bone_count);
+		config["frames"] = picojson::value((double)desc.animation_frames);
+		config["repetitions"] = picojson::value((double)repetitions);
+		config["warmup"] = picojson::value((double)warmup);
+		config["max_threads"] = picojson::value((double)max_threads);
+		config["transform_isa"] = picojson::value(std::string(getVertexTransformISA()));
+
+		picojson::object result;
+		result["benchmark"] = picojson::value(std::string("import"));
+		result["config"] = picojson::value(config);
+		result["fbx_bytes"] = picojson::value((double)fbx.size());
+		result["imported_vertices"] = picojson::value((double)vertex_count);
+		result["imported_indices"] = picojson::value((double)index_count);
+		result["imported_bones"] = picojson::value((double)bone_count);
+		result["imported_tracks"] = picojson::value((double)track_count);
+		result["imported_keys"] = picojson::value((double)key_count);
+		result["matches_scene"] = picojson::value(skinned && animated);
+		result["stages"] = stagesToJson(stages);
+		if (!writeJson(out_path, picojson::value(result)))
+		{
+			fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return skinned && animated ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,278 @@
+// Meshlet culling benchmark: builds the meshlets of a bumpy sphere, the way the importer
+// does, and times cullMeshlets for cameras around and inside it next to testing every
+// triangle. Every meshlet it culls is checked triangle by triangle: one that still has a
+// triangle facing the camera and not outside a frustum plane fails the run.
+//
+//   bench-meshlet [--vertices N] [--cameras N] [--reps N] [--warmup N] [--out results.json]
+
+#include "benchmark.hpp"
+#include "frustum.hpp"
+#include "mesh-optimizer.hpp"
+#include "meshlet.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int MAX_VERTICES = 64;   // FBXImporter's defaults
+const int MAX_TRIANGLES = 124;
+const int VERTEX_CACHE_SIZE = 16;
+// a triangle seen this close to edge on may round either way in the cone test
+const float FACING_TOLERANCE = 1e-4f;
+
+struct Mesh
+{
+	std::vector<float> positions;
+	std::vector<int> indices;
+
+	glm::vec3 getPosition(int vertex) const { return glm::vec3(positions[vertex * 3], positions[vertex * 3 + 1], positions[vertex * 3 + 2]); }
+};
+
+// A sphere of rings and segments with waves on its surface, so meshlets on the bumps
+// have wide normal cones and those between them narrow ones. Triangles face outwards.
+Mesh makeMesh(int vertex_count)
+{
+	int segments = std::max(8, (int)sqrtf(vertex_count * 2.0f));
+	int rings = std::max(4, segments / 2);
+	Mesh mesh;
+	for (int ring = 0; ring <= rings; ++ring)
+	{
+		float theta = 3.14159265f * ring / rings;
+		for (int segment = 0; segment < segments; ++segment)
+		{
+			float phi = 6.2831853f * segment / segments;
+			float radius = 1.0f + 0.1f * sinf(5 * theta) * cosf(7 * phi);
+			mesh.positions.push_back(radius * sinf(theta) * cosf(phi));
+			mesh.positions.push_back(radius * cosf(theta));
+			mesh.positions.push_back(radius * sinf(theta) * sinf(phi));
+		}
+	}
+	for (int ring = 0; ring < rings; ++ring)
+	{
+		for (int segment = 0; segment < segments; ++segment)
+		{
+			int a = ring * segments + segment;
+			int b = ring * segments + (segment + 1) % segments;
+			int c = a + segments;
+			int d = b + segments;
+			// the poles collapse one triangle of each quad
+			if (ring > 0)
+			{
+				mesh.indices.push_back(a);
+				mesh.indices.push_back(b);
+				mesh.indices.push_back(c);
+			}
+			if (ring < rings - 1)
+			{
+				mesh.indices.push_back(b);
+				mesh.indices.push_back(d);
+				mesh.indices.push_back(c);
+			}
+		}
+	}
+	std::vector<int> optimized(mesh.indices.size());
+	optimizeVertexCache(optimized.data(), mesh.indices.data(), (int)mesh.indices.size(), (int)mesh.positions.size() / 3,
+		VERTEX_CACHE_SIZE);
+	mesh.indices.swap(optimized);
+	return mesh;
+}
+
+struct Camera
+{
+	glm::vec3 position;
+	Frustum frustum;
+};
+
+// mostly around the sphere looking somewhere near it, a few inside, where every
+// triangle faces away
+std::vector<Camera> makeCameras(int count, std::mt19937* rng)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> normal;
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+	std::vector<Camera> cameras(count);
+	for (int i = 0; i < count; ++i)
+	{
+		glm::vec3 direction = glm::normalize(glm::vec3(normal(*rng), normal(*rng), normal(*rng)) + glm::vec3(0, 0, 1e-3f));
+		float distance = i % 10 == 0 ? 0.5f * unit(*rng) : 1.3f + 4.0f * unit(*rng);
+		glm::vec3 target = glm::vec3(unit(*rng), unit(*rng), unit(*rng)) - glm::vec3(0.5f);
+		glm::vec3 up = fabsf(direction.y) > 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+		cameras[i].position = direction * distance;
+		cameras[i].frustum = makeFrustum(projection * glm::lookAt(cameras[i].position, target, up));
+	}
+	return cameras;
+}
+
+// Whether a camera could see the triangle: it faces the camera and is not entirely
+// outside one frustum plane. The meshlet's sphere holds its vertices, so a triangle
+// passing this keeps its meshlet inside the frustum too.
+bool isTriangleVisible(const Mesh& mesh, const int* triangle, const Camera& camera)
+{
+	glm::vec3 p0 = mesh.getPosition(triangle[0]);
+	glm::vec3 p1 = mesh.getPosition(triangle[1]);
+	glm::vec3 p2 = mesh.getPosition(triangle[2]);
+	glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	glm::vec3 to_camera = camera.position - p0;
+	if (glm::dot(normal, to_camera) <= FACING_TOLERANCE * glm::length(normal) * glm::length(to_camera)) return false;
+	for (const glm::vec4& plane : camera.frustum.planes)
+	{
+		glm::vec3 n(plane);
+		if (glm::dot(n, p0) + plane.w < 0 && glm::dot(n, p1) + plane.w < 0 && glm::dot(n, p2) + plane.w < 0) return false;
+	}
+	return true;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: bench-meshlet [--vertices N] [--cameras N] [--reps N] [--warmup N] [--out results.json]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	int vertex_count = 50000;
+	int camera_count = 100;
+	std::string out_path;
+	int repetitions = 10;
+	int warmup = 2;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (strcmp(arg, "--vertices") == 0) vertex_count = atoi(value);
+		else if (strcmp(arg, "--cameras") == 0) camera_count = atoi(value);
+		else if (strcmp(arg, "--reps") == 0) repetitions = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0) warmup = atoi(value);
+		else if (strcmp(arg, "--out") == 0) out_path = value;
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (repetitions < 1 || vertex_count < 1 || camera_count < 1)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 rng(1234);
+	Mesh mesh = makeMesh(vertex_count);
+	int triangle_count = (int)mesh.indices.size() / 3;
+	std::vector<Meshlet> meshlets;
+	BenchmarkTimer build_timer;
+	buildMeshlets(&meshlets, mesh.indices.data(), (int)mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float),
+		(int)mesh.positions.size() / 3, MAX_VERTICES, MAX_TRIANGLES);
+	double build_time = build_timer.milliseconds();
+	int coned = 0;
+	for (const Meshlet& meshlet : meshlets) coned += meshlet.cone_cutoff < 1;
+	std::vector<Camera> cameras = makeCameras(camera_count, &rng);
+	printf("synthetic mesh: %d vertices, %d triangles in %zu meshlets (built in %.1f ms), %d with a normal cone; %d cameras\n",
+		(int)mesh.positions.size() / 3, triangle_count, meshlets.size(), build_time, coned, camera_count);
+
+	enum { MESHLETS, TRIANGLES, STAGE_COUNT };
+	std::vector<BenchmarkStage> stages(STAGE_COUNT);
+	stages[MESHLETS].name = "cull meshlets";
+	stages[TRIANGLES].name = "test triangles";
+
+	std::vector<MeshletDraw> draws;
+	size_t visible_meshlets = 0, visible_triangles = 0;
+	for (int rep = -warmup; rep < repetitions; ++rep)
+	{
+		double times[STAGE_COUNT] = {};
+		visible_meshlets = visible_triangles = 0;
+		for (const Camera& camera : cameras)
+		{
+			draws.clear();
+			BenchmarkTimer timer;
+			visible_meshlets += cullMeshlets(meshlets.data(), (int)meshlets.size(), camera.frustum, camera.position, &draws);
+			times[MESHLETS] += timer.milliseconds();
+
+			timer.restart();
+			for (int t = 0; t < triangle_count; ++t) visible_triangles += isTriangleVisible(mesh, &mesh.indices[t * 3], camera);
+			times[TRIANGLES] += timer.milliseconds();
+		}
+		if (rep >= 0)
+		{
+			for (int s = 0; s < STAGE_COUNT; ++s) stages[s].samples.push_back(times[s]);
+		}
+	}
+
+	// the draws are merged, sorted ranges; a meshlet is drawn when its first index is in one
+	size_t drawn_triangles = 0;
+	int wrongly_culled = 0;
+	for (const Camera& camera : cameras)
+	{
+		draws.clear();
+		cullMeshlets(meshlets.data(), (int)meshlets.size(), camera.frustum, camera.position, &draws);
+		size_t draw = 0;
+		for (const Meshlet& meshlet : meshlets)
+		{
+			while (draw < draws.size() && draws[draw].index_offset + draws[draw].index_count <= meshlet.index_offset) ++draw;
+			if (draw < draws.size() && draws[draw].index_offset <= meshlet.index_offset)
+			{
+				drawn_triangles += meshlet.triangle_count;
+				continue;
+			}
+			for (uint32_t t = 0; t < meshlet.triangle_count; ++t)
+			{
+				if (!isTriangleVisible(mesh, &mesh.indices[meshlet.index_offset + t * 3], camera)) continue;
+				++wrongly_culled;
+				break;
+			}
+		}
+	}
+
+	printf("per camera: %.1f of %zu meshlets drawn, %.0f triangles drawn of %d, %.0f facing the camera in the frustum\n",
+		(double)visible_meshlets / camera_count, meshlets.size(), (double)drawn_triangles / camera_count, triangle_count,
+		(double)visible_triangles / camera_count);
+	printf("%d culled meshlets still had a visible triangle\n", wrongly_culled);
+	printf("%d repetitions of all cameras after %d warmup\n", repetitions, warmup);
+	printStages(stages);
+	printf("median per camera: meshlets %.3f ms (%.1f ns each), triangles %.3f ms\n",
+		computeStats(stages[MESHLETS].samples).median / camera_count,
+		computeStats(stages[MESHLETS].samples).median * 1e6 / ((double)camera_count * meshlets.size()),
+		computeStats(stages[TRIANGLES].samples).median / camera_count);
+
+	if (!out_path.empty())
+	{
+		picojson::object config;
+		config["vertices"] = picojson::value((double)vertex_count);
+		config["cameras"] = picojson::value((double)camera_count);
+		config["repetitions"] = picojson::value((double)repetitions);
+		config["warmup"] = picojson::value((double)warmup);
+
+		picojson::object result;
+		result["benchmark"] = picojson::value(std::string("meshlet"));
+		result["config"] = picojson::value(config);
+		result["meshlets"] = picojson::value((double)meshlets.size());
+		result["meshlets_drawn"] = picojson::value((double)visible_meshlets / camera_count);
+		result["triangles_drawn"] = picojson::value((double)drawn_triangles / camera_count);
+		result["triangles_visible"] = picojson::value((double)visible_triangles / camera_count);
+		result["wrongly_culled"] = picojson::value((double)wrongly_culled);
+		result["stages"] = stagesToJson(stages);
+		if (!writeJson(out_path, picojson::value(result)))
+		{
+			fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return wrongly_culled ? EXIT_FAILURE : EXIT_SUCCESS;
+}
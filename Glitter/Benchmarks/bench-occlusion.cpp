@@ -0,0 +1,371 @@
+// Occlusion culling benchmark: builds a synthetic interior, a grid of rooms joined by
+// doorways and full of props, and for views from inside the rooms times setting up the
+// walls as occluders, rasterizing them and testing the boxes of the props that pass
+// frustum culling against the result, so the share of hidden props shows. Every prop
+// the culler hides is checked with rays through its pixels, a visible one fails the run.
+//
+//   bench-occlusion [--rooms N] [--props N] [--views N] [--width N] [--height N]
+//                   [--reps N] [--warmup N] [--threads N] [--out results.json]
+
+#include "benchmark.hpp"
+#include "frustum.hpp"
+#include "occlusion-culler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef CPM_GLM_AABB_NS::AABB AABB;
+
+const float ROOM_SIZE = 10.0f;
+const float ROOM_HEIGHT = 4.0f;
+const float WALL_THICKNESS = 0.2f;
+const float DOOR_WIDTH = 1.5f;
+const float DOOR_HEIGHT = 2.5f;
+const float EYE_HEIGHT = 1.7f;
+const float VIEW_DISTANCE = 200.0f;
+// the rays of the check treat walls as this much bigger, a ray grazing an edge may go
+// either way in the rasterizer
+const float WALL_SLACK = 1e-3f;
+
+// every wall piece is a box, as one mesh: 8 corners and 12 triangles each
+struct Occluders
+{
+	std::vector<float> positions;
+	std::vector<int> indices;
+	std::vector<AABB> boxes; // the same walls, for the check
+};
+
+void addBox(Occluders* occluders, const glm::vec3& min, const glm::vec3& max)
+{
+	static const int faces[36] = {
+		0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5
+	};
+	int first = (int)occluders->positions.size() / 3;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		occluders->positions.push_back(corner & 1 ? max.x : min.x);
+		occluders->positions.push_back(corner & 2 ? max.y : min.y);
+		occluders->positions.push_back(corner & 4 ? max.z : min.z);
+	}
+	for (int index : faces) occluders->indices.push_back(first + index);
+	occluders->boxes.push_back(AABB(min, max));
+}
+
+// A wall along x or z from \p start, one room long, with a doorway in the middle:
+// the pieces left and right of it and the lintel above.
+void addWall(Occluders* occluders, const glm::vec3& start, bool along_x)
+{
+	glm::vec3 axis = along_x ? glm::vec3(1, 0, 0) : glm::vec3(0, 0, 1);
+	glm::vec3 across = glm::vec3(WALL_THICKNESS * 0.5f) * (glm::vec3(1, 0, 1) - axis);
+	float door_start = (ROOM_SIZE - DOOR_WIDTH) * 0.5f;
+	float door_end = door_start + DOOR_WIDTH;
+	glm::vec3 up(0, ROOM_HEIGHT, 0);
+	addBox(occluders, start - across, start + axis * door_start + across + up);
+	addBox(occluders, start + axis * door_end - across, start + axis * ROOM_SIZE + across + up);
+	addBox(occluders, start + axis * door_start - across + glm::vec3(0, DOOR_HEIGHT, 0),
+		start + axis * door_end + across + up);
+}
+
+Occluders makeWalls(int rooms)
+{
+	Occluders occluders;
+	for (int i = 0; i <= rooms; ++i)
+	{
+		for (int j = 0; j < rooms; ++j)
+		{
+			addWall(&occluders, glm::vec3(j * ROOM_SIZE, 0, i * ROOM_SIZE), true);
+			addWall(&occluders, glm::vec3(i * ROOM_SIZE, 0, j * ROOM_SIZE), false);
+		}
+	}
+	return occluders;
+}
+
+// furniture sized boxes standing on the floor, away from the walls
+std::vector<AABB> makeProps(int rooms, int props_per_room, std::mt19937* rng)
+{
+	std::uniform_real_distribution<float> inside(1.0f, ROOM_SIZE - 1.0f);
+	std::uniform_real_distribution<float> size(0.2f, 1.0f);
+	std::vector<AABB> props;
+	for (int room = 0; room < rooms * rooms; ++room)
+	{
+		glm::vec3 corner((room % rooms) * ROOM_SIZE, 0, (room / rooms) * ROOM_SIZE);
+		for (int i = 0; i < props_per_room; ++i)
+		{
+			glm::vec3 min = corner + glm::vec3(inside(*rng), 0, inside(*rng));
+			props.push_back(AABB(min, min + glm::vec3(size(*rng), 2 * size(*rng), size(*rng))));
+		}
+	}
+	return props;
+}
+
+// standing somewhere in a room, looking around
+std::vector<glm::mat4> makeViews(int rooms, int count, float aspect, std::mt19937* rng)
+{
+	std::uniform_real_distribution<float> position(0.5f, rooms * ROOM_SIZE - 0.5f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	glm::mat4 projection = glm::perspective(glm::radians(70.0f), aspect, 0.1f, VIEW_DISTANCE);
+	std::vector<glm::mat4> views;
+	for (int i = 0; i < count; ++i)
+	{
+		glm::vec3 eye(position(*rng), EYE_HEIGHT, position(*rng));
+		float yaw = angle(*rng);
+		glm::vec3 forward(cosf(yaw), -0.05f, sinf(yaw));
+		views.push_back(projection * glm::lookAt(eye, eye + forward, glm::vec3(0, 1, 0)));
+	}
+	return views;
+}
+
+// Slab test of the ray origin + t * direction against a box, t from 0 to 1.
+bool intersectBox(const glm::vec3& origin, const glm::vec3& inv_direction, const glm::vec3& min, const glm::vec3& max,
+	float* t_enter)
+{
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+	float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+	float exit = std::min(std::min(far.x, far.y), std::min(far.z, 1.0f));
+	*t_enter = enter;
+	return enter <= exit;
+}
+
+// Reference for isVisible: whether a ray through the center of any pixel of the box's
+// screen rectangle reaches the box before every wall. The culler samples coverage at
+// the same centers, so it may only hide a box no such ray sees. \p walls should be
+// sorted nearest first, a hidden box then stops at one of the first few.
+bool isVisibleByRays(const AABB& box, const glm::mat4& view_projection, const glm::mat4& inverse, int width, int height,
+	const std::vector<AABB>& walls)
+{
+	glm::vec2 screen_min(INFINITY), screen_max(-INFINITY);
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec3 p(corner & 1 ? box.getMax().x : box.getMin().x, corner & 2 ? box.getMax().y : box.getMin().y,
+			corner & 4 ? box.getMax().z : box.getMin().z);
+		glm::vec4 clip = view_projection * glm::vec4(p, 1.0f);
+		// boxes reaching the near plane are never hidden
+		if (clip.w <= 0 || clip.z < -clip.w) return true;
+		glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+		screen_min = glm::min(screen_min, ndc);
+		screen_max = glm::max(screen_max, ndc);
+	}
+	int x0 = std::max(0, (int)floorf((screen_min.x * 0.5f + 0.5f) * width));
+	int y0 = std::max(0, (int)floorf((screen_min.y * 0.5f + 0.5f) * height));
+	int x1 = std::min(width - 1, (int)floorf((screen_max.x * 0.5f + 0.5f) * width));
+	int y1 = std::min(height - 1, (int)floorf((screen_max.y * 0.5f + 0.5f) * height));
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			glm::vec2 ndc((x + 0.5f) / width * 2 - 1, (y + 0.5f) / height * 2 - 1);
+			glm::vec4 near = inverse * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+			glm::vec4 far = inverse * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+			glm::vec3 origin = glm::vec3(near) / near.w;
+			glm::vec3 inv_direction = glm::vec3(1.0f) / (glm::vec3(far) / far.w - origin);
+			float t_box;
+			if (!intersectBox(origin, inv_direction, box.getMin(), box.getMax(), &t_box)) continue;
+			bool blocked = false;
+			for (size_t i = 0; i < walls.size() && !blocked; ++i)
+			{
+				float t_wall;
+				blocked = intersectBox(origin, inv_direction, walls[i].getMin() - glm::vec3(WALL_SLACK),
+					walls[i].getMax() + glm::vec3(WALL_SLACK), &t_wall) && t_wall <= t_box;
+			}
+			if (!blocked) return true;
+		}
+	}
+	return false;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: bench-occlusion [--rooms N] [--props N] [--views N] [--width N] [--height N]\n"
+		"                       [--reps N] [--warmup N] [--threads N] [--out results.json]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	int rooms = 16;
+	int props_per_room = 40;
+	int view_count = 100;
+	int width = 256;
+	int height = 128;
+	int max_threads = 0;
+	std::string out_path;
+	int repetitions = 10;
+	int warmup = 2;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (strcmp(arg, "--rooms") == 0) rooms = atoi(value);
+		else if (strcmp(arg, "--props") == 0) props_per_room = atoi(value);
+		else if (strcmp(arg, "--views") == 0) view_count = atoi(value);
+		else if (strcmp(arg, "--width") == 0) width = atoi(value);
+		else if (strcmp(arg, "--height") == 0) height = atoi(value);
+		else if (strcmp(arg, "--threads") == 0) max_threads = atoi(value);
+		else if (strcmp(arg, "--reps") == 0) repetitions = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0) warmup = atoi(value);
+		else if (strcmp(arg, "--out") == 0) out_path = value;
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (repetitions < 1 || rooms < 1 || props_per_room < 1 || view_count < 1 || width < 1 || height < 1)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 rng(1234);
+	Occluders walls = makeWalls(rooms);
+	std::vector<AABB> props = makeProps(rooms, props_per_room, &rng);
+	std::vector<glm::mat4> views = makeViews(rooms, view_count, (float)width / height, &rng);
+	int wall_vertex_count = (int)walls.positions.size() / 3;
+	printf("synthetic interior: %d x %d rooms, %d wall triangles, %d props, %d views, %d x %d depth buffer\n",
+		rooms, rooms, (int)walls.indices.size() / 3, (int)props.size(), view_count, width, height);
+
+	enum { SETUP, RASTERIZE, RASTERIZE_SERIAL, FRUSTUM, TEST, STAGE_COUNT };
+	std::vector<BenchmarkStage> stages(STAGE_COUNT);
+	stages[SETUP].name = "occluder setup";
+	stages[RASTERIZE].name = "rasterize";
+	stages[RASTERIZE_SERIAL].name = "rasterize 1 thread";
+	stages[FRUSTUM].name = "frustum test";
+	stages[TEST].name = "occlusion test";
+
+	OcclusionCuller culler;
+	culler.resize(width, height);
+	std::vector<int> candidates;
+	size_t in_frustum = 0, visible = 0, occluder_triangles = 0;
+	for (int rep = -warmup; rep < repetitions; ++rep)
+	{
+		double times[STAGE_COUNT] = {};
+		in_frustum = visible = occluder_triangles = 0;
+		for (const glm::mat4& view : views)
+		{
+			BenchmarkTimer timer;
+			culler.begin(view);
+			culler.addOccluder(walls.indices.data(), (int)walls.indices.size(), walls.positions.data(),
+				3 * sizeof(float), wall_vertex_count, glm::mat4(1.0f));
+			times[SETUP] += timer.milliseconds();
+			occluder_triangles += culler.getTriangleCount();
+
+			// same work twice, to compare the threaded tiles with a single thread
+			timer.restart();
+			culler.rasterize(1);
+			times[RASTERIZE_SERIAL] += timer.milliseconds();
+			timer.restart();
+			culler.rasterize(max_threads);
+			times[RASTERIZE] += timer.milliseconds();
+
+			Frustum frustum = makeFrustum(view);
+			candidates.clear();
+			timer.restart();
+			for (int i = 0; i < (int)props.size(); ++i)
+			{
+				if (frustum.intersectsBox(props[i].getMin(), props[i].getMax())) candidates.push_back(i);
+			}
+			times[FRUSTUM] += timer.milliseconds();
+			in_frustum += candidates.size();
+
+			timer.restart();
+			for (int i : candidates) visible += culler.isVisible(props[i]);
+			times[TEST] += timer.milliseconds();
+		}
+
+		if (rep >= 0)
+		{
+			for (int s = 0; s < STAGE_COUNT; ++s) stages[s].samples.push_back(times[s]);
+		}
+	}
+
+	// the check runs outside the timed loop, once per view
+	size_t culled = 0;
+	int wrongly_culled = 0;
+	std::vector<AABB> walls_by_distance = walls.boxes;
+	for (const glm::mat4& view : views)
+	{
+		culler.begin(view);
+		culler.addOccluder(walls.indices.data(), (int)walls.indices.size(), walls.positions.data(),
+			3 * sizeof(float), wall_vertex_count, glm::mat4(1.0f));
+		culler.rasterize(max_threads);
+		glm::mat4 inverse = glm::inverse(view);
+		glm::vec4 eye = inverse * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+		glm::vec3 eye_position = glm::vec3(eye) / eye.w;
+		auto distance = [&eye_position](const AABB& box) {
+			return glm::length(glm::max(box.getMin(), glm::min(eye_position, box.getMax())) - eye_position);
+		};
+		std::sort(walls_by_distance.begin(), walls_by_distance.end(),
+			[&distance](const AABB& a, const AABB& b) { return distance(a) < distance(b); });
+		Frustum frustum = makeFrustum(view);
+		for (const AABB& prop : props)
+		{
+			if (!frustum.intersectsBox(prop.getMin(), prop.getMax()) || culler.isVisible(prop)) continue;
+			++culled;
+			wrongly_culled += isVisibleByRays(prop, view, inverse, width, height, walls_by_distance);
+		}
+	}
+
+	double hidden = in_frustum ? 1.0 - (double)visible / in_frustum : 0.0;
+	printf("per view: %.0f occluder triangles set up, %.1f props in the frustum, %.1f visible (%.1f%% hidden)\n",
+		(double)occluder_triangles / view_count, (double)in_frustum / view_count, (double)visible / view_count,
+		hidden * 100);
+	printf("%zu props culled over all views, %d of them seen by rays through their pixels\n", culled, wrongly_culled);
+	printf("%d repetitions of all views after %d warmup, rasterizer: %s\n", repetitions, warmup, OcclusionCuller::getISA());
+	printStages(stages);
+	printf("median per view: setup %.3f ms, rasterize %.3f ms (%.3f ms on 1 thread), test %.3f ms (%.1f ns per box)\n",
+		computeStats(stages[SETUP].samples).median / view_count,
+		computeStats(stages[RASTERIZE].samples).median / view_count,
+		computeStats(stages[RASTERIZE_SERIAL].samples).median / view_count,
+		computeStats(stages[TEST].samples).median / view_count,
+		in_frustum ? computeStats(stages[TEST].samples).median * 1e6 / in_frustum : 0.0);
+
+	if (!out_path.empty())
+	{
+		picojson::object config;
+		config["rooms"] = picojson::value((double)rooms);
+		config["props_per_room"] = picojson::value((double)props_per_room);
+		config["views"] = picojson::value((double)view_count);
+		config["width"] = picojson::value((double)width);
+		config["height"] = picojson::value((double)height);
+		config["threads"] = picojson::value((double)max_threads);
+		config["repetitions"] = picojson::value((double)repetitions);
+		config["warmup"] = picojson::value((double)warmup);
+		config["isa"] = picojson::value(std::string(OcclusionCuller::getISA()));
+
+		picojson::object result;
+		result["benchmark"] = picojson::value(std::string("occlusion"));
+		result["config"] = picojson::value(config);
+		result["props_in_frustum"] = picojson::value((double)in_frustum / view_count);
+		result["props_visible"] = picojson::value((double)visible / view_count);
+		result["hidden_fraction"] = picojson::value(hidden);
+		result["wrongly_culled"] = picojson::value((double)wrongly_culled);
+		result["stages"] = stagesToJson(stages);
+		if (!writeJson(out_path, picojson::value(result)))
+		{
+			fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return wrongly_culled ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+// Pose sampling benchmark: generates a skinned FBX scene with a take, imports it
+// split into clips, then times samplePoses for a crowd of instances, each at its
+// own clip and time. The clips go through importAnimations, so their key density
+// and layout are those of an imported asset.
+//
+//   bench-pose [--instances N] [--bones N] [--clips N] [--frames N]
+//              [--reps N] [--warmup N] [--threads N] [--out results.json]
+
+#include "benchmark.hpp"
+#include "fbx-generator.hpp"
+#include "fbx-importer.hpp"
+#include "pose-sampler.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// One small mesh skinned to a chain of bone_count bones and a take of clip_count
+// clips back to back, imported the way the viewer does. The skeleton may hold more
+// bones than asked for, the scene nodes above the chain count too.
+bool importClips(int bone_count, int clip_count, int frame_count, PoseSkeleton* skeleton, std::vector<PoseClip>* clips)
+{
+	SyntheticSceneDesc desc;
+	desc.vertex_count = 1024;
+	desc.bone_count = bone_count;
+	desc.animation_frames = clip_count * frame_count;
+	std::vector<uint8_t> fbx = generateSyntheticFbx(desc);
+	ofbx::IScene* scene = ofbx::load(fbx.data(), (int)fbx.size());
+	if (!scene)
+	{
+		fprintf(stderr, "ofbx::load failed: %s\n", ofbx::getError());
+		return false;
+	}
+
+	FBXImporter importer;
+	importer.scenes.push_back(scene);
+	importer.gatherMeshes(scene);
+	importer.gatherAnimations(scene);
+	if (importer.animations.size() != 1)
+	{
+		fprintf(stderr, "expected one take, found %zu\n", importer.animations.size());
+		importer.clearSources();
+		return false;
+	}
+	FBXImporter::ImportAnimation& animation = importer.animations[0];
+	for (int i = 0; i < clip_count; ++i)
+	{
+		FBXImporter::ImportAnimation::Split split;
+		split.from_frame = i * frame_count;
+		split.to_frame = (i + 1) * frame_count - 1;
+		split.name = "clip" + std::to_string(i);
+		animation.splits.push_back(split);
+	}
+	importer.importAnimations();
+
+	*skeleton = makePoseSkeleton(importer);
+	for (const FBXImporter::AnimationClip& clip : animation.clips) clips->push_back(makePoseClip(clip, *skeleton));
+	importer.clearSources();
+	if ((int)clips->size() != clip_count)
+	{
+		fprintf(stderr, "expected %d clips, imported %zu\n", clip_count, clips->size());
+		return false;
+	}
+	return true;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: bench-pose [--instances N] [--bones N] [--clips N] [--frames N]\n"
+		"                  [--reps N] [--warmup N] [--threads N] [--out results.json]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	int instance_count = 2048;
+	int bone_count = 64;
+	int clip_count = 8;
+	int frame_count = 120;
+	std::string out_path;
+	int repetitions = 50;
+	int warmup = 5;
+	int max_threads = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (strcmp(arg, "--instances") == 0) instance_count = atoi(value);
+		else if (strcmp(arg, "--bones") == 0) bone_count = atoi(value);
+		else if (strcmp(arg, "--clips") == 0) clip_count = atoi(value);
+		else if (strcmp(arg, "--frames") == 0) frame_count = atoi(value);
+		else if (strcmp(arg, "--reps") == 0) repetitions = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0) warmup = atoi(value);
+		else if (strcmp(arg, "--threads") == 0) max_threads = atoi(value);
+		else if (strcmp(arg, "--out") == 0) out_path = value;
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (repetitions < 1 || instance_count < 1 || bone_count < 1 || bone_count > INT16_MAX || clip_count < 1
+		|| frame_count < 2 || frame_count > 0x10000)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	BenchmarkTimer import_timer;
+	PoseSkeleton skeleton;
+	std::vector<PoseClip> clips;
+	if (!importClips(bone_count, clip_count, frame_count, &skeleton, &clips)) return EXIT_FAILURE;
+	double import_time = import_timer.milliseconds();
+	int skeleton_bones = skeleton.getBoneCount();
+	size_t key_count = 0;
+	for (const PoseClip& clip : clips) key_count += clip.translation_frames.size() + clip.rotation_frames.size();
+	printf("synthetic crowd: %d instances, %d bones, %d clips x %d frames, %.1f keys per bone and clip (imported in %.0f ms)\n",
+		instance_count, skeleton_bones, clip_count, frame_count, (double)key_count / (skeleton_bones * clip_count), import_time);
+	printf("pose kernel: %s\n", getPoseSamplerISA());
+
+	std::mt19937 rng(1234);
+	std::vector<PoseInstance> instances(instance_count);
+	std::uniform_real_distribution<float> start(0.0f, 1.0f);
+	for (int i = 0; i < instance_count; ++i)
+	{
+		instances[i].clip = &clips[i % clip_count];
+		instances[i].time = start(rng) * instances[i].clip->getDuration();
+	}
+	std::vector<BoneTransform> poses((size_t)instance_count * skeleton_bones);
+
+	std::vector<BenchmarkStage> stages(1);
+	stages[0].name = "sample";
+	const float frame_time = 1.0f / 60.0f;
+	for (int rep = -warmup; rep < repetitions; ++rep)
+	{
+		// every frame advances and loops the clips, like a game tick would
+		for (PoseInstance& instance : instances)
+		{
+			instance.time += frame_time;
+			if (instance.time > instance.clip->getDuration()) instance.time -= instance.clip->getDuration();
+		}
+		BenchmarkTimer timer;
+		samplePoses(skeleton, instances.data(), instance_count, poses.data(), max_threads);
+		double time = timer.milliseconds();
+		if (rep >= 0) stages[0].samples.push_back(time);
+	}
+
+	// keeps the poses observable and doubles as a sanity check
+	double checksum = 0;
+	for (const BoneTransform& pose : poses) checksum += pose.position[1] + pose.rotation[3];
+	BenchmarkStats stats = computeStats(stages[0].samples);
+	printf("posed %d bones per frame; %d repetitions after %d warmup, checksum %.3f\n",
+		instance_count * skeleton_bones, repetitions, warmup, checksum);
+	printStages(stages);
+	printf("median %.1f ns per bone\n", stats.median * 1e6 / ((double)instance_count * skeleton_bones));
+
+	if (!out_path.empty())
+	{
+		picojson::object config;
+		config["instances"] = picojson::value((double)instance_count);
+		config["bones"] = picojson::value((double)bone_count);
+		config["clips"] = picojson::value((double)clip_count);
+		config["frames"] = picojson::value((double)frame_count);
+		config["repetitions"] = picojson::value((double)repetitions);
+		config["warmup"] = picojson::value((double)warmup);
+		config["max_threads"] = picojson::value((double)max_threads);
+		config["pose_isa"] = picojson::value(std::string(getPoseSamplerISA()));
+
+		picojson::object result;
+		result["benchmark"] = picojson::value(std::string("pose"));
+		result["config"] = picojson::value(config);
+		result["skeleton_bones"] = picojson::value((double)skeleton_bones);
+		result["keys"] = picojson::value((double)key_count);
+		result["stages"] = stagesToJson(stages);
+		if (!writeJson(out_path, picojson::value(result)))
+		{
+			fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
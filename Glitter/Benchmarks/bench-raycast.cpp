@@ -0,0 +1,310 @@
+// Ray cast benchmark: builds a MeshBVH over a synthetic terrain of a few million
+// triangles and times closest hit rays from a camera looking across it, incoherent rays
+// from random points in random directions, any hit rays, and the camera rays batched
+// over threads. A subset of every ray set is checked against testing every triangle.
+//
+//   bench-raycast [--size N] [--rays N] [--check N] [--reps N] [--warmup N]
+//                 [--threads N] [--out results.json]
+
+#include "benchmark.hpp"
+#include "mesh-bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const float CELL_SIZE = 1.0f;
+// how far the hits may be from the brute force ones: relative distance, and barycentrics
+const float DISTANCE_TOLERANCE = 1e-5f;
+const float EDGE_TOLERANCE = 1e-5f;
+
+struct Mesh
+{
+	std::vector<float> positions;
+	std::vector<int> indices;
+};
+
+// a size x size grid of cells, two triangles each, over rolling hills with ridges
+// steep enough that rays pass behind them
+Mesh makeTerrain(int size)
+{
+	Mesh mesh;
+	mesh.positions.reserve((size_t)(size + 1) * (size + 1) * 3);
+	mesh.indices.reserve((size_t)size * size * 6);
+	for (int z = 0; z <= size; ++z)
+	{
+		for (int x = 0; x <= size; ++x)
+		{
+			float height = 8.0f * sinf(x * 0.05f) * cosf(z * 0.043f) + 2.0f * sinf((x + 2 * z) * 0.31f);
+			mesh.positions.push_back(x * CELL_SIZE);
+			mesh.positions.push_back(height);
+			mesh.positions.push_back(z * CELL_SIZE);
+		}
+	}
+	for (int z = 0; z < size; ++z)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			int a = z * (size + 1) + x;
+			int quad[6] = {a, a + size + 1, a + 1, a + 1, a + size + 1, a + size + 2};
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+// a pinhole camera at one corner above the terrain, looking over it
+std::vector<MeshRay> makeCameraRays(int count, int size)
+{
+	int width = (int)sqrtf((float)count * 2), height = (count + width - 1) / width;
+	glm::vec3 eye(-10.0f, 30.0f, -10.0f);
+	glm::vec3 forward = glm::normalize(glm::vec3(size * 0.5f, -5.0f, size * 0.5f) - eye);
+	glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0, 1, 0)));
+	glm::vec3 up = glm::cross(right, forward);
+	std::vector<MeshRay> rays;
+	rays.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		float sx = ((i % width) + 0.5f) / width * 2 - 1;
+		float sy = ((i / width) + 0.5f) / height * 2 - 1;
+		MeshRay ray;
+		ray.origin = eye;
+		ray.direction = glm::normalize(forward + right * (sx * 0.8f) + up * (sy * 0.4f));
+		ray.max_distance = INFINITY;
+		rays.push_back(ray);
+	}
+	return rays;
+}
+
+// from random points above the ground in random directions, up to a fixed length
+std::vector<MeshRay> makeRandomRays(int count, int size, std::mt19937* rng)
+{
+	std::uniform_real_distribution<float> position(0.0f, size * CELL_SIZE);
+	std::uniform_real_distribution<float> height(10.0f, 20.0f);
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	std::vector<MeshRay> rays;
+	rays.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		MeshRay ray;
+		ray.origin = glm::vec3(position(*rng), height(*rng), position(*rng));
+		ray.direction = glm::normalize(glm::vec3(direction(*rng), direction(*rng), direction(*rng)));
+		ray.max_distance = size * CELL_SIZE * 0.25f;
+		rays.push_back(ray);
+	}
+	return rays;
+}
+
+// the closest hit by testing every triangle, grown by \p margin in barycentrics, or
+// shrunk for a negative one
+MeshRayHit raycastBruteForce(const Mesh& mesh, const MeshRay& ray, float margin)
+{
+	MeshRayHit hit;
+	float closest = ray.max_distance;
+	const glm::vec3& d = ray.direction;
+	for (size_t t = 0; t < mesh.indices.size() / 3; ++t)
+	{
+		const float* v0 = &mesh.positions[3 * mesh.indices[3 * t]];
+		const float* v1 = &mesh.positions[3 * mesh.indices[3 * t + 1]];
+		const float* v2 = &mesh.positions[3 * mesh.indices[3 * t + 2]];
+		glm::vec3 e1(v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]);
+		glm::vec3 e2(v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]);
+		glm::vec3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+		float inverse = 1.0f / (e1.x * p.x + e1.y * p.y + e1.z * p.z);
+		glm::vec3 s(ray.origin.x - v0[0], ray.origin.y - v0[1], ray.origin.z - v0[2]);
+		float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverse;
+		glm::vec3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+		float v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverse;
+		float distance = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverse;
+		if (!(u >= -margin && v >= -margin && u + v <= 1 + margin && distance >= 0 && distance <= closest)) continue;
+		if (hit.triangle >= 0 && distance >= closest) continue;
+		closest = distance;
+		hit.triangle = (int)t;
+		hit.distance = distance;
+		hit.u = u;
+		hit.v = v;
+	}
+	return hit;
+}
+
+bool isSameHit(const MeshRayHit& a, const MeshRayHit& b)
+{
+	if (a.triangle < 0 || b.triangle < 0) return a.triangle == b.triangle;
+	return fabsf(a.distance - b.distance) <= DISTANCE_TOLERANCE * std::max(1.0f, b.distance);
+}
+
+// Rays of the first \p count whose hit differs from the brute force one. Both round
+// differently, e.g. where the compiler fuses multiplies and adds, so distances match to a
+// tolerance and a ray through an edge may hit on one side and miss on the other: a hit
+// counts as right when the triangles grown or shrunk by EDGE_TOLERANCE agree with it.
+int countMismatches(const Mesh& mesh, const std::vector<MeshRay>& rays, const std::vector<MeshRayHit>& hits,
+	int count)
+{
+	int mismatches = 0;
+	for (int i = 0; i < count && i < (int)rays.size(); ++i)
+	{
+		bool same = isSameHit(hits[i], raycastBruteForce(mesh, rays[i], 0.0f))
+			|| isSameHit(hits[i], raycastBruteForce(mesh, rays[i], EDGE_TOLERANCE))
+			|| isSameHit(hits[i], raycastBruteForce(mesh, rays[i], -EDGE_TOLERANCE));
+		mismatches += !same;
+	}
+	return mismatches;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: bench-raycast [--size N] [--rays N] [--check N] [--reps N] [--warmup N]\n"
+		"                     [--threads N] [--out results.json]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	int size = 1024;
+	int ray_count = 1000000;
+	int check_count = 200;
+	int max_threads = 0;
+	std::string out_path;
+	int repetitions = 5;
+	int warmup = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!value)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		++i;
+		if (strcmp(arg, "--size") == 0) size = atoi(value);
+		else if (strcmp(arg, "--rays") == 0) ray_count = atoi(value);
+		else if (strcmp(arg, "--check") == 0) check_count = atoi(value);
+		else if (strcmp(arg, "--threads") == 0) max_threads = atoi(value);
+		else if (strcmp(arg, "--reps") == 0) repetitions = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0) warmup = atoi(value);
+		else if (strcmp(arg, "--out") == 0) out_path = value;
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (repetitions < 1 || size < 1 || ray_count < 1 || check_count < 0)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 rng(1234);
+	Mesh mesh = makeTerrain(size);
+	std::vector<MeshRay> camera_rays = makeCameraRays(ray_count, size);
+	std::vector<MeshRay> random_rays = makeRandomRays(ray_count, size, &rng);
+	int vertex_count = (int)mesh.positions.size() / 3;
+	printf("synthetic terrain: %d x %d cells, %zu triangles, %d rays per set\n", size, size, mesh.indices.size() / 3,
+		ray_count);
+
+	enum { BUILD, CAMERA, RANDOM, ANY_HIT, BATCH, STAGE_COUNT };
+	std::vector<BenchmarkStage> stages(STAGE_COUNT);
+	stages[BUILD].name = "build";
+	stages[CAMERA].name = "camera rays";
+	stages[RANDOM].name = "random rays";
+	stages[ANY_HIT].name = "random rays any hit";
+	stages[BATCH].name = "camera rays batch";
+
+	MeshBVH bvh;
+	std::vector<MeshRayHit> camera_hits(ray_count), random_hits(ray_count), batch_hits(ray_count);
+	size_t camera_hit_count = 0, random_hit_count = 0, occluded_count = 0;
+	for (int rep = -warmup; rep < repetitions; ++rep)
+	{
+		double times[STAGE_COUNT] = {};
+		BenchmarkTimer timer;
+		bvh.build(mesh.indices.data(), (int)mesh.indices.size(), mesh.positions.data(), 3 * sizeof(float), vertex_count);
+		times[BUILD] = timer.milliseconds();
+
+		camera_hit_count = random_hit_count = occluded_count = 0;
+		timer.restart();
+		for (int i = 0; i < ray_count; ++i) camera_hit_count += bvh.raycast(camera_rays[i], &camera_hits[i]);
+		times[CAMERA] = timer.milliseconds();
+
+		timer.restart();
+		for (int i = 0; i < ray_count; ++i) random_hit_count += bvh.raycast(random_rays[i], &random_hits[i]);
+		times[RANDOM] = timer.milliseconds();
+
+		timer.restart();
+		for (int i = 0; i < ray_count; ++i) occluded_count += bvh.occluded(random_rays[i]);
+		times[ANY_HIT] = timer.milliseconds();
+
+		timer.restart();
+		bvh.raycast(camera_rays.data(), ray_count, batch_hits.data(), max_threads);
+		times[BATCH] = timer.milliseconds();
+
+		if (rep >= 0)
+		{
+			for (int s = 0; s < STAGE_COUNT; ++s) stages[s].samples.push_back(times[s]);
+		}
+	}
+
+	// every ray set against the brute force hits, the batch against the serial ones
+	int mismatches = countMismatches(mesh, camera_rays, camera_hits, check_count)
+		+ countMismatches(mesh, random_rays, random_hits, check_count);
+	for (int i = 0; i < ray_count; ++i)
+	{
+		mismatches += batch_hits[i].triangle != camera_hits[i].triangle || batch_hits[i].distance != camera_hits[i].distance;
+	}
+	mismatches += occluded_count != random_hit_count;
+
+	printf("%d nodes, %d triangle blocks, depth %d; hits: %.1f%% camera, %.1f%% random; queries: %s\n",
+		(int)bvh.getNodes().size(), (int)bvh.getBlocks().size(), bvh.getDepth(), 100.0 * camera_hit_count / ray_count,
+		100.0 * random_hit_count / ray_count, MeshBVH::getISA());
+	printf("%d repetitions after %d warmup\n", repetitions, warmup);
+	printStages(stages);
+	auto raysPerSecond = [&](int stage) { return ray_count / (computeStats(stages[stage].samples).median * 1e-3); };
+	printf("median: camera %.2f Mrays/s, random %.2f Mrays/s, any hit %.2f Mrays/s, batch %.2f Mrays/s\n",
+		raysPerSecond(CAMERA) * 1e-6, raysPerSecond(RANDOM) * 1e-6, raysPerSecond(ANY_HIT) * 1e-6,
+		raysPerSecond(BATCH) * 1e-6);
+	printf("%d of %d rays checked against every triangle differ\n", mismatches, 2 * check_count);
+
+	if (!out_path.empty())
+	{
+		picojson::object config;
+		config["size"] = picojson::value((double)size);
+		config["rays"] = picojson::value((double)ray_count);
+		config["check"] = picojson::value((double)check_count);
+		config["threads"] = picojson::value((double)max_threads);
+		config["repetitions"] = picojson::value((double)repetitions);
+		config["warmup"] = picojson::value((double)warmup);
+		config["isa"] = picojson::value(std::string(MeshBVH::getISA()));
+
+		picojson::object rays_per_second;
+		rays_per_second["camera"] = picojson::value(raysPerSecond(CAMERA));
+		rays_per_second["random"] = picojson::value(raysPerSecond(RANDOM));
+		rays_per_second["any_hit"] = picojson::value(raysPerSecond(ANY_HIT));
+		rays_per_second["batch"] = picojson::value(raysPerSecond(BATCH));
+
+		picojson::object result;
+		result["benchmark"] = picojson::value(std::string("raycast"));
+		result["config"] = picojson::value(config);
+		result["triangles"] = picojson::value((double)(mesh.indices.size() / 3));
+		result["nodes"] = picojson::value((double)bvh.getNodes().size());
+		result["depth"] = picojson::value((double)bvh.getDepth());
+		result["rays_per_second"] = picojson::value(rays_per_second);
+		result["mismatches"] = picojson::value((double)mismatches);
+		result["stages"] = stagesToJson(stages);
+		if (!writeJson(out_path, picojson::value(result)))
+		{
+			fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
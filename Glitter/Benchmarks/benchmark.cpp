@@ -0,0 +1,76 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+BenchmarkStats computeStats(const std::vector<double>& samples)
+{
+	BenchmarkStats stats;
+	stats.count = (int)samples.size();
+	if (samples.empty()) return stats;
+
+	std::vector<double> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+	stats.min = sorted.front();
+	stats.max = sorted.back();
+	size_t mid = sorted.size() / 2;
+	stats.median = sorted.size() % 2 ? sorted[mid] : 0.5 * (sorted[mid - 1] + sorted[mid]);
+
+	double sum = 0;
+	for (double sample : sorted) sum += sample;
+	stats.mean = sum / sorted.size();
+
+	if (sorted.size() > 1)
+	{
+		double squares = 0;
+		for (double sample : sorted) squares += (sample - stats.mean) * (sample - stats.mean);
+		stats.stddev = std::sqrt(squares / (sorted.size() - 1));
+	}
+	return stats;
+}
+
+
+void printStages(const std::vector<BenchmarkStage>& stages)
+{
+	printf("%-16s %10s %10s %10s %10s %10s\n", "stage (ms)", "min", "median", "mean", "stddev", "max");
+	for (const BenchmarkStage& stage : stages)
+	{
+		BenchmarkStats stats = computeStats(stage.samples);
+		printf("%-16s %10.3f %10.3f %10.3f %10.3f %10.3f\n", stage.name.c_str(),
+			stats.min, stats.median, stats.mean, stats.stddev, stats.max);
+	}
+}
+
+
+picojson::value stagesToJson(const std::vector<BenchmarkStage>& stages)
+{
+	picojson::object result;
+	for (const BenchmarkStage& stage : stages)
+	{
+		BenchmarkStats stats = computeStats(stage.samples);
+		picojson::array samples;
+		for (double sample : stage.samples) samples.push_back(picojson::value(sample));
+
+		picojson::object entry;
+		entry["count"] = picojson::value((double)stats.count);
+		entry["min_ms"] = picojson::value(stats.min);
+		entry["max_ms"] = picojson::value(stats.max);
+		entry["mean_ms"] = picojson::value(stats.mean);
+		entry["median_ms"] = picojson::value(stats.median);
+		entry["stddev_ms"] = picojson::value(stats.stddev);
+		entry["samples_ms"] = picojson::value(samples);
+		result[stage.name] = picojson::value(entry);
+	}
+	return picojson::value(result);
+}
+
+
+bool writeJson(const std::string& path, const picojson::value& value)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if (!fp) return false;
+	std::string text = value.serialize(true);
+	bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+	return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,54 @@
+#ifndef GLITTER_BENCHMARK_HPP
+#define GLITTER_BENCHMARK_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <picojson.h>
+
+/// Wall clock stopwatch, started on construction.
+class BenchmarkTimer
+{
+public:
+	BenchmarkTimer() : start(std::chrono::steady_clock::now()) {}
+	void restart() { start = std::chrono::steady_clock::now(); }
+	double milliseconds() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+/// Summary of the repetitions of one measurement, in milliseconds.
+struct BenchmarkStats
+{
+	int count = 0;
+	double min = 0;
+	double max = 0;
+	double mean = 0;
+	double median = 0;
+	double stddev = 0; ///< Sample standard deviation.
+};
+
+BenchmarkStats computeStats(const std::vector<double>& samples);
+
+/// One named measurement and its samples, one per repetition, in milliseconds.
+struct BenchmarkStage
+{
+	std::string name;
+	std::vector<double> samples;
+};
+
+/// Prints one line per stage: min / median / mean / stddev / max.
+void printStages(const std::vector<BenchmarkStage>& stages);
+
+/// {"name": {"min_ms": .., "median_ms": .., ..., "samples_ms": [..]}, ...}
+picojson::value stagesToJson(const std::vector<BenchmarkStage>& stages);
+
+/// Writes \p value to \p path, pretty printed. Returns false on I/O errors.
+bool writeJson(const std::string& path, const picojson::value& value);
+
+#endif
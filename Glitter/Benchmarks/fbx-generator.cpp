@@ -0,0 +1,639 @@
+#include "fbx-generator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace {
+
+const int64_t FBX_TICKS_PER_SECOND = 46186158000LL;
+const int FRAME_RATE = 30;
+const int TIME_MODE_FRAMES_30 = 6; // FbxTime::eFrames30
+// skin and cluster ids of a mesh, above its geometry, model and materials
+const int64_t SKIN_ID = (int64_t)1 << 24;
+
+// Binary FBX writer, version 7400 (32-bit offsets). A node record is
+//   u32 end_offset, u32 property_count, u32 property_bytes, u8 name_length, name,
+//   properties, child records, 13 zero bytes if it has children
+// and the top level list ends with a 13 byte null record as well.
+class FbxWriter
+{
+public:
+	FbxWriter()
+	{
+		const char magic[] = "Kaydara FBX Binary  ";
+		out.insert(out.end(), magic, magic + sizeof(magic)); // includes the terminating zero
+		out.push_back(0x1a);
+		out.push_back(0x00);
+		write<uint32_t>(7400);
+	}
+
+	void beginNode(const char* name)
+	{
+		if (!stack.empty()) closeProperties(&stack.back());
+		Node node;
+		node.start = out.size();
+		write<uint32_t>(0); // end offset
+		write<uint32_t>(0); // property count
+		write<uint32_t>(0); // property bytes
+		uint8_t length = (uint8_t)strlen(name);
+		out.push_back(length);
+		out.insert(out.end(), name, name + length);
+		node.properties_start = out.size();
+		stack.push_back(node);
+	}
+
+	void endNode()
+	{
+		Node& node = stack.back();
+		bool has_children = node.has_children;
+		closeProperties(&node);
+		if (has_children) out.insert(out.end(), NULL_RECORD_SIZE, 0);
+		patch<uint32_t>(node.start, (uint32_t)out.size());
+		stack.pop_back();
+	}
+
+	void propertyInt(int32_t value)
+	{
+		beginProperty('I');
+		write(value);
+	}
+
+	void propertyInt64(int64_t value)
+	{
+		beginProperty('L');
+		write(value);
+	}
+
+	void propertyDouble(double value)
+	{
+		beginProperty('D');
+		write(value);
+	}
+
+	void propertyString(const char* value, size_t length)
+	{
+		beginProperty('S');
+		write<uint32_t>((uint32_t)length);
+		out.insert(out.end(), value, value + length);
+	}
+
+	void propertyString(const char* value) { propertyString(value, strlen(value)); }
+
+	/// "name\0\1Class", the way the SDK writes object names.
+	void propertyObjectName(const std::string& name, const char* object_class)
+	{
+		std::string full = name;
+		full.push_back('\0');
+		full.push_back('\1');
+		full += object_class;
+		propertyString(full.data(), full.size());
+	}
+
+	void propertyArray(const std::vector<double>& values) { propertyArray('d', values.data(), values.size()); }
+	void propertyArray(const std::vector<int32_t>& values) { propertyArray('i', values.data(), values.size()); }
+	void propertyArray(const std::vector<float>& values) { propertyArray('f', values.data(), values.size()); }
+	void propertyArray(const std::vector<int64_t>& values) { propertyArray('l', values.data(), values.size()); }
+
+	std::vector<uint8_t> finish()
+	{
+		assert(stack.empty());
+		out.insert(out.end(), NULL_RECORD_SIZE, 0);
+		return std::move(out);
+	}
+
+private:
+	static const size_t NULL_RECORD_SIZE = 13;
+
+	struct Node
+	{
+		size_t start;
+		size_t properties_start;
+		uint32_t property_count = 0;
+		bool has_children = false;
+	};
+
+	template <typename T>
+	void write(T value)
+	{
+		const uint8_t* bytes = (const uint8_t*)&value;
+		out.insert(out.end(), bytes, bytes + sizeof(value));
+	}
+
+	template <typename T>
+	void patch(size_t offset, T value)
+	{
+		memcpy(&out[offset], &value, sizeof(value));
+	}
+
+	template <typename T>
+	void propertyArray(char type, const T* values, size_t count)
+	{
+		beginProperty(type);
+		write<uint32_t>((uint32_t)count);
+		write<uint32_t>(0); // not compressed
+		write<uint32_t>((uint32_t)(count * sizeof(T)));
+		const uint8_t* bytes = (const uint8_t*)values;
+		out.insert(out.end(), bytes, bytes + count * sizeof(T));
+	}
+
+	void beginProperty(char type)
+	{
+		Node& node = stack.back();
+		assert(!node.has_children);
+		++node.property_count;
+		out.push_back((uint8_t)type);
+	}
+
+	// the property header is final once the first child starts or the node ends
+	void closeProperties(Node* node)
+	{
+		if (node->has_children) return;
+		patch<uint32_t>(node->start + 4, node->property_count);
+		patch<uint32_t>(node->start + 8, (uint32_t)(out.size() - node->properties_start));
+		node->has_children = true;
+	}
+
+	std::vector<uint8_t> out;
+	std::vector<Node> stack;
+};
+
+void writeStringNode(FbxWriter* writer, const char* name, const char* value)
+{
+	writer->beginNode(name);
+	writer->propertyString(value);
+	writer->endNode();
+}
+
+void writeIntNode(FbxWriter* writer, const char* name, int32_t value)
+{
+	writer->beginNode(name);
+	writer->propertyInt(value);
+	writer->endNode();
+}
+
+// P: "name", "type", "label", "flags", value... in a Properties70 list
+void beginPropertyNode(FbxWriter* writer, const char* name, const char* type, const char* label, const char* flags)
+{
+	writer->beginNode("P");
+	writer->propertyString(name);
+	writer->propertyString(type);
+	writer->propertyString(label);
+	writer->propertyString(flags);
+}
+
+// LayerElement* with one value per polygon vertex
+void writeLayerElement(FbxWriter* writer, const char* element, const char* data_name, const std::vector<double>& data)
+{
+	writer->beginNode(element);
+	writer->propertyInt(0);
+	writeIntNode(writer, "Version", 101);
+	writeStringNode(writer, "Name", "");
+	writeStringNode(writer, "MappingInformationType", "ByPolygonVertex");
+	writeStringNode(writer, "ReferenceInformationType", "Direct");
+	writer->beginNode(data_name);
+	writer->propertyArray(data);
+	writer->endNode();
+	writer->endNode();
+}
+
+// cells along each side of a mesh's grid
+int getGridSize(const SyntheticSceneDesc& desc)
+{
+	return std::max(1, (int)std::ceil(std::sqrt((double)std::max(desc.vertex_count, 4))) - 1);
+}
+
+void writeGeometry(FbxWriter* writer, int64_t id, int mesh_index, const SyntheticSceneDesc& desc, std::mt19937* rng)
+{
+	int grid = getGridSize(desc);
+	int row = grid + 1;
+	std::uniform_real_distribution<double> bump(-0.05, 0.05);
+
+	std::vector<double> positions;
+	positions.reserve(row * row * 3);
+	for (int y = 0; y < row; ++y)
+	{
+		for (int x = 0; x < row; ++x)
+		{
+			positions.push_back(x + mesh_index * (grid + 2.0));
+			positions.push_back(y);
+			positions.push_back(std::sin(x * 0.3) * std::cos(y * 0.2) + bump(*rng));
+		}
+	}
+
+	// two triangles per cell; the last index of every polygon is stored as ~index
+	std::vector<int32_t> polygons;
+	polygons.reserve(grid * grid * 6);
+	for (int y = 0; y < grid; ++y)
+	{
+		for (int x = 0; x < grid; ++x)
+		{
+			int32_t a = y * row + x, b = a + 1, c = a + row, d = c + 1;
+			polygons.push_back(a);
+			polygons.push_back(b);
+			polygons.push_back(~d);
+			polygons.push_back(a);
+			polygons.push_back(d);
+			polygons.push_back(~c);
+		}
+	}
+
+	writer->beginNode("Geometry");
+	writer->propertyInt64(id);
+	writer->propertyObjectName("Grid" + std::to_string(mesh_index), "Geometry");
+	writer->propertyString("Mesh");
+
+	writer->beginNode("Vertices");
+	writer->propertyArray(positions);
+	writer->endNode();
+	writer->beginNode("PolygonVertexIndex");
+	writer->propertyArray(polygons);
+	writer->endNode();
+	writeIntNode(writer, "GeometryVersion", 124);
+
+	std::vector<double> data;
+	if (desc.normals)
+	{
+		data.clear();
+		for (int32_t index : polygons)
+		{
+			int v = index < 0 ? ~index : index;
+			double nx = -0.3 * std::cos((v % row) * 0.3), ny = 0.2 * std::sin((v / row) * 0.2), nz = 1.0;
+			double inv_len = 1.0 / std::sqrt(nx * nx + ny * ny + nz * nz);
+			data.push_back(nx * inv_len);
+			data.push_back(ny * inv_len);
+			data.push_back(nz * inv_len);
+		}
+		writeLayerElement(writer, "LayerElementNormal", "Normals", data);
+	}
+	if (desc.tangents)
+	{
+		data.clear();
+		for (size_t i = 0; i < polygons.size(); ++i)
+		{
+			data.push_back(1.0);
+			data.push_back(0.0);
+			data.push_back(0.0);
+		}
+		writeLayerElement(writer, "LayerElementTangent", "Tangents", data);
+	}
+	if (desc.colors)
+	{
+		data.clear();
+		for (int32_t index : polygons)
+		{
+			int v = index < 0 ? ~index : index;
+			data.push_back((v % row) / (double)grid);
+			data.push_back((v / row) / (double)grid);
+			data.push_back(0.5);
+			data.push_back(1.0);
+		}
+		writeLayerElement(writer, "LayerElementColor", "Colors", data);
+	}
+	if (desc.uvs)
+	{
+		data.clear();
+		for (int32_t index : polygons)
+		{
+			int v = index < 0 ? ~index : index;
+			data.push_back((v % row) / (double)grid);
+			data.push_back((v / row) / (double)grid);
+		}
+		writeLayerElement(writer, "LayerElementUV", "UV", data);
+	}
+
+	std::uniform_int_distribution<int32_t> pick_material(0, std::max(desc.material_count, 1) - 1);
+	std::vector<int32_t> materials(polygons.size() / 3);
+	for (int32_t& material : materials) material = pick_material(*rng);
+	writer->beginNode("LayerElementMaterial");
+	writer->propertyInt(0);
+	writeIntNode(writer, "Version", 101);
+	writeStringNode(writer, "Name", "");
+	writeStringNode(writer, "MappingInformationType", "ByPolygon");
+	writeStringNode(writer, "ReferenceInformationType", "IndexToDirect");
+	writer->beginNode("Materials");
+	writer->propertyArray(materials);
+	writer->endNode();
+	writer->endNode();
+
+	writer->endNode();
+}
+
+void writeConnection(FbxWriter* writer, int64_t child, int64_t parent)
+{
+	writer->beginNode("C");
+	writer->propertyString("OO");
+	writer->propertyInt64(child);
+	writer->propertyInt64(parent);
+	writer->endNode();
+}
+
+// an object connected to a property of its parent, e.g. a curve node to "Lcl Rotation"
+void writePropertyConnection(FbxWriter* writer, int64_t child, int64_t parent, const char* property)
+{
+	writer->beginNode("C");
+	writer->propertyString("OP");
+	writer->propertyInt64(child);
+	writer->propertyInt64(parent);
+	writer->propertyString(property);
+	writer->endNode();
+}
+
+// a translation along x, column major like every FBX matrix
+void writeMatrixNode(FbxWriter* writer, const char* name, double x)
+{
+	std::vector<double> matrix = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, 0, 0, 1};
+	writer->beginNode(name);
+	writer->propertyArray(matrix);
+	writer->endNode();
+}
+
+// The bones form one chain along x from the origin, each bone_length long, spanning the
+// meshes side by side.
+double getBoneLength(const SyntheticSceneDesc& desc)
+{
+	double span = desc.mesh_count * (getGridSize(desc) + 2.0) - 2.0;
+	return std::max(span, 1.0) / desc.bone_count;
+}
+
+void writeBone(FbxWriter* writer, int64_t id, int bone, double bone_length)
+{
+	writer->beginNode("Model");
+	writer->propertyInt64(id);
+	writer->propertyObjectName("Bone" + std::to_string(bone), "Model");
+	writer->propertyString("LimbNode");
+	writeIntNode(writer, "Version", 232);
+	writer->beginNode("Properties70");
+	beginPropertyNode(writer, "Lcl Translation", "Lcl Translation", "", "A");
+	writer->propertyDouble(bone ? bone_length : 0.0);
+	writer->propertyDouble(0.0);
+	writer->propertyDouble(0.0);
+	writer->endNode();
+	writer->endNode();
+	writer->endNode();
+}
+
+// A skin with a cluster per bone: every control point goes to the two bones nearest
+// along x, blended linearly between their middles.
+void writeSkin(FbxWriter* writer, int64_t base, int mesh_index, const SyntheticSceneDesc& desc)
+{
+	int grid = getGridSize(desc);
+	int row = grid + 1;
+	double bone_length = getBoneLength(desc);
+	std::vector<std::vector<int32_t>> indices(desc.bone_count);
+	std::vector<std::vector<double>> weights(desc.bone_count);
+	for (int v = 0; v < row * row; ++v)
+	{
+		double x = (v % row) + mesh_index * (grid + 2.0);
+		double f = x / bone_length - 0.5;
+		int bone = std::max(0, std::min(desc.bone_count - 1, (int)std::floor(f)));
+		double t = std::max(0.0, std::min(1.0, f - bone));
+		if (bone + 1 == desc.bone_count) t = 0;
+		indices[bone].push_back(v);
+		weights[bone].push_back(1 - t);
+		if (t > 0)
+		{
+			indices[bone + 1].push_back(v);
+			weights[bone + 1].push_back(t);
+		}
+	}
+
+	writer->beginNode("Deformer");
+	writer->propertyInt64(base + SKIN_ID);
+	writer->propertyObjectName("Skin" + std::to_string(mesh_index), "Deformer");
+	writer->propertyString("Skin");
+	writeIntNode(writer, "Version", 101);
+	writer->endNode();
+
+	for (int bone = 0; bone < desc.bone_count; ++bone)
+	{
+		writer->beginNode("Deformer");
+		writer->propertyInt64(base + SKIN_ID + 1 + bone);
+		writer->propertyObjectName("Cluster" + std::to_string(mesh_index) + "_" + std::to_string(bone), "SubDeformer");
+		writer->propertyString("Cluster");
+		writeIntNode(writer, "Version", 100);
+		// the SDK leaves both out of clusters without influence
+		if (!indices[bone].empty())
+		{
+			writer->beginNode("Indexes");
+			writer->propertyArray(indices[bone]);
+			writer->endNode();
+			writer->beginNode("Weights");
+			writer->propertyArray(weights[bone]);
+			writer->endNode();
+		}
+		// bind pose: the mesh at the origin, the bone where the chain puts it
+		writeMatrixNode(writer, "Transform", -bone * bone_length);
+		writeMatrixNode(writer, "TransformLink", bone * bone_length);
+		writer->endNode();
+	}
+}
+
+void writeCurve(FbxWriter* writer, int64_t id, const std::vector<int64_t>& times, const std::vector<float>& values)
+{
+	writer->beginNode("AnimationCurve");
+	writer->propertyInt64(id);
+	writer->propertyObjectName("", "AnimCurve");
+	writer->propertyString("");
+	writer->beginNode("Default");
+	writer->propertyDouble(values[0]);
+	writer->endNode();
+	writeIntNode(writer, "KeyVer", 4009);
+	writer->beginNode("KeyTime");
+	writer->propertyArray(times);
+	writer->endNode();
+	writer->beginNode("KeyValueFloat");
+	writer->propertyArray(values);
+	writer->endNode();
+	writer->endNode();
+}
+
+// A curve node with an X, Y and Z curve, ids id + 1 to id + 3.
+void writeCurveNode(FbxWriter* writer, int64_t id, const char* name, const std::vector<int64_t>& times,
+	const std::vector<float> (&values)[3])
+{
+	writer->beginNode("AnimationCurveNode");
+	writer->propertyInt64(id);
+	writer->propertyObjectName(name, "AnimCurveNode");
+	writer->propertyString("");
+	writer->beginNode("Properties70");
+	const char* channels[3] = {"d|X", "d|Y", "d|Z"};
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		beginPropertyNode(writer, channels[axis], "Number", "", "A");
+		writer->propertyDouble(values[axis][0]);
+		writer->endNode();
+	}
+	writer->endNode();
+	writer->endNode();
+	for (int axis = 0; axis < 3; ++axis) writeCurve(writer, id + 1 + axis, times, values[axis]);
+}
+
+// Curve node ids of a bone in the take: rotation, then translation for the root.
+int64_t getRotationNodeId(int64_t take_base, int bone) { return take_base + 16 + 8 * (int64_t)bone; }
+int64_t getTranslationNodeId(int64_t take_base, int bone) { return getRotationNodeId(take_base, bone) + 4; }
+
+// One stack with one layer, baked like an SDK export: a key per frame on every curve.
+// Each bone swings on all three axes at its own speed, the root also bobs up and down.
+void writeTake(FbxWriter* writer, int64_t take_base, const SyntheticSceneDesc& desc, std::mt19937* rng)
+{
+	writer->beginNode("AnimationStack");
+	writer->propertyInt64(take_base);
+	writer->propertyObjectName("Take 001", "AnimStack");
+	writer->propertyString("");
+	writer->endNode();
+	writer->beginNode("AnimationLayer");
+	writer->propertyInt64(take_base + 1);
+	writer->propertyObjectName("BaseLayer", "AnimLayer");
+	writer->propertyString("");
+	writer->endNode();
+
+	std::vector<int64_t> times(desc.animation_frames);
+	for (int f = 0; f < desc.animation_frames; ++f) times[f] = f * (FBX_TICKS_PER_SECOND / FRAME_RATE);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<float> values[3];
+	for (int bone = 0; bone < desc.bone_count; ++bone)
+	{
+		float amplitude[3] = {10 + 20 * unit(*rng), 5 * unit(*rng), 10 + 30 * unit(*rng)}; // degrees
+		float speed = 1 + 2 * unit(*rng);
+		float phase = 6.28f * unit(*rng);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			values[axis].resize(desc.animation_frames);
+			for (int f = 0; f < desc.animation_frames; ++f)
+			{
+				values[axis][f] = amplitude[axis] * sinf(speed * f / FRAME_RATE + phase + axis);
+			}
+		}
+		writeCurveNode(writer, getRotationNodeId(take_base, bone), "R", times, values);
+		if (bone) continue;
+
+		for (int f = 0; f < desc.animation_frames; ++f)
+		{
+			values[0][f] = values[2][f] = 0;
+			values[1][f] = 0.5f * sinf(2 * speed * f / FRAME_RATE);
+		}
+		writeCurveNode(writer, getTranslationNodeId(take_base, bone), "T", times, values);
+	}
+}
+
+void writeAnimationSettings(FbxWriter* writer, const SyntheticSceneDesc& desc)
+{
+	int64_t stop = (desc.animation_frames - 1) * (FBX_TICKS_PER_SECOND / FRAME_RATE);
+	writer->beginNode("GlobalSettings");
+	writeIntNode(writer, "Version", 1000);
+	writer->beginNode("Properties70");
+	beginPropertyNode(writer, "TimeMode", "enum", "", "");
+	writer->propertyInt(TIME_MODE_FRAMES_30);
+	writer->endNode();
+	writer->endNode();
+	writer->endNode();
+
+	writer->beginNode("Takes");
+	writeStringNode(writer, "Current", "Take 001");
+	writer->beginNode("Take");
+	writer->propertyString("Take 001");
+	writeStringNode(writer, "FileName", "Take_001.tak");
+	writer->beginNode("LocalTime");
+	writer->propertyInt64(0);
+	writer->propertyInt64(stop);
+	writer->endNode();
+	writer->beginNode("ReferenceTime");
+	writer->propertyInt64(0);
+	writer->propertyInt64(stop);
+	writer->endNode();
+	writer->endNode();
+	writer->endNode();
+}
+
+} // anonymous namespace
+
+
+std::vector<uint8_t> generateSyntheticFbx(const SyntheticSceneDesc& desc)
+{
+	std::mt19937 rng(desc.seed);
+	FbxWriter writer;
+
+	writer.beginNode("FBXHeaderExtension");
+	writeIntNode(&writer, "FBXHeaderVersion", 1003);
+	writeIntNode(&writer, "FBXVersion", 7400);
+	writer.endNode();
+	bool animated = desc.bone_count > 0 && desc.animation_frames > 0;
+	if (animated) writeAnimationSettings(&writer, desc);
+
+	// ids: geometry, model, materials and skin of mesh i start at (i + 1) << 32, the bones
+	// after the last mesh's, the take after the bones'
+	int material_count = std::max(desc.material_count, 1);
+	int64_t skeleton_base = (int64_t)(desc.mesh_count + 1) << 32;
+	int64_t take_base = (int64_t)(desc.mesh_count + 2) << 32;
+	writer.beginNode("Objects");
+	for (int i = 0; i < desc.mesh_count; ++i)
+	{
+		int64_t base = (int64_t)(i + 1) << 32;
+		writeGeometry(&writer, base, i, desc, &rng);
+
+		writer.beginNode("Model");
+		writer.propertyInt64(base + 1);
+		writer.propertyObjectName("Mesh" + std::to_string(i), "Model");
+		writer.propertyString("Mesh");
+		writeIntNode(&writer, "Version", 232);
+		writer.endNode();
+
+		for (int j = 0; j < material_count; ++j)
+		{
+			writer.beginNode("Material");
+			writer.propertyInt64(base + 2 + j);
+			writer.propertyObjectName("Material" + std::to_string(i) + "_" + std::to_string(j), "Material");
+			writer.propertyString("");
+			writeIntNode(&writer, "Version", 102);
+			writeStringNode(&writer, "ShadingModel", "phong");
+			writer.endNode();
+		}
+		if (desc.bone_count > 0) writeSkin(&writer, base, i, desc);
+	}
+	for (int bone = 0; bone < desc.bone_count; ++bone) writeBone(&writer, skeleton_base + bone, bone, getBoneLength(desc));
+	if (animated) writeTake(&writer, take_base, desc, &rng);
+	writer.endNode();
+
+	writer.beginNode("Connections");
+	for (int i = 0; i < desc.mesh_count; ++i)
+	{
+		int64_t base = (int64_t)(i + 1) << 32;
+		writeConnection(&writer, base + 1, 0);
+		writeConnection(&writer, base, base + 1);
+		for (int j = 0; j < material_count; ++j) writeConnection(&writer, base + 2 + j, base + 1);
+		if (desc.bone_count <= 0) continue;
+		writeConnection(&writer, base + SKIN_ID, base);
+		for (int bone = 0; bone < desc.bone_count; ++bone)
+		{
+			writeConnection(&writer, base + SKIN_ID + 1 + bone, base + SKIN_ID);
+			writeConnection(&writer, skeleton_base + bone, base + SKIN_ID + 1 + bone);
+		}
+	}
+	for (int bone = 0; bone < desc.bone_count; ++bone)
+	{
+		writeConnection(&writer, skeleton_base + bone, bone ? skeleton_base + bone - 1 : 0);
+	}
+	if (animated)
+	{
+		writeConnection(&writer, take_base + 1, take_base);
+		for (int bone = 0; bone < desc.bone_count; ++bone)
+		{
+			int64_t nodes[2] = {getRotationNodeId(take_base, bone), getTranslationNodeId(take_base, bone)};
+			const char* properties[2] = {"Lcl Rotation", "Lcl Translation"};
+			for (int k = 0; k < (bone ? 1 : 2); ++k)
+			{
+				writeConnection(&writer, nodes[k], take_base + 1);
+				writePropertyConnection(&writer, nodes[k], skeleton_base + bone, properties[k]);
+				const char* channels[3] = {"d|X", "d|Y", "d|Z"};
+				for (int axis = 0; axis < 3; ++axis) writePropertyConnection(&writer, nodes[k] + 1 + axis, nodes[k], channels[axis]);
+			}
+		}
+	}
+	writer.endNode();
+
+	return writer.finish();
+}
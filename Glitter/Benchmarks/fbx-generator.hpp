@@ -0,0 +1,30 @@
+#ifndef GLITTER_FBX_GENERATOR_HPP
+#define GLITTER_FBX_GENERATOR_HPP
+
+#include <cstdint>
+#include <vector>
+
+/// Shape of a synthetic scene. Every mesh is a displaced grid with its own
+/// geometry, triangles are assigned to materials at random. With bones, a chain
+/// of them runs along x under all the meshes and skins each vertex to the two
+/// nearest; with frames, a take swings every bone on all three axes.
+struct SyntheticSceneDesc
+{
+	int mesh_count = 1;
+	int vertex_count = 100000; ///< Control points per mesh, rounded to a square grid.
+	int material_count = 1;    ///< Per mesh.
+	bool normals = true;
+	bool tangents = false;
+	bool uvs = true;
+	bool colors = false;
+	int bone_count = 0;       ///< 0 = static meshes.
+	int animation_frames = 0; ///< Of the take at 30 fps, every frame keyed; 0 = no animation, needs bones.
+	uint32_t seed = 1;
+};
+
+/// Writes the scene as a binary FBX 7.4 file, laid out the way the FBX SDK
+/// exports meshes: per polygon vertex attributes, per polygon materials, skins as
+/// clusters of control points and animations baked to a key per frame.
+std::vector<uint8_t> generateSyntheticFbx(const SyntheticSceneDesc& desc);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef GLITTER_ARENA_HPP
+#define GLITTER_ARENA_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/// Linear allocator: allocations bump a pointer and are never freed one by one,
+/// reset() releases everything at once but keeps the memory for the next round.
+/// allocate() may be called from several threads at the same time; reset() and
+/// reserve() may not overlap with anything else.
+class Arena
+{
+public:
+	/// \p block_size is the size of blocks added when the arena runs out.
+	explicit Arena(size_t block_size = 1 << 20) : min_block_size(block_size) {}
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t alignment);
+	/// Makes sure the next \p size bytes (plus alignment) fit without adding a block.
+	void reserve(size_t size);
+	/// Frees every allocation. If the last round needed several blocks they are
+	/// merged into one, so a similar round fits in a single block next time.
+	void reset();
+
+	size_t getUsed() const;
+	size_t getCapacity() const;
+
+private:
+	struct Block
+	{
+		uint8_t* data;
+		size_t size;
+		std::atomic<size_t> offset;
+	};
+
+	Block* addBlock(size_t size);
+
+	size_t min_block_size;
+	std::vector<Block*> blocks;
+	std::atomic<Block*> current{nullptr};
+	std::mutex grow_mutex;
+};
+
+/// Standard allocator over an Arena; without an arena it uses the heap. Memory
+/// from an arena is only released by Arena::reset, so containers using it must
+/// not outlive the arena or its next reset. Copies of such containers go to the
+/// heap, moves and swaps keep the arena.
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::false_type propagate_on_container_copy_assignment;
+
+	ArenaAllocator(Arena* storage = nullptr) noexcept : arena(storage) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.getArena()) {}
+
+	T* allocate(size_t count)
+	{
+		if (arena) return (T*)arena->allocate(count * sizeof(T), alignof(T));
+		return (T*)::operator new(count * sizeof(T));
+	}
+
+	void deallocate(T* ptr, size_t)
+	{
+		if (!arena) ::operator delete(ptr);
+	}
+
+	ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+	Arena* getArena() const { return arena; }
+
+private:
+	Arena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() == b.getArena(); }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.getArena() != b.getArena(); }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef GLITTER_BACKGROUND_IMPORT_HPP
+#define GLITTER_BACKGROUND_IMPORT_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "fbx-importer.hpp"
+#include "file-source.hpp"
+#include "spsc-queue.hpp"
+
+/// Imports one FBX file (or its cooked cache) on a worker thread and hands the
+/// finished meshes to the thread that started it, one at a time.
+class BackgroundImport
+{
+public:
+	BackgroundImport() : finished(64) {}
+	/// Stops handing out meshes and waits for the worker; an import that is
+	/// already running is not interrupted.
+	~BackgroundImport();
+
+	BackgroundImport(const BackgroundImport&) = delete;
+	BackgroundImport& operator=(const BackgroundImport&) = delete;
+
+	/// Starts importing \p fbx_path with the settings of \p settings (its meshes
+	/// are ignored). The cooked cache lives next to the source, see mesh-cache.hpp.
+	void start(const std::string& fbx_path, const FBXImporter& settings, FileSource::Mode mode);
+
+	/// Next finished mesh, null when none is ready yet.
+	std::unique_ptr<FBXImporter::ImportMesh> pop();
+	/// True once the worker is done and every mesh has been popped.
+	bool isDone();
+
+private:
+	void run(FileSource::Mode mode);
+
+	std::string path;
+	std::unique_ptr<FBXImporter> importer;
+	std::thread worker;
+	SpscQueue<FBXImporter::ImportMesh*> finished;
+	std::atomic<bool> worker_done{false};
+	std::atomic<bool> cancelled{false};
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef GLITTER_BOUNDING_SPHERE_HPP
+#define GLITTER_BOUNDING_SPHERE_HPP
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+/// A sphere enclosing a mesh, the cheapest shape to cull with; see Frustum::intersectsSphere.
+struct BoundingSphere
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = -1.0f; ///< Negative for a null sphere that encloses nothing.
+
+	bool isNull() const { return radius < 0; }
+};
+
+/// Ritter's sphere around \p count xyz float positions \p position_stride bytes apart:
+/// the most distant pair among the six extreme points seeds it and one pass grows it
+/// over every point, giving a sphere a few percent larger than the smallest one.
+/// \p extreme_vertices are the points at min x, max x, min y, max y, min z and max z,
+/// as VertexTransformOutput has them; null finds them with a pass of its own. Each of
+/// \p refine_passes shrinks the best sphere so far and grows it again over the points
+/// in another order, keeping it when it came out smaller, which mostly closes the gap
+/// to the optimum. Returns a null sphere when \p count is 0.
+BoundingSphere computeBoundingSphere(const float* positions, size_t position_stride, int count,
+	const int* extreme_vertices, int refine_passes);
+
+#endif
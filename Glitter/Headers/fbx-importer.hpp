@@ -0,0 +1,391 @@
+#ifndef GLITTER_FBX_IMPORTER_HPP
+#define GLITTER_FBX_IMPORTER_HPP
+
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/norm.hpp>
+#include <glm-abb.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "bounding-sphere.hpp"
+#include "keyframe-compression.hpp"
+#include "mesh-bvh.hpp"
+#include "mesh-optimizer.hpp"
+#include "meshlet.hpp"
+#include "ofbx.h"
+#include "vertex-layout.hpp"
+#include "vertex-quantize.hpp"
+
+using AABB = CPM_GLM_AABB_NS::AABB;
+
+struct FBXImporter
+{
+	enum class Orientation
+	{
+		Y_UP,
+		Z_UP,
+		Z_MINUS_UP,
+		X_MINUS_UP,
+		X_UP
+	};
+
+	struct RotationKey
+	{
+		glm::quat rot;
+		float time;
+		uint16_t frame;
+	};
+
+	struct TranslationKey
+	{
+		glm::vec3 pos;
+		float time;
+		uint16_t frame;
+	};
+
+	struct PackedRotationKey
+	{
+		PackedQuat rot;
+		uint16_t frame;
+	};
+
+	/// Keys of one bone in a clip, see importAnimations. Frames count from the start of
+	/// the clip, a track with a single key holds that pose for the whole clip.
+	struct BoneTrack
+	{
+		int bone = -1; // into bones
+		std::vector<TranslationKey> translations;
+		std::vector<PackedRotationKey> rotations;
+	};
+
+	/// One split of an animation stack, or the whole take when it has no splits.
+	struct AnimationClip
+	{
+		std::string name;
+		float frame_rate = 0; // frames per second, time_scale applied
+		int frame_count = 0;
+		std::vector<BoneTrack> tracks; // only bones with curves in the stack
+	};
+
+	struct Skin
+	{
+		float weights[4];
+		int16_t joints[4];
+		int count = 0;
+	};
+
+	struct ImportAnimation
+	{
+		struct Split
+		{
+			int from_frame = 0;
+			int to_frame = 0;
+			std::string name;
+		};
+
+		const ofbx::AnimationStack* fbx = nullptr;
+		const ofbx::IScene* scene = nullptr;
+		std::vector<Split> splits;
+	    std::string output_filename;
+		bool import = true;
+		int root_motion_bone_idx = -1;
+		std::vector<AnimationClip> clips; // filled by importAnimations
+	};
+
+	struct ImportTexture
+	{
+		enum Type
+		{
+			DIFFUSE,
+			NORMAL,
+			COUNT
+		};
+
+		const ofbx::Texture* fbx = nullptr;
+		bool import = true;
+		bool to_dds = true;
+		bool is_valid = false;
+		std::string path;
+		std::string src;
+	};
+
+	struct ImportMaterial
+	{
+		const ofbx::Material* fbx = nullptr;
+		bool import = true;
+		bool alpha_cutout = false;
+		ImportTexture textures[ImportTexture::COUNT];
+		char shader[20];
+	};
+
+	
+	struct ImportMesh
+	{
+		ImportMesh()
+		{
+		}
+
+		int getVertexCount() const { return layout.stride ? (int)(vertices.size() * sizeof(float) / layout.stride) : 0; }
+		/// The first vertex's \p attribute, the next vertex's is layout.stride bytes further. Null if the layout lacks it.
+		float* getAttribute(VertexAttribute attribute)
+		{
+			return layout.has(attribute) && !vertices.empty() ? (float*)((uint8_t*)vertices.data() + layout.attributes[attribute].offset) : nullptr;
+		}
+		const float* getAttribute(VertexAttribute attribute) const { return const_cast<ImportMesh*>(this)->getAttribute(attribute); }
+
+		const ofbx::Mesh* fbx = nullptr;
+		const ofbx::Material* fbx_mat = nullptr;
+		int material_index = -1;
+		std::string material_name; // kept apart from fbx_mat, cooked meshes have no scene
+		bool import = true;
+		bool import_physics = false;
+		int lod = 0;
+		// float vertices with only the attributes the source has, see makeFloatVertexLayout
+		VertexLayout layout;
+		// allocated from FBXImporter::arena when there is one, see postprocessMeshGroup
+		ArenaVector<float> vertices;
+		ArenaVector<int> indices;
+		// indices as uploaded: uint16_t when every vertex is addressable with 16 bits, uint32_t otherwise
+		ArenaVector<uint8_t> index_data;
+		int index_size = 0;
+		// filled by quantizeMeshes: vertices in the compact format, vertices above stays as is
+		ArenaVector<uint8_t> quantized_vertices;
+		VertexQuantization quantization;
+		QuantizationError quantization_error;
+		// filled by optimizeMesh: runs of indices to cull separately, see buildMeshlets
+		std::vector<Meshlet> meshlets;
+		// filled by optimizeMesh for the base level when build_bvh is set, for picking and ray casts
+		MeshBVH bvh;
+		AABB aabb;
+		BoundingSphere bounding_sphere;
+	};
+
+	/// Where a bone comes from, see gatherBones.
+	struct BoneInfo
+	{
+		int index = -1;                   // into bones
+		const ofbx::Mesh* mesh = nullptr; // first skinned mesh with a cluster linked to the bone
+		ofbx::Matrix bind_pose;           // that cluster's TransformLink matrix
+	};
+
+	const ofbx::Mesh* getAnyMeshFromBone(const ofbx::Object* node) const
+	{
+		auto iter = bone_infos.find(node);
+		return iter != bone_infos.end() ? iter->second.mesh : nullptr;
+	}
+
+	int getBoneIndex(const ofbx::Object* node) const
+	{
+		auto iter = bone_infos.find(node);
+		return iter != bone_infos.end() ? iter->second.index : -1;
+	}
+
+    static ofbx::Matrix makeOFBXIdentity() { return {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}; }
+
+
+	ofbx::Matrix getBindPoseMatrix(const ofbx::Mesh* mesh, const ofbx::Object* node) const
+	{
+		if (!mesh) return makeOFBXIdentity();
+
+		auto iter = bone_infos.find(node);
+		if (iter != bone_infos.end() && iter->second.mesh == mesh) return iter->second.bind_pose;
+
+		// another mesh skinned to the same bone, its cluster may have its own bind pose
+		auto* skin = mesh->getGeometry()->getSkin();
+
+		for (int i = 0, c = skin->getClusterCount(); i < c; ++i)
+		{
+			const ofbx::Cluster* cluster = skin->getCluster(i);
+			if (cluster->getLink() == node)
+			{
+				return cluster->getTransformLinkMatrix();
+			}
+		}
+		assert(false);
+		return makeOFBXIdentity();
+	}
+
+	static glm::vec3 getTranslation(const ofbx::Matrix& mtx)
+	{
+		return glm::vec3((float)mtx.m[12], (float)mtx.m[13], (float)mtx.m[14]);
+	}
+
+
+	static glm::quat getRotation(const ofbx::Matrix& mtx)
+	{
+		glm::mat4x4 m = glm::make_mat4x4(mtx.m);
+		glm::quat q = glm::quat_cast(m);
+		return q;
+	}
+
+	static float getScaleX(const ofbx::Matrix& mtx)
+	{
+		glm::vec3 v(float(mtx.m[0]), float(mtx.m[4]), float(mtx.m[8]));
+
+		return v.length();
+	}
+
+	static int getDepth(const ofbx::Object* bone)
+	{
+		int depth = 0;
+		while (bone)
+		{
+			++depth;
+			bone = bone->getParent();
+		}
+		return depth;
+	}
+
+	bool isSkinned(const ofbx::Mesh& mesh) const { return !ignore_skeleton && mesh.getGeometry()->getSkin() != nullptr; }
+
+    glm::vec3 fixRootOrientation(const glm::vec3& v) const
+	{
+		switch (root_orientation)
+		{
+			case Orientation::Y_UP: return glm::vec3(v.x, v.y, v.z);
+			case Orientation::Z_UP: return glm::vec3(v.x, v.z, -v.y);
+			case Orientation::Z_MINUS_UP: return glm::vec3(v.x, -v.z, v.y);
+			case Orientation::X_MINUS_UP: return glm::vec3(v.y, -v.x, v.z);
+			case Orientation::X_UP: return glm::vec3(-v.y, v.x, v.z);
+		}
+		assert(false);
+		return glm::vec3(v.x, v.y, v.z);
+	}
+
+
+	glm::quat fixRootOrientation(const glm::quat& v) const
+	{
+		switch (root_orientation)
+		{
+			case Orientation::Y_UP: return glm::quat(v.x, v.y, v.z, v.w);
+			case Orientation::Z_UP: return glm::quat(v.x, v.z, -v.y, v.w);
+			case Orientation::Z_MINUS_UP: return glm::quat(v.x, -v.z, v.y, v.w);
+			case Orientation::X_MINUS_UP: return glm::quat(v.y, -v.x, v.z, v.w);
+			case Orientation::X_UP: return glm::quat(-v.y, v.x, v.z, v.w);
+		}
+		assert(false);
+		return glm::quat(v.x, v.y, v.z, v.w);
+	}
+
+
+	glm::vec3 fixOrientation(const glm::vec3& v) const
+	{
+		switch (orientation)
+		{
+			case Orientation::Y_UP: return glm::vec3(v.x, v.y, v.z);
+			case Orientation::Z_UP: return glm::vec3(v.x, v.z, -v.y);
+			case Orientation::Z_MINUS_UP: return glm::vec3(v.x, -v.z, v.y);
+			case Orientation::X_MINUS_UP: return glm::vec3(v.y, -v.x, v.z);
+			case Orientation::X_UP: return glm::vec3(-v.y, v.x, v.z);
+		}
+		assert(false);
+		return glm::vec3(v.x, v.y, v.z);
+	}
+
+
+	glm::quat fixOrientation(const glm::quat& v) const
+	{
+		switch (orientation)
+		{
+			case Orientation::Y_UP: return glm::quat(v.x, v.y, v.z, v.w);
+			case Orientation::Z_UP: return glm::quat(v.x, v.z, -v.y, v.w);
+			case Orientation::Z_MINUS_UP: return glm::quat(v.x, -v.z, v.y, v.w);
+			case Orientation::X_MINUS_UP: return glm::quat(v.y, -v.x, v.z, v.w);
+			case Orientation::X_UP: return glm::quat(-v.y, v.x, v.z, v.w);
+		}
+		assert(false);
+		return glm::quat(v.x, v.y, v.z, v.w);
+	}
+
+
+	static int getMaterialIndex(const ofbx::Mesh& mesh, const ofbx::Material& material)
+	{
+		for (int i = 0, c = mesh.getMaterialCount(); i < c; ++i)
+		{
+			if (mesh.getMaterial(i) == &material) return i;
+		}
+		return -1;
+	}
+
+	void clearSources()
+	{
+		for (ofbx::IScene* scene : scenes) scene->destroy();
+		scenes.clear();
+		meshes.clear();
+		materials.clear();
+		animations.clear();
+		bones.clear();
+		bone_infos.clear();
+	}
+
+	VertexLayout getSourceLayout(const ofbx::Mesh& mesh) const;
+	void fillSkinInfo(std::vector<Skin>* skinning, const ofbx::Mesh& mesh) const;
+	static void weldVertices(ImportMesh& mesh, float epsilon);
+	static void packIndices(ImportMesh& mesh);
+	void postprocessMeshGroup(int first, int count);
+	void postprocessMeshes();
+	void optimizeMesh(ImportMesh& mesh, VertexCacheStats* before, VertexCacheStats* after) const;
+	void optimizeMeshes();
+	void quantizeMeshes();
+	void generateLODs();
+	void gatherMeshes(ofbx::IScene* scene);
+	void gatherBones();
+	void gatherAnimations(const ofbx::IScene* scene);
+	void getBoneLocalTransform(const ofbx::Object& bone, const ofbx::Vec3& translation, const ofbx::Vec3& rotation,
+		glm::vec3* pos, glm::quat* rot) const;
+	void sampleBoneTrack(const ofbx::AnimationLayer& layer, int bone_idx, double from_time, double sample_period,
+		int frame_count, float frame_rate, BoneTrack* track) const;
+	void importAnimations();
+
+	std::vector<ImportMaterial> materials;
+	std::vector<ImportMesh> meshes;
+	std::vector<ImportAnimation> animations;
+	std::vector<const ofbx::Object*> bones; // parents before children
+	std::unordered_map<const ofbx::Object*, BoneInfo> bone_infos;
+	std::vector<ofbx::IScene*> scenes;
+	float lods_distances[4] = {-10, -100, -1000, -10000}; // draw distance of each LOD level, negative = no limit
+	// generateLODs targets per level, 0 is the base mesh: triangles relative to the base
+	// mesh, and the surface error allowed relative to the diagonal of its bounds
+	float lods_triangle_ratio[4] = {1, 0.5f, 0.25f, 0.125f};
+	float lods_max_error[4] = {0, 0.01f, 0.02f, 0.04f};
+	int max_threads = 0; // 0 = one per hardware thread, 1 = serial
+	// optional storage for mesh vertices and indices, reused across imports by resetting it
+	// after clearSources; meshes allocated from it must not outlive it or its next reset
+	Arena* arena = nullptr;
+	float weld_epsilon = 0.0f; // 0 = only bit-identical vertices are welded
+	int vertex_cache_size = 16;
+	int meshlet_max_vertices = 64;
+	int meshlet_max_triangles = 124; // 0 = no meshlets
+	int bounding_sphere_refine_passes = 4; // see computeBoundingSphere, 0 = plain Ritter
+    float mesh_scale = 1.0f;
+	float time_scale = 1.0f;
+	float position_error = 0.1f;  // animation keys, in mesh units after mesh_scale
+	float rotation_error = 0.01f; // animation keys, in radians
+	float bounding_shape_scale = 1.0f;
+	bool to_dds = false;
+	bool center_mesh = false;
+	bool ignore_skeleton = false;
+	bool import_vertex_colors = true;
+	bool weld_vertices = true;
+	bool optimize_overdraw = false;
+	bool build_bvh = false; // triangle BVH per base level mesh, see ImportMesh::bvh
+	bool quantize_vertices = false; // run quantizeMeshes after importing or loading the cooked meshes
+	VertexQuantizeSettings vertex_quantize;
+	bool make_convex = false;
+	bool create_billboard_lod = false;
+	bool verbose = true; // a summary line per pass on stdout; warnings are printed regardless
+	Orientation orientation = Orientation::Y_UP;
+	Orientation root_orientation = Orientation::Y_UP;
+};
+
+#endif
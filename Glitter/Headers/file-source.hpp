@@ -0,0 +1,42 @@
+#ifndef GLITTER_FILE_SOURCE_HPP
+#define GLITTER_FILE_SOURCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mapped-file.hpp"
+
+/// Read-only view of a whole input file. Mapping avoids reading the file into a
+/// private heap copy: the pages are shared with the OS file cache and can be
+/// evicted under pressure. Reading into a buffer is kept as a fallback for file
+/// systems that cannot be mapped.
+class FileSource
+{
+public:
+	enum class Mode
+	{
+		AUTO,     ///< Map, fall back to reading when the mapping fails.
+		MAPPED,
+		BUFFERED
+	};
+
+	/// Opens \p path for a single front-to-back pass. Returns false if the file
+	/// cannot be read in the requested mode.
+	bool open(const char* path, Mode mode = Mode::AUTO);
+	/// Releases the data early; parsers that copy their input can drop it right after.
+	void close();
+
+	const uint8_t* data() const { return mapped.isOpen() ? mapped.data() : buffer.data(); }
+	size_t size() const { return mapped.isOpen() ? mapped.size() : buffer.size(); }
+	bool isMapped() const { return mapped.isOpen(); }
+
+private:
+	MappedFile mapped;
+	std::vector<uint8_t> buffer;
+};
+
+/// Highest resident set size of the process so far, in bytes; 0 where unsupported.
+size_t getPeakResidentMemory();
+
+#endif
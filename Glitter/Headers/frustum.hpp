@@ -0,0 +1,40 @@
+#ifndef GLITTER_FRUSTUM_HPP
+#define GLITTER_FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+/// The six planes of a view frustum, normals pointing inwards and normalized, so
+/// dot(plane.xyz, p) + plane.w is the signed distance of p from the plane.
+struct Frustum
+{
+	glm::vec4 planes[6]; ///< left, right, bottom, top, near, far
+
+	/// False when the sphere is entirely outside one of the planes. Conservative:
+	/// a sphere outside near a corner may still pass.
+	bool intersectsSphere(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+		}
+		return true;
+	}
+
+	/// Same as intersectsSphere for the box between \p min and \p max.
+	bool intersectsBox(const glm::vec3& min, const glm::vec3& max) const
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			// the corner furthest along the plane normal
+			glm::vec3 p(plane.x >= 0 ? max.x : min.x, plane.y >= 0 ? max.y : min.y, plane.z >= 0 ? max.z : min.z);
+			if (glm::dot(glm::vec3(plane), p) + plane.w < 0) return false;
+		}
+		return true;
+	}
+};
+
+/// Extracts the frustum of a GL view projection matrix (clip z in -w..w), in the space
+/// the matrix transforms from: pass projection * view * model to get it in model space.
+Frustum makeFrustum(const glm::mat4& view_projection);
+
+#endif
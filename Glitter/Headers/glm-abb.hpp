@@ -3,6 +3,10 @@
 
 #include <glm/glm.hpp>
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 namespace CPM_GLM_AABB_NS {
 
 /// Standalone axis aligned bounding box implemented built on top of GLM.
@@ -21,6 +25,7 @@ public:
   AABB(const glm::vec3& p1, const glm::vec3& p2);
 
   AABB(const AABB& aabb);
+  AABB& operator=(const AABB& aabb) = default;
   ~AABB();
 
   /// Set the AABB as NULL (not set).
@@ -102,6 +107,70 @@ public:
   glm::vec3 mMax;   ///< Maximum point.
 };
 
+/// Structure of arrays companion to AABB, for testing many boxes against one
+/// shape at once. The kernels process a register of boxes per instruction (8
+/// with AVX2, 4 with SSE2) and answer with bitmasks: bit i % 32 of word i / 32
+/// is set when box i passes, see getMaskSize. Null boxes are kept as such and
+/// never overlap or intersect anything.
+class AABBArray
+{
+public:
+  AABBArray() : mCount(0) {}
+
+  /// Number of boxes.
+  size_t size() const {return mCount;}
+  bool empty() const  {return mCount == 0;}
+  void clear();
+  void reserve(size_t count);
+
+  /// Number of 32 bit words a mask for this array takes.
+  size_t getMaskSize() const {return (mCount + 31) / 32;}
+
+  void push_back(const AABB& aabb);
+  void set(size_t index, const AABB& aabb);
+  AABB get(size_t index) const;
+
+  /// Sets the bit of every box that overlaps \p bb, touching counts as in
+  /// AABB::overlaps.
+  /// \param[out] result getMaskSize() words.
+  void overlaps(const AABB& bb, uint32_t* result) const;
+
+  /// Mirrors bb.intersect(get(i)) for every box.
+  /// \param[out] intersecting Bits of the boxes that are not OUTSIDE.
+  /// \param[out] inside       Bits of the boxes INSIDE \p bb.
+  void intersect(const AABB& bb, uint32_t* intersecting, uint32_t* inside) const;
+
+  /// Classifies every box against a set of planes, a point p being on the inner
+  /// side of a plane when dot(plane.xyz, p) + plane.w >= 0, e.g. the planes of a
+  /// view frustum. At most 8 planes.
+  /// \param[out] outside Bits of the boxes entirely outside at least one plane.
+  /// \param[out] inside  Bits of the boxes entirely inside every plane.
+  void classify(const glm::vec4* planes, int planeCount, uint32_t* outside,
+                uint32_t* inside) const;
+
+  /// Grows every box to also contain the box at the same index in \p other,
+  /// which must have the same size.
+  void extend(const AABBArray& other);
+
+  /// Returns the box containing every box, null if there are none.
+  AABB getBounds() const;
+
+  /// Transforms every box by the affine \p matrix and stores the boxes around
+  /// the results in \p result, which may be this array (Arvo 1990).
+  void transform(const glm::mat4& matrix, AABBArray* result) const;
+
+  /// Instruction set the kernels were compiled for: "avx2", "sse2" or "scalar".
+  static const char* getISA();
+
+private:
+  void resize(size_t count);
+
+  size_t mCount;
+  // padded to a whole register with null boxes, min = +inf and max = -inf
+  std::vector<float> mMinX, mMinY, mMinZ;
+  std::vector<float> mMaxX, mMaxY, mMaxZ;
+};
+
 } // namespace CPM_GLM_AABB_NS 
 
 #endif 
\ No newline at end of file
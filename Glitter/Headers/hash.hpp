@@ -0,0 +1,48 @@
+#ifndef GLITTER_HASH_HPP
+#define GLITTER_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// 64-bit MurmurHash2 (MurmurHash64A by Austin Appleby, public domain). Fast on
+/// large buffers and stable across runs, which is what content keys need.
+inline uint64_t hash64(const void* key, size_t len, uint64_t seed = 0)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	uint64_t h = seed ^ (len * m);
+
+	const uint8_t* data = (const uint8_t*)key;
+	const uint8_t* end = data + (len & ~(size_t)7);
+	for (; data != end; data += 8)
+	{
+		uint64_t k;
+		memcpy(&k, data, sizeof(k));
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	switch (len & 7)
+	{
+		case 7: h ^= uint64_t(data[6]) << 48; // fallthrough
+		case 6: h ^= uint64_t(data[5]) << 40; // fallthrough
+		case 5: h ^= uint64_t(data[4]) << 32; // fallthrough
+		case 4: h ^= uint64_t(data[3]) << 24; // fallthrough
+		case 3: h ^= uint64_t(data[2]) << 16; // fallthrough
+		case 2: h ^= uint64_t(data[1]) << 8; // fallthrough
+		case 1: h ^= uint64_t(data[0]);
+			h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+#endif
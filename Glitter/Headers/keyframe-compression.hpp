@@ -0,0 +1,38 @@
+#ifndef GLITTER_KEYFRAME_COMPRESSION_HPP
+#define GLITTER_KEYFRAME_COMPRESSION_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/// Unit quaternion in 48 bits, "smallest three": the largest component follows from
+/// the unit length and is dropped, the other three lie within +-1/sqrt(2) and get 15
+/// bits each, the dropped component's index the remaining 2. The decoded quaternion
+/// may be the negated input, which is the same rotation.
+struct PackedQuat
+{
+	uint16_t data[3];
+};
+
+PackedQuat packQuat(const glm::quat& q);
+glm::quat unpackQuat(const PackedQuat& packed);
+
+/// Angle in radians of the rotation from \p a to \p b, regardless of their signs.
+float getRotationAngle(const glm::quat& a, const glm::quat& b);
+
+/// Normalized lerp along the shorter arc, what playback interpolates rotation keys with.
+glm::quat nlerpShortest(const glm::quat& a, const glm::quat& b, float t);
+
+/// Picks which of \p count evenly spaced samples to keep as keys: every dropped sample
+/// is within \p max_error of the lerp between the kept ones around it. Appends the
+/// indices of the kept samples to \p keys in increasing order. The first sample is
+/// always kept, the last one too unless the whole track is within \p max_error of the
+/// first sample, then that one key is the track. Kept samples are at most 64 apart.
+void reduceKeys(const glm::vec3* samples, int count, float max_error, std::vector<int>* keys);
+
+/// The same for rotations: nlerpShortest between the kept ones, \p max_angle in radians.
+void reduceKeys(const glm::quat* samples, int count, float max_angle, std::vector<int>* keys);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef GLITTER_MAPPED_FILE_HPP
+#define GLITTER_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// Maps \p path, closing any previous mapping first. Returns false if the
+	/// file cannot be opened or mapped; empty files map to a null pointer.
+	bool open(const char* path);
+	void close();
+
+	/// Hints that the mapping is about to be read front to back, so the OS reads
+	/// ahead aggressively and drops pages behind the reader early.
+	void adviseSequential() const;
+
+	bool isOpen() const { return is_open; }
+	const uint8_t* data() const { return mapped; }
+	size_t size() const { return mapped_size; }
+
+private:
+	const uint8_t* mapped = nullptr;
+	size_t mapped_size = 0;
+	bool is_open = false;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef GLITTER_MESH_BVH_HPP
+#define GLITTER_MESH_BVH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/// A ray from \p origin along \p direction, up to \p max_distance times the length of
+/// \p direction, as SceneBVH::queryRay takes it.
+struct MeshRay
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float max_distance;
+};
+
+struct MeshRayHit
+{
+	int triangle = -1;     ///< Index of the triangle, its indices start at 3 times it; -1 for a miss.
+	float distance = 0.0f; ///< Along the ray, in lengths of its direction.
+	float u = 0.0f;        ///< Barycentrics of the hit: weight of the second and third vertex.
+	float v = 0.0f;
+};
+
+/// Bounding volume hierarchy over the triangles of one mesh, for picking and ray casts
+/// against imported geometry. Nodes have eight children tested at once, and leaves hold
+/// blocks of eight triangles tested at once, stored with their positions so a query
+/// never touches the mesh. Queries may run concurrently; build and assign may not run
+/// alongside anything else. Both faces of a triangle are hit.
+class MeshBVH
+{
+public:
+	static const int WIDTH = 8;
+
+	/// WIDTH children, the bounds of each in one column. 256 bytes, four cache lines.
+	struct Node
+	{
+		float min_x[WIDTH], min_y[WIDTH], min_z[WIDTH];
+		float max_x[WIDTH], max_y[WIDTH], max_z[WIDTH]; ///< Empty slots have min = +inf, max = -inf.
+		/// An inner node index (always after this node's), ~first block of a leaf, 0 for an empty slot.
+		int32_t children[WIDTH];
+		uint32_t block_counts[WIDTH]; ///< Triangle blocks of a leaf, 0 otherwise.
+	};
+
+	/// WIDTH triangles as a vertex and two edges each, one column per triangle. 320 bytes.
+	struct TriangleBlock
+	{
+		float v0_x[WIDTH], v0_y[WIDTH], v0_z[WIDTH];
+		float e1_x[WIDTH], e1_y[WIDTH], e1_z[WIDTH]; ///< v1 - v0
+		float e2_x[WIDTH], e2_y[WIDTH], e2_z[WIDTH]; ///< v2 - v0
+		int32_t triangles[WIDTH];                    ///< -1 in columns left unused, whose edges are 0.
+	};
+
+	/// Builds the tree with the surface area heuristic over the triangles of \p indices
+	/// into \p vertex_count xyz float positions \p position_stride bytes apart, e.g. the
+	/// indices and VERTEX_POSITION attribute of an ImportMesh.
+	void build(const int* indices, int index_count, const float* positions, size_t position_stride, int vertex_count);
+
+	/// Takes a tree saved from getNodes and getBlocks; false, leaving the tree empty,
+	/// when isValid rejects it.
+	bool assign(const Node* nodes, int node_count, const TriangleBlock* blocks, int block_count);
+	/// Whether the arrays make a tree the queries can walk without reading out of bounds.
+	static bool isValid(const Node* nodes, int node_count, const TriangleBlock* blocks, int block_count);
+
+	/// The closest triangle along \p ray; false, leaving \p hit a miss, when there is none.
+	bool raycast(const MeshRay& ray, MeshRayHit* hit) const;
+	/// Whether any triangle is on \p ray, stopping at the first one found: for shadow and
+	/// line of sight rays.
+	bool occluded(const MeshRay& ray) const;
+	/// raycast for each of \p count rays, in chunks spread over up to \p max_threads
+	/// threads, 0 for one per hardware thread.
+	void raycast(const MeshRay* rays, int count, MeshRayHit* hits, int max_threads = 0) const;
+
+	void clear();
+	bool empty() const { return nodes.empty(); }
+	const std::vector<Node>& getNodes() const { return nodes; }
+	const std::vector<TriangleBlock>& getBlocks() const { return blocks; }
+	int getDepth() const { return depth; }
+
+	/// Instruction set the queries were compiled for: "avx2", "sse2" or "scalar".
+	static const char* getISA();
+
+private:
+	std::vector<Node> nodes;          ///< Parents before children, the root first.
+	std::vector<TriangleBlock> blocks; ///< Each leaf owns a run of them.
+	int depth = 0;
+};
+
+#endif
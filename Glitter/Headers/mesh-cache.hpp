@@ -0,0 +1,99 @@
+#ifndef GLITTER_MESH_CACHE_HPP
+#define GLITTER_MESH_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fbx-importer.hpp"
+#include "mapped-file.hpp"
+
+// Cooked meshes are the importer output (after postprocessMeshes and
+// optimizeMeshes) written as one flat file that is mapped back without parsing:
+//
+//   CookedMeshHeader
+//   CookedMesh[mesh_count]
+//   per mesh: vertices, index_data, meshlets, then BVH nodes and triangle blocks,
+//   each starting on a 16 byte boundary
+//
+// All values are little-endian; the file is only meant to be read back on the
+// machine (or at least the architecture) that cooked it.
+
+const uint32_t COOKED_MESH_MAGIC = 0x4b4f4f43; // "COOK"
+/// Bump whenever the layout or the importer output changes, old files are then rebuilt.
+const uint32_t COOKED_MESH_VERSION = 6;
+
+struct CookedMeshHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;        ///< getCookedMeshKey of the source, a mismatch means the file is stale.
+	uint32_t mesh_count;
+	uint32_t reserved;
+	uint64_t file_size;
+};
+
+struct CookedMesh
+{
+	uint64_t vertex_offset; ///< From the start of the file.
+	uint64_t index_offset;
+	uint64_t meshlet_offset;
+	uint64_t bvh_offset;    ///< The nodes, the triangle blocks right after them.
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t meshlet_count;
+	uint32_t bvh_node_count; ///< 0 for meshes cooked without build_bvh.
+	uint32_t bvh_block_count;
+	uint32_t index_size;    ///< 2 or 4.
+	uint32_t vertex_attributes; ///< VertexLayout::getMask, the layout is makeFloatVertexLayout of it.
+	uint32_t vertex_stride;
+	int32_t material_index;
+	int32_t lod;
+	float aabb_min[3];
+	float aabb_max[3];
+	float sphere_center[3];
+	float sphere_radius;    ///< Negative for meshes without vertices.
+	char material_name[128];
+};
+
+/// Key of a cooked file: hashes the FBX bytes together with every importer
+/// setting that changes the meshes it produces.
+uint64_t getCookedMeshKey(const void* fbx_data, size_t fbx_size, const FBXImporter& importer);
+
+/// Writes \p meshes to \p path through a temporary file, so a crash never leaves
+/// a truncated cache behind. Returns false on I/O errors.
+bool saveCookedMeshes(const char* path, uint64_t key, const std::vector<FBXImporter::ImportMesh>& meshes);
+
+/// Maps a cooked file and exposes its streams in place.
+class CookedMeshFile
+{
+public:
+	/// Fails if the file is missing, was cooked with a different key or version,
+	/// a mesh has an unknown vertex layout, any offset points outside the file, an
+	/// index past the vertices of its mesh, a meshlet outside its indices, or a BVH
+	/// MeshBVH::isValid rejects or whose triangles are not those of its mesh.
+	bool open(const char* path, uint64_t key);
+	void close() { file.close(); }
+
+	int getMeshCount() const { return (int)getHeader().mesh_count; }
+	const CookedMesh& getMesh(int index) const { return ((const CookedMesh*)(file.data() + sizeof(CookedMeshHeader)))[index]; }
+	const void* getVertices(int index) const { return file.data() + getMesh(index).vertex_offset; }
+	const void* getIndices(int index) const { return file.data() + getMesh(index).index_offset; }
+	const Meshlet* getMeshlets(int index) const { return (const Meshlet*)(file.data() + getMesh(index).meshlet_offset); }
+	const MeshBVH::Node* getBVHNodes(int index) const { return (const MeshBVH::Node*)(file.data() + getMesh(index).bvh_offset); }
+	const MeshBVH::TriangleBlock* getBVHBlocks(int index) const
+	{
+		return (const MeshBVH::TriangleBlock*)(getBVHNodes(index) + getMesh(index).bvh_node_count);
+	}
+
+private:
+	const CookedMeshHeader& getHeader() const { return *(const CookedMeshHeader*)file.data(); }
+
+	MappedFile file;
+};
+
+/// Replaces \p meshes with the content of a cooked file. Returns false, leaving
+/// \p meshes untouched, when the file cannot be used; see CookedMeshFile::open.
+bool loadCookedMeshes(const char* path, uint64_t key, std::vector<FBXImporter::ImportMesh>* meshes);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef GLITTER_MESH_OPTIMIZER_HPP
+#define GLITTER_MESH_OPTIMIZER_HPP
+
+#include <cstddef>
+
+/// Post-transform vertex cache efficiency of an indexed triangle list, measured
+/// by simulating a FIFO cache of the given size.
+struct VertexCacheStats
+{
+	int misses = 0;
+	int triangle_count = 0;
+	int vertex_count = 0;
+
+	/// Average cache miss ratio, transformed vertices per triangle (0.5 .. 3).
+	float acmr() const { return triangle_count ? (float)misses / triangle_count : 0.0f; }
+	/// Average transform to vertex ratio, 1.0 means every vertex is transformed once.
+	float atvr() const { return vertex_count ? (float)misses / vertex_count : 0.0f; }
+};
+
+VertexCacheStats analyzeVertexCache(const int* indices, int index_count, int vertex_count, int cache_size);
+
+/// Reorders triangles for post-transform cache locality (Tipsify, Sander et al. 2007).
+/// \p dst must not alias \p indices.
+void optimizeVertexCache(int* dst, const int* indices, int index_count, int vertex_count, int cache_size);
+
+/// Splits an already cache-optimized triangle list into clusters wherever a triangle
+/// misses the cache on all three vertices, then sorts the clusters so the ones facing
+/// away from the mesh center are drawn first. That front-loads likely occluders while
+/// keeping the cache order inside every cluster. \p positions points at xyz floats
+/// \p position_stride bytes apart.
+void optimizeOverdraw(int* indices, int index_count, const float* positions, size_t position_stride,
+	int vertex_count, int cache_size);
+
+/// Builds a vertex remap table in order of first use by \p indices, for vertex fetch
+/// locality. Unreferenced vertices map to -1. Returns the number of referenced vertices.
+int optimizeVertexFetchRemap(int* remap, const int* indices, int index_count, int vertex_count);
+
+#endif
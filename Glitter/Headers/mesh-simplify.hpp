@@ -0,0 +1,21 @@
+#ifndef GLITTER_MESH_SIMPLIFY_HPP
+#define GLITTER_MESH_SIMPLIFY_HPP
+
+#include <cstddef>
+
+/// Simplifies an indexed triangle list by collapsing edges onto existing vertices,
+/// cheapest first by quadric error (Garland and Heckbert 1997), so the result
+/// indexes the same vertex buffer. Vertices on attribute seams (several vertices
+/// used at one position, e.g. UV or normal splits) and on open or non-manifold
+/// edges never move, which keeps seams and borders intact. Collapses that would
+/// flip a triangle are skipped.
+///
+/// Stops once the mesh is down to \p target_index_count indices or the next
+/// collapse would move the surface by more than \p target_error (mesh units).
+/// Writes the result to \p dst, which may alias \p indices, and returns its index
+/// count; \p result_error, when not null, gets the largest error committed.
+/// \p positions points at xyz floats \p position_stride bytes apart.
+int simplifyMesh(int* dst, const int* indices, int index_count, const float* positions, size_t position_stride,
+	int vertex_count, int target_index_count, float target_error, float* result_error);
+
+#endif
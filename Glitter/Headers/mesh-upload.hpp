@@ -0,0 +1,77 @@
+#ifndef GLITTER_MESH_UPLOAD_HPP
+#define GLITTER_MESH_UPLOAD_HPP
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "fbx-importer.hpp"
+
+/// How much uploading a single frame may do. A mesh larger than the byte budget
+/// is streamed into its buffers over several frames.
+struct UploadBudget
+{
+	size_t bytes_per_frame = 4 << 20; ///< 0 = no limit.
+	double milliseconds_per_frame = 2.0; ///< 0 = no limit.
+};
+
+/// A mesh whose buffers are complete and ready to draw.
+struct GpuMesh
+{
+	GLuint vertex_array = 0;
+	GLuint vertex_buffer = 0;
+	GLuint index_buffer = 0;
+	GLsizei index_count = 0;
+	GLenum index_type = GL_UNSIGNED_INT;
+	int material_index = -1;
+	int lod = 0;            ///< Level of detail, see FBXImporter::lods_distances.
+	VertexLayout layout;    ///< Of the vertex buffer, attributes it lacks are disabled in the VAO.
+	bool quantized = false; ///< Vertices are in the compact format, decoded with quantization.
+	VertexQuantization quantization;
+	AABB aabb;
+	BoundingSphere bounding_sphere; ///< Cheaper to cull with than aabb, if looser.
+	std::vector<Meshlet> meshlets; ///< Of the index buffer, see cullMeshlets and drawMeshlets.
+};
+
+/// Draws the index ranges cullMeshlets found visible in \p mesh with one
+/// glMultiDrawElements. Binds the mesh's vertex array and leaves it bound.
+void drawMeshlets(const GpuMesh& mesh, const std::vector<MeshletDraw>& draws);
+
+/// Owns the GL objects of every uploaded mesh. All calls need the GL context current.
+class MeshUploader
+{
+public:
+	MeshUploader() {}
+	~MeshUploader() { clear(); }
+
+	MeshUploader(const MeshUploader&) = delete;
+	MeshUploader& operator=(const MeshUploader&) = delete;
+
+	void enqueue(std::unique_ptr<FBXImporter::ImportMesh> mesh);
+	/// Uploads queued data in order until \p budget is spent; always makes some
+	/// progress. Returns the number of bytes uploaded.
+	size_t update(const UploadBudget& budget);
+	bool isIdle() const { return pending.empty(); }
+	/// Deletes every GL object and drops pending uploads.
+	void clear();
+
+	const std::vector<GpuMesh>& getMeshes() const { return meshes; }
+
+private:
+	struct PendingUpload
+	{
+		std::unique_ptr<FBXImporter::ImportMesh> mesh;
+		GpuMesh gpu;
+		size_t vertex_bytes_done = 0;
+		size_t index_bytes_done = 0;
+		bool allocated = false;
+	};
+
+	std::deque<PendingUpload> pending;
+	std::vector<GpuMesh> meshes;
+};
+
+#endif
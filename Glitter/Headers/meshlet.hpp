@@ -0,0 +1,51 @@
+#ifndef GLITTER_MESHLET_HPP
+#define GLITTER_MESHLET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+/// A run of consecutive triangles of a mesh's index buffer, small enough to be culled
+/// on its own. Plain data, meshlets are stored as is in cooked files.
+struct Meshlet
+{
+	uint32_t index_offset;   ///< First index of the run in the mesh's indices.
+	uint32_t triangle_count;
+	uint32_t vertex_count;   ///< Distinct vertices the triangles use.
+	float center[3];         ///< Bounding sphere.
+	float radius;
+	float cone_apex[3];      ///< Normal cone: every triangle faces away from a viewer
+	float cone_axis[3];      ///< inside the cone at the apex, around -axis.
+	float cone_cutoff;       ///< Sine of the cone's half angle; 1 when the cone is empty.
+};
+
+/// A range of indices to draw, several visible meshlets in a row merge into one.
+struct MeshletDraw
+{
+	uint32_t index_offset;
+	uint32_t index_count;
+};
+
+/// Splits an index buffer into meshlets of at most \p max_vertices distinct vertices and
+/// \p max_triangles triangles. The triangles keep their order, each meshlet is the
+/// longest run that fits, so run it on cache optimized indices: their locality is what
+/// keeps the meshlets compact. Replaces the content of \p meshlets and returns how many
+/// there are. \p positions points at xyz floats \p position_stride bytes apart.
+size_t buildMeshlets(std::vector<Meshlet>* meshlets, const int* indices, int index_count, const float* positions,
+	size_t position_stride, int vertex_count, int max_vertices, int max_triangles);
+
+/// Computes the bounding sphere and normal cone of a run of \p triangle_count triangles.
+void computeMeshletBounds(Meshlet* meshlet, const int* indices, int triangle_count, const float* positions,
+	size_t position_stride);
+
+/// Tests every meshlet against \p frustum and its normal cone against \p camera_position,
+/// both in the mesh's space, and appends the index ranges of the visible ones to \p draws,
+/// merged where they are adjacent. Returns the number of visible meshlets.
+int cullMeshlets(const Meshlet* meshlets, int meshlet_count, const Frustum& frustum,
+	const glm::vec3& camera_position, std::vector<MeshletDraw>* draws);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef GLITTER_OCCLUSION_CULLER_HPP
+#define GLITTER_OCCLUSION_CULLER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm-abb.hpp>
+
+/// Occlusion culling on the CPU: a few big meshes, walls and floors, are rasterized into
+/// a small depth buffer each frame and the boxes of everything else are tested against
+/// it before being drawn. The buffer keeps a conservative (far) depth of the nearest
+/// occluder per pixel, so occluders never hide what is in front of them; coverage is
+/// sampled at pixel centers, which is exact to half a pixel at their silhouettes.
+///
+/// A frame is begin, any number of addOccluder, rasterize, then isVisible from any
+/// number of threads.
+class OcclusionCuller
+{
+public:
+	/// Size of the depth buffer in pixels. Occlusion needs little detail: a few hundred
+	/// pixels across, with the aspect ratio of the view, is plenty.
+	void resize(int width, int height);
+
+	/// Starts a frame seen through \p view_projection, a GL matrix (clip z in -w..w),
+	/// and drops the occluders of the last frame. Sizes the buffer to 256 x 128 unless
+	/// resize was called.
+	void begin(const glm::mat4& view_projection);
+
+	/// Adds the triangles of a mesh placed by \p model as occluders, e.g. the indices
+	/// and VERTEX_POSITION attribute of an ImportMesh; a coarse LOD occludes just as
+	/// well. \p positions points at xyz floats \p position_stride bytes apart. Only sets
+	/// the triangles up, rasterize draws them. Triangles reaching the near plane are
+	/// left out.
+	void addOccluder(const int* indices, int index_count, const float* positions, size_t position_stride,
+		int vertex_count, const glm::mat4& model);
+
+	/// Clears the depth buffer, draws the occluders into it and builds its max depth
+	/// hierarchy. Screen tiles are rasterized in parallel on up to \p max_threads
+	/// threads, 0 for one per hardware thread.
+	void rasterize(int max_threads = 0);
+
+	/// False when every pixel \p box covers is hidden behind an occluder, or the box is
+	/// entirely off screen or behind the near plane. Boxes across the near plane are
+	/// always visible. Frustum culling is cheaper, run it first.
+	bool isVisible(const CPM_GLM_AABB_NS::AABB& box) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	/// Occluder triangles set up since begin.
+	int getTriangleCount() const { return (int)triangles.size(); }
+	/// Depth of the nearest occluder in [0, 1] per pixel, 1 where there is none; rows
+	/// are getDepthPitch floats apart, the bottom one first.
+	const float* getDepth() const { return levels.empty() ? nullptr : levels[0].depth.data(); }
+	int getDepthPitch() const { return levels.empty() ? 0 : levels[0].pitch; }
+
+	/// Instruction set the rasterizer was compiled for: "avx2", "sse2" or "scalar".
+	static const char* getISA();
+
+private:
+	/// Edge functions and depth plane in pixel coordinates.
+	struct Triangle
+	{
+		float edge_a[3];
+		float edge_b[3];
+		float edge_c[3]; ///< A pixel center is inside when a * x + b * y + c >= 0 for all three.
+		float depth_x;
+		float depth_y;
+		float depth_c;   ///< Plane through the vertices, pushed back by half a pixel's slope.
+		float depth_max;
+		int min_x, min_y, max_x, max_y; ///< Pixels whose center may be inside, inclusive.
+	};
+
+	/// A level of the hierarchy, each texel the farthest depth of the 2x2 below it.
+	struct Level
+	{
+		int width = 0;
+		int height = 0;
+		int pitch = 0;
+		std::vector<float> depth;
+	};
+
+	void rasterizeTile(int tile);
+	void buildHierarchy();
+
+	int width = 0;
+	int height = 0;
+	int tiles_x = 0;
+	int tiles_y = 0;
+	glm::mat4 view_projection = glm::mat4(1.0f);
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bins; ///< Triangles overlapping each tile.
+	std::vector<Level> levels;               ///< The depth buffer first.
+	std::vector<glm::vec4> clip_positions;   ///< addOccluder scratch.
+};
+
+#endif
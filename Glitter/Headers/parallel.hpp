@@ -0,0 +1,54 @@
+#ifndef GLITTER_PARALLEL_HPP
+#define GLITTER_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+/// Number of threads to use for \p job_count jobs when at most \p max_threads
+/// may run at once. A \p max_threads of 0 means one per hardware thread.
+inline int workerCount(int job_count, int max_threads)
+{
+	int hw = (int)std::thread::hardware_concurrency();
+	if (hw <= 0) hw = 1;
+	int count = max_threads > 0 ? max_threads : hw;
+	return std::max(1, std::min(count, job_count));
+}
+
+/// Calls fn(job) for every job in [0, job_count) on up to \p max_threads
+/// threads, the calling thread included. Jobs are handed out one at a time
+/// from a shared counter so uneven job sizes still balance. With a single
+/// worker everything runs inline, in order, on the calling thread.
+template <typename Fn>
+void parallelFor(int job_count, int max_threads, Fn fn)
+{
+	if (job_count <= 0) return;
+	int worker_count = workerCount(job_count, max_threads);
+	if (worker_count == 1)
+	{
+		for (int i = 0; i < job_count; ++i) fn(i);
+		return;
+	}
+
+	std::atomic<int> next_job(0);
+	auto worker = [&]() {
+		for (int i = next_job++; i < job_count; i = next_job++) fn(i);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(worker_count - 1);
+	for (int i = 1; i < worker_count; ++i)
+	{
+		threads.emplace_back([&worker]() {
+			TRACE_THREAD_NAME("Worker");
+			worker();
+		});
+	}
+	worker();
+	for (std::thread& t : threads) t.join();
+}
+
+#endif
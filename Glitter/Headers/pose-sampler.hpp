@@ -0,0 +1,70 @@
+#ifndef GLITTER_POSE_SAMPLER_HPP
+#define GLITTER_POSE_SAMPLER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "fbx-importer.hpp"
+
+/// The bones every instance sampled together shares, parents before children.
+struct PoseSkeleton
+{
+	std::vector<int> parents;        ///< -1 for roots.
+	std::vector<float> rest_pose;    ///< Local xyz position and xyzw rotation per bone, for bones a clip does not animate.
+
+	int getBoneCount() const { return (int)parents.size(); }
+};
+
+/// An AnimationClip laid out for sampling: each bone's keys are contiguous and every
+/// component has its own array, bones without a track get a single rest pose key.
+/// The keys of bone i are [translation_first[i], translation_first[i + 1]), the same
+/// for rotations.
+struct PoseClip
+{
+	float frame_rate = 0;
+	int frame_count = 0;
+
+	std::vector<uint32_t> translation_first;
+	std::vector<float> translation_frames;
+	std::vector<float> translation_x, translation_y, translation_z;
+
+	std::vector<uint32_t> rotation_first;
+	std::vector<float> rotation_frames;
+	std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+
+	float getDuration() const { return frame_count > 1 ? (frame_count - 1) / frame_rate : 0.0f; }
+};
+
+/// One character to pose: its clip and the time in seconds, clamped to the clip.
+struct PoseInstance
+{
+	const PoseClip* clip = nullptr;
+	float time = 0;
+};
+
+/// Model space transform of a bone.
+struct BoneTransform
+{
+	float rotation[4]; ///< xyzw
+	float position[3];
+};
+
+/// The importer's bones with their rest pose, positions and rotations fixed up like
+/// importAnimations does.
+PoseSkeleton makePoseSkeleton(const FBXImporter& importer);
+
+/// Decodes the packed keys of \p clip into the sampling layout of \p skeleton.
+PoseClip makePoseClip(const FBXImporter::AnimationClip& clip, const PoseSkeleton& skeleton);
+
+/// Samples the clip of every instance at its time and writes the model space pose,
+/// bone count transforms per instance, instance i at poses + i * bone count. Keys are
+/// interpolated with lerp and shortest-arc nlerp. Instances go through the SIMD kernel
+/// a register width at a time, so their clips may differ; batches of them are spread
+/// over up to \p max_threads threads (0 = one per hardware thread).
+void samplePoses(const PoseSkeleton& skeleton, const PoseInstance* instances, int instance_count,
+	BoneTransform* poses, int max_threads);
+
+/// Instruction set the kernel was compiled for: "avx2", "sse2" or "scalar".
+const char* getPoseSamplerISA();
+
+#endif
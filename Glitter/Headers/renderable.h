@@ -1,14 +1,17 @@
-
-
 #pragma once
 
+#include <glad/glad.h>
+
 #include <cassert>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
 #include <array>
 #include <vector>
-#include <unordered_map>
 #include <initializer_list>
 
+#include "trace.hpp"
+#include "vertex-layout.hpp"
+
 /*
 #define GL_BYTE                           0x1400
 #define GL_UNSIGNED_BYTE                  0x1401
@@ -21,7 +24,7 @@
 */
 
 
-std::size_t glTypeSize(GLenum glType)
+inline std::size_t glTypeSize(GLenum glType)
 {
     std::array<std::size_t, 8> sizes = { sizeof(int8_t), sizeof(uint8_t),
                                          sizeof(int16_t), sizeof(uint16_t),
@@ -30,70 +33,110 @@ std::size_t glTypeSize(GLenum glType)
 
     int index = glType - GL_BYTE;
     assert(index >= 0);
-    assert(index < sizes.size());
+    assert(index < (int)sizes.size());
     return sizes[index];
-};
+}
+
+
+inline GLenum glComponentType(VertexComponentType type)
+{
+    switch (type)
+    {
+        case VertexComponentType::FLOAT32: return GL_FLOAT;
+        case VertexComponentType::FLOAT16: return GL_HALF_FLOAT;
+        case VertexComponentType::INT16:   return GL_SHORT;
+        case VertexComponentType::UINT16:  return GL_UNSIGNED_SHORT;
+        case VertexComponentType::UINT8:   return GL_UNSIGNED_BYTE;
+    }
+    assert(false);
+    return GL_FLOAT;
+}
+
+
+inline void glVertexAttribute(GLuint location, const VertexAttributeFormat& format, GLsizei stride, std::size_t byteOffset)
+{
+    glVertexAttribPointer(location, format.components, glComponentType(format.type),
+                          format.normalized ? GL_TRUE : GL_FALSE, stride,
+                          (const void*)(byteOffset + format.offset));
+    glEnableVertexAttribArray(location);
+}
+
+
+/*
+ * Points the attributes of a layout at the bound GL_ARRAY_BUFFER, vertices starting at byteOffset.
+ * Attribute locations are the VertexAttribute values. Attributes the layout lacks are disabled,
+ * shaders then read the current generic value instead: glVertexAttrib4f(VERTEX_COLOR, 1, 1, 1, 1)
+ * makes meshes without colors white.
+ */
+inline void glVertexLayout(const VertexLayout& layout, std::size_t byteOffset = 0)
+{
+    for (GLuint location = 0; location < VERTEX_ATTRIBUTE_COUNT; ++location)
+    {
+        const VertexAttributeFormat& format = layout.attributes[location];
+        if (!format.components)
+        {
+            glDisableVertexAttribArray(location);
+            continue;
+        }
+        glVertexAttribute(location, format, layout.stride, byteOffset);
+    }
+}
 
 
 /*
- * Encapsulates a data buffer of a given OpenGL element, with a number of components of a given type
+ * Encapsulates an interleaved vertex buffer in a given VertexLayout. Only the attributes in the
+ * layout are stored, and the data is uploaded as is: no copy is kept, the pointer just has to
+ * stay valid until the Renderable is constructed.
  */
 class RenderAttributeData
 {
 public:
-    GLenum      type;
-    int         components;
-    std::size_t count;
-    std::size_t size() const { return glTypeSize(type) * components * count; };
-private:   
-    uint8_t* data;
+    VertexLayout layout;
+    std::size_t  count;
+    std::size_t size() const { return layout.stride * count; }
+private:
+    const void* data;
 public:
-    RenderAttributeData(GLenum inType, int inComponents, std::size_t inCount) 
-    : type(inType), components(inComponents), count(inCount)
+    RenderAttributeData(const VertexLayout& inLayout, const void* inData, std::size_t inCount)
+    : layout(inLayout), count(inCount), data(inData)
     {
-      data = new uint8_t[size()];
     }
 
-    ~RenderAttributeData()
-    {
-        delete [] data;
-    }
-    void* get() const { return (void*) data; }
-   
+    const void* get() const { return data; }
 };
 
 
-using RenderData = std::unordered_map<std::string, RenderAttributeData>;
-using RenderDataInitInfo = RenderData::value_type;
-
 /**
- * Encapsulates a collection of buffers that add up to something we can draw
+ * Encapsulates a collection of buffers that add up to something we can draw. Each buffer gets its
+ * own GL buffer object; an attribute should only be present in one of them.
  */
 class Renderable
 {
 private:
-    RenderData          data;
     GLuint              arrayObject;
     std::vector<GLuint> bufferObjects;
 public:
-    Renderable(std::initializer_list<RenderDataInitInfo> initlist)
+    Renderable(std::initializer_list<RenderAttributeData> buffers)
     {
-        GLuint bufferHandle;
-        int index;
+        TRACE_ZONE("Renderable::Renderable");
         glGenVertexArrays(1 , &arrayObject );
         glBindVertexArray(arrayObject);
-        for( auto&& kv : initlist )
+        for( const RenderAttributeData& buffer : buffers )
         {
-            data.emplace(kv);
+            GLuint bufferHandle;
             glGenBuffers(1 , &bufferHandle);
             glBindBuffer( GL_ARRAY_BUFFER , bufferHandle );
-            const RenderAttributeData& buffer = kv.second;
             glBufferData(GL_ARRAY_BUFFER, buffer.size(), buffer.get(), GL_STATIC_DRAW);
             bufferObjects.push_back(bufferHandle);
-            glVertexAttribPointer(index, buffer.components, buffer.type, GL_FALSE, 0, 0);
-            index++;
-            glEnableVertexAttribArray(index);
+            for (GLuint location = 0; location < VERTEX_ATTRIBUTE_COUNT; ++location)
+            {
+                const VertexAttributeFormat& format = buffer.layout.attributes[location];
+                if (!format.components) continue;
+                glVertexAttribute(location, format, buffer.layout.stride, 0);
+            }
         }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
     ~Renderable()
     {
@@ -103,4 +146,9 @@ public:
             glDeleteBuffers(1, &buffer);
         }
     }
+
+    Renderable(const Renderable&) = delete;
+    Renderable& operator=(const Renderable&) = delete;
+
+    GLuint getArrayObject() const { return arrayObject; }
 };
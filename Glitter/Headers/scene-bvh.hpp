@@ -0,0 +1,74 @@
+#ifndef GLITTER_SCENE_BVH_HPP
+#define GLITTER_SCENE_BVH_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm-abb.hpp>
+
+#include "frustum.hpp"
+
+/// Bounding volume hierarchy over the boxes of a scene's objects, e.g. the aabb of
+/// every imported mesh, so culling and spatial queries visit O(log n) nodes instead of
+/// every object. Objects are identified by their index in the array given to build.
+/// Queries append to their output and may run concurrently; build, refit and
+/// updateObject may not run alongside anything else.
+class SceneBVH
+{
+public:
+	/// Builds the tree with the surface area heuristic over \p count boxes. Objects with
+	/// a null box are left out until the next build.
+	void build(const CPM_GLM_AABB_NS::AABB* boxes, int count);
+
+	/// Moves one object and refits the nodes above it. The tree keeps its structure,
+	/// so it slowly gets worse as objects travel; see getCost. A null box keeps the old one.
+	void updateObject(int object, const CPM_GLM_AABB_NS::AABB& box);
+	/// Same for every object at once, in a single bottom-up pass; \p boxes has the
+	/// count given to build.
+	void refit(const CPM_GLM_AABB_NS::AABB* boxes);
+
+	/// Objects whose box intersects the frustum, conservatively like Frustum::intersectsBox.
+	void queryFrustum(const Frustum& frustum, std::vector<int>* objects) const;
+	/// Objects whose box overlaps \p box, touching counts.
+	void queryBox(const CPM_GLM_AABB_NS::AABB& box, std::vector<int>* objects) const;
+	/// Objects whose box the segment from \p origin along \p direction, up to
+	/// \p max_distance times its length, passes through.
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float max_distance,
+		std::vector<int>* objects) const;
+
+	/// Expected cost of a query by the surface area heuristic, in box tests. Compare it
+	/// with the value right after build to decide when refitting has degraded the tree
+	/// enough to rebuild.
+	float getCost() const;
+	int getNodeCount() const { return (int)nodes.size(); }
+	int getDepth() const { return depth; }
+
+private:
+	/// 32 bytes, two to a cache line.
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t first; ///< Inner nodes: left child, the right one follows. Leaves: first slot.
+		glm::vec3 max;
+		uint32_t count; ///< Objects in a leaf, 0 for inner nodes.
+	};
+
+	struct ObjectBox
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	void refitNode(uint32_t node_index);
+
+	std::vector<Node> nodes;        ///< Parents before children, the root first.
+	std::vector<uint32_t> parents;  ///< Per node, the root has UINT32_MAX.
+	std::vector<int> slot_objects;      ///< Every leaf owns a run of slots, one object each.
+	std::vector<ObjectBox> slot_boxes;  ///< Kept by slot, so the boxes of a leaf are adjacent.
+	std::vector<uint32_t> slot_leaves;
+	std::vector<uint32_t> object_slots; ///< Per object, UINT32_MAX when left out.
+	int depth = 0;
+};
+
+#endif
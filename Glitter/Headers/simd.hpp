@@ -0,0 +1,184 @@
+#ifndef GLITTER_SIMD_HPP
+#define GLITTER_SIMD_HPP
+
+#include <cmath>
+#include <cstdint>
+
+// The one place the instruction set is picked: AVX2 when the compiler targets it, SSE2
+// on every x86-64 and on 32-bit x86 built for it, plain floats anywhere else.
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define GLITTER_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define GLITTER_SIMD_SSE2
+#endif
+
+/// One register worth of floats and the operations the SIMD kernels are written against,
+/// so each kernel is written once and runs LANES elements per iteration. Masks are the
+/// result of a comparison, all bits set in the lanes where it held; bits() packs them
+/// one bit per lane, lane 0 lowest. load() and store() take any address, loadAligned()
+/// and storeAligned() one aligned to a whole register.
+namespace simd {
+
+#if defined(GLITTER_SIMD_AVX2)
+	const int LANES = 8;
+	typedef __m256 Lanes;
+	typedef __m256 Mask;
+	typedef __m256i Indices;
+	const char* const ISA_NAME = "avx2";
+
+	inline Lanes splat(float f) { return _mm256_set1_ps(f); }
+	inline Lanes load(const float* p) { return _mm256_loadu_ps(p); }
+	inline Lanes loadAligned(const float* p) { return _mm256_load_ps(p); }
+	inline void store(float* p, Lanes v) { _mm256_storeu_ps(p, v); }
+	inline void storeAligned(float* p, Lanes v) { _mm256_store_ps(p, v); }
+	inline Lanes laneOffsets() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+	inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+	inline Lanes min(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+	inline Lanes sqrt(Lanes a) { return _mm256_sqrt_ps(a); }
+	// a with the sign of b flipped into it
+	inline Lanes flipSign(Lanes a, Lanes b) { return _mm256_xor_ps(a, _mm256_and_ps(b, _mm256_set1_ps(-0.0f))); }
+	#if defined(__FMA__)
+		inline Lanes madd(Lanes a, Lanes b, Lanes c) { return _mm256_fmadd_ps(a, b, c); }
+	#else
+		inline Lanes madd(Lanes a, Lanes b, Lanes c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+	#endif
+	inline float reduceMin(Lanes a)
+	{
+		__m128 v = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	inline float reduceMax(Lanes a)
+	{
+		__m128 v = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+
+	inline Mask less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline Mask lessEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	inline Mask greaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	inline Mask maskAnd(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+	inline Mask maskOr(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+	// a and not b
+	inline Mask maskAndNot(Mask a, Mask b) { return _mm256_andnot_ps(b, a); }
+	inline Mask maskAll() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+	inline Mask maskNone() { return _mm256_setzero_ps(); }
+	inline uint32_t bits(Mask m) { return (uint32_t)_mm256_movemask_ps(m); }
+	inline Lanes select(Mask m, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, m); }
+
+	inline Indices splatIndex(int i) { return _mm256_set1_epi32(i); }
+	inline Indices loadIndices(const int* p) { return _mm256_load_si256((const __m256i*)p); }
+	inline void storeIndices(int* p, Indices v) { _mm256_store_si256((__m256i*)p, v); }
+	inline Indices addIndices(Indices a, Indices b) { return _mm256_add_epi32(a, b); }
+	inline Indices selectIndices(Mask m, Indices a, Indices b)
+	{
+		return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m));
+	}
+#elif defined(GLITTER_SIMD_SSE2)
+	const int LANES = 4;
+	typedef __m128 Lanes;
+	typedef __m128 Mask;
+	typedef __m128i Indices;
+	const char* const ISA_NAME = "sse2";
+
+	inline Lanes splat(float f) { return _mm_set1_ps(f); }
+	inline Lanes load(const float* p) { return _mm_loadu_ps(p); }
+	inline Lanes loadAligned(const float* p) { return _mm_load_ps(p); }
+	inline void store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+	inline void storeAligned(float* p, Lanes v) { _mm_store_ps(p, v); }
+	inline Lanes laneOffsets() { return _mm_setr_ps(0, 1, 2, 3); }
+
+	inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+	inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+	inline Lanes min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+	inline Lanes max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+	inline Lanes sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+	inline Lanes flipSign(Lanes a, Lanes b) { return _mm_xor_ps(a, _mm_and_ps(b, _mm_set1_ps(-0.0f))); }
+	inline Lanes madd(Lanes a, Lanes b, Lanes c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	inline float reduceMin(Lanes a)
+	{
+		__m128 v = _mm_min_ps(a, _mm_movehl_ps(a, a));
+		return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	inline float reduceMax(Lanes a)
+	{
+		__m128 v = _mm_max_ps(a, _mm_movehl_ps(a, a));
+		return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+
+	inline Mask less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+	inline Mask lessEqual(Lanes a, Lanes b) { return _mm_cmple_ps(a, b); }
+	inline Mask greaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+	inline Mask maskAnd(Mask a, Mask b) { return _mm_and_ps(a, b); }
+	inline Mask maskOr(Mask a, Mask b) { return _mm_or_ps(a, b); }
+	inline Mask maskAndNot(Mask a, Mask b) { return _mm_andnot_ps(b, a); }
+	inline Mask maskAll() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+	inline Mask maskNone() { return _mm_setzero_ps(); }
+	inline uint32_t bits(Mask m) { return (uint32_t)_mm_movemask_ps(m); }
+	inline Lanes select(Mask m, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+	inline Indices splatIndex(int i) { return _mm_set1_epi32(i); }
+	inline Indices loadIndices(const int* p) { return _mm_load_si128((const __m128i*)p); }
+	inline void storeIndices(int* p, Indices v) { _mm_store_si128((__m128i*)p, v); }
+	inline Indices addIndices(Indices a, Indices b) { return _mm_add_epi32(a, b); }
+	inline Indices selectIndices(Mask m, Indices a, Indices b)
+	{
+		return _mm_castps_si128(select(m, _mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+	}
+#else
+	const int LANES = 1;
+	typedef float Lanes;
+	typedef bool Mask;
+	typedef int Indices;
+	const char* const ISA_NAME = "scalar";
+
+	inline Lanes splat(float f) { return f; }
+	inline Lanes load(const float* p) { return *p; }
+	inline Lanes loadAligned(const float* p) { return *p; }
+	inline void store(float* p, Lanes v) { *p = v; }
+	inline void storeAligned(float* p, Lanes v) { *p = v; }
+	inline Lanes laneOffsets() { return 0.0f; }
+
+	inline Lanes add(Lanes a, Lanes b) { return a + b; }
+	inline Lanes sub(Lanes a, Lanes b) { return a - b; }
+	inline Lanes mul(Lanes a, Lanes b) { return a * b; }
+	inline Lanes div(Lanes a, Lanes b) { return a / b; }
+	inline Lanes min(Lanes a, Lanes b) { return a < b ? a : b; }
+	inline Lanes max(Lanes a, Lanes b) { return a > b ? a : b; }
+	inline Lanes sqrt(Lanes a) { return std::sqrt(a); }
+	inline Lanes flipSign(Lanes a, Lanes b) { return b < 0 ? -a : a; }
+	inline Lanes madd(Lanes a, Lanes b, Lanes c) { return a * b + c; }
+	inline float reduceMin(Lanes a) { return a; }
+	inline float reduceMax(Lanes a) { return a; }
+
+	inline Mask less(Lanes a, Lanes b) { return a < b; }
+	inline Mask lessEqual(Lanes a, Lanes b) { return a <= b; }
+	inline Mask greaterEqual(Lanes a, Lanes b) { return a >= b; }
+	inline Mask maskAnd(Mask a, Mask b) { return a && b; }
+	inline Mask maskOr(Mask a, Mask b) { return a || b; }
+	inline Mask maskAndNot(Mask a, Mask b) { return a && !b; }
+	inline Mask maskAll() { return true; }
+	inline Mask maskNone() { return false; }
+	inline uint32_t bits(Mask m) { return m ? 1u : 0u; }
+	inline Lanes select(Mask m, Lanes a, Lanes b) { return m ? a : b; }
+
+	inline Indices splatIndex(int i) { return i; }
+	inline Indices loadIndices(const int* p) { return *p; }
+	inline void storeIndices(int* p, Indices v) { *p = v; }
+	inline Indices addIndices(Indices a, Indices b) { return a + b; }
+	inline Indices selectIndices(Mask m, Indices a, Indices b) { return m ? a : b; }
+#endif
+
+} // namespace simd
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef GLITTER_SPSC_QUEUE_HPP
+#define GLITTER_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/// Bounded lock-free queue between exactly one producer thread and one consumer
+/// thread. Neither side ever blocks: push fails when the queue is full and pop
+/// fails when it is empty.
+template <typename T>
+class SpscQueue
+{
+public:
+	/// \p capacity is rounded up to a power of two.
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity) size *= 2;
+		slots.resize(size);
+		mask = size - 1;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	/// Producer side.
+	bool push(T&& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head_cache > mask)
+		{
+			head_cache = head.load(std::memory_order_acquire);
+			if (t - head_cache > mask) return false;
+		}
+		slots[t & mask] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Consumer side.
+	bool pop(T* item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail_cache)
+		{
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (h == tail_cache) return false;
+		}
+		*item = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Consumer side.
+	bool isEmpty() const
+	{
+		return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+	}
+
+private:
+	// each side only touches its own index and its cached copy of the other one,
+	// the padding keeps the two sides on separate cache lines
+	std::vector<T> slots;
+	size_t mask;
+	char pad0[64];
+	std::atomic<size_t> head{0};
+	size_t tail_cache = 0; // consumer's last view of tail
+	char pad1[64];
+	std::atomic<size_t> tail{0};
+	size_t head_cache = 0; // producer's last view of head
+	char pad2[64];
+};
+
+#endif
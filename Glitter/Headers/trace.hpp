@@ -0,0 +1,59 @@
+#ifndef GLITTER_TRACE_HPP
+#define GLITTER_TRACE_HPP
+
+// Scoped zone tracing, written out as Chrome trace event JSON (chrome://tracing,
+// ui.perfetto.dev). Configure with -DGLITTER_TRACE=ON to enable it; otherwise
+// every macro below expands to nothing.
+//
+//   void work()
+//   {
+//       TRACE_ZONE("work"); // measured until the end of the scope
+//       ...
+//   }
+//
+// Zone and thread names must be string literals, only the pointer is stored.
+// Every thread appends to its own buffer without locks, a thread that exits hands
+// its buffer on to the next new one; TRACE_SAVE should run once the traced work has
+// finished, zones still open are not written.
+
+#ifdef GLITTER_TRACE
+
+#include <cstdint>
+
+#define GLITTER_TRACE_CONCAT2(a, b) a##b
+#define GLITTER_TRACE_CONCAT(a, b) GLITTER_TRACE_CONCAT2(a, b)
+
+#define TRACE_ZONE(name) TraceZone GLITTER_TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) traceSetThreadName(name)
+#define TRACE_SAVE(path) traceSave(path)
+
+/// Nanoseconds since the first call in the process.
+uint64_t traceNow();
+void traceRecord(const char* name, uint64_t begin, uint64_t end);
+void traceSetThreadName(const char* name);
+/// Writes every recorded zone of every thread, including finished ones.
+bool traceSave(const char* path);
+
+class TraceZone
+{
+public:
+	explicit TraceZone(const char* zone_name) : name(zone_name), begin(traceNow()) {}
+	~TraceZone() { traceRecord(name, begin, traceNow()); }
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t begin;
+};
+
+#else
+
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_SAVE(path) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef GLITTER_VERTEX_LAYOUT_HPP
+#define GLITTER_VERTEX_LAYOUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/// Vertex attributes; the value doubles as the shader attribute location.
+enum VertexAttribute
+{
+	VERTEX_POSITION,
+	VERTEX_NORMAL,
+	VERTEX_TANGENT,
+	VERTEX_COLOR,
+	VERTEX_UV,
+	VERTEX_JOINTS,  ///< Indices into FBXImporter::bones, up to four per vertex.
+	VERTEX_WEIGHTS, ///< Weight of each joint, they add up to 1.
+	VERTEX_ATTRIBUTE_COUNT
+};
+
+enum class VertexComponentType : uint8_t
+{
+	FLOAT32,
+	FLOAT16,
+	INT16,
+	UINT16,
+	UINT8
+};
+
+struct VertexAttributeFormat
+{
+	VertexComponentType type = VertexComponentType::FLOAT32;
+	uint8_t components = 0;  ///< 0 = not part of the layout.
+	bool normalized = false; ///< Integers map to [0, 1] or [-1, 1] instead of converting as is.
+	uint16_t offset = 0;     ///< From the start of the vertex, in bytes.
+};
+
+/// Runtime description of an interleaved vertex that holds only some of the
+/// attributes, each in its own format. Attributes are appended in the order
+/// they are added, so layouts built the same way are identical.
+struct VertexLayout
+{
+	VertexAttributeFormat attributes[VERTEX_ATTRIBUTE_COUNT];
+	uint32_t stride = 0;
+
+	bool has(VertexAttribute attribute) const { return attributes[attribute].components != 0; }
+	/// Bit 1 << attribute set for every attribute in the layout.
+	uint32_t getMask() const;
+	/// Appends \p attribute to the end of the vertex; the stride stays a multiple of 4.
+	void add(VertexAttribute attribute, VertexComponentType type, int components, bool normalized = false);
+};
+
+size_t getVertexComponentSize(VertexComponentType type);
+
+/// Components of \p attribute in the importer's float vertices: xyz positions,
+/// normals and tangents, rgba colors, uv texture coordinates, four joints and weights.
+int getFloatVertexComponents(VertexAttribute attribute);
+
+/// The importer's layout: every attribute of \p mask (bits 1 << VertexAttribute)
+/// as float32, in attribute order. Positions are always included.
+VertexLayout makeFloatVertexLayout(uint32_t mask);
+
+#endif
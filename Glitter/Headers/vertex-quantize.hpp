@@ -0,0 +1,75 @@
+#ifndef GLITTER_VERTEX_QUANTIZE_HPP
+#define GLITTER_VERTEX_QUANTIZE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex-layout.hpp"
+
+/// Encodings of the compact vertex format. Normals and tangents are always
+/// octahedral snorm16x2, colors unorm8x4, joints uint16x4 and weights unorm16x4;
+/// positions and UVs can pick.
+struct VertexQuantizeSettings
+{
+	bool quantize_positions = false; ///< unorm16x3 within the mesh bounds instead of float32x3.
+	bool unorm_uvs = false;          ///< unorm16x2 within the UV bounds instead of float16x2.
+};
+
+/// Layout of one mesh's compact vertices and how to get the original values back:
+/// value = offset + scale * normalized attribute. Without quantized positions or
+/// unorm UVs the respective offset is 0 and the scale 1. Octahedral normals and
+/// tangents are plain INT16 in the layout, decoded as max(v / 32767, -1).
+struct VertexQuantization
+{
+	VertexLayout layout;
+
+	float position_decode_offset[3] = {0, 0, 0};
+	float position_decode_scale[3] = {1, 1, 1};
+	float uv_decode_offset[2] = {0, 0};
+	float uv_decode_scale[2] = {1, 1};
+};
+
+/// Largest difference between the source and the decoded compact vertices.
+struct QuantizationError
+{
+	float position = 0; ///< Distance, in mesh units.
+	float normal = 0;   ///< Angle in degrees; zero length vectors are skipped.
+	float tangent = 0;
+	float uv = 0;       ///< Per component.
+	float color = 0;    ///< Per component, colors are clamped to [0, 1] first.
+	float weight = 0;   ///< Per joint weight.
+
+	void merge(const QuantizationError& other);
+};
+
+/// Interleaved float streams \p stride bytes apart: xyz positions, normals and
+/// tangents, rgba colors, uv texture coordinates, four joint indices and their
+/// weights. Only positions are required, the compact layout leaves out the
+/// attributes whose stream is null.
+struct VertexQuantizeInput
+{
+	const float* positions = nullptr;
+	const float* normals = nullptr;
+	const float* tangents = nullptr;
+	const float* colors = nullptr;
+	const float* uvs = nullptr;
+	const float* joints = nullptr;
+	const float* weights = nullptr;
+	size_t stride = 0;
+	size_t count = 0;
+};
+
+/// Compact layout of the attributes in \p mask (bits 1 << VertexAttribute); the
+/// decode ranges are left at identity.
+VertexQuantization getVertexQuantization(const VertexQuantizeSettings& settings, uint32_t mask);
+
+/// Encodes \p input into \p dst, which needs quantization->layout.stride * input.count
+/// bytes. Fills \p quantization with the layout and the decode ranges of this
+/// mesh and, when \p error is not null, measures the error by decoding again.
+void quantizeVertices(const VertexQuantizeInput& input, const VertexQuantizeSettings& settings,
+	uint8_t* dst, VertexQuantization* quantization, QuantizationError* error);
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef GLITTER_VERTEX_TRANSFORM_HPP
+#define GLITTER_VERTEX_TRANSFORM_HPP
+
+#include <cstddef>
+
+/// Source attribute streams, as OpenFBX stores them: tightly packed xyz doubles.
+struct VertexTransformInput
+{
+	const double* positions = nullptr; ///< Required.
+	const double* normals = nullptr;   ///< Optional, transformed without translation and normalized.
+	const double* tangents = nullptr;  ///< Optional, transformed without translation and normalized.
+	const int* remap = nullptr;        ///< Source vertex of every output vertex, null for 0..count-1.
+	int count = 0;
+};
+
+/// Destination streams: xyz floats \p stride bytes apart, usually members of an
+/// interleaved vertex. Streams whose input is null are left untouched.
+struct VertexTransformOutput
+{
+	float* positions = nullptr;
+	float* normals = nullptr;
+	float* tangents = nullptr;
+	size_t stride = 0;
+
+	// filled in by transformVertices
+	float bounds_min[3];
+	float bounds_max[3];
+	int extreme_vertices[6];  ///< Vertices at min x, max x, min y, max y, min z and max z, -1 when empty.
+};
+
+/// Converts and transforms whole attribute streams in SoA blocks, reducing the
+/// bounds of the transformed positions, and the vertices lying on them, on the way.
+/// \p matrix is a column-major 4x4; positions are multiplied by \p scale (in double,
+/// like the source data) before the transform. An empty input yields inverted (null)
+/// bounds.
+void transformVertices(const VertexTransformInput& input, const float matrix[16], double scale,
+	VertexTransformOutput* output);
+
+/// Instruction set the kernel was compiled for: "avx2", "sse2" or "scalar".
+const char* getVertexTransformISA();
+
+#endif
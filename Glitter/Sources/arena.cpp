@@ -0,0 +1,101 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+Arena::~Arena()
+{
+	for (Block* block : blocks)
+	{
+		delete[] block->data;
+		delete block;
+	}
+}
+
+
+Arena::Block* Arena::addBlock(size_t size)
+{
+	Block* block = new Block;
+	block->data = new uint8_t[size];
+	block->size = size;
+	block->offset.store(0, std::memory_order_relaxed);
+	blocks.push_back(block);
+	current.store(block, std::memory_order_release);
+	return block;
+}
+
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+	assert(alignment && (alignment & (alignment - 1)) == 0);
+	for (;;)
+	{
+		// lock-free fast path: claim a range of the current block
+		Block* block = current.load(std::memory_order_acquire);
+		if (block)
+		{
+			uintptr_t base = (uintptr_t)block->data;
+			size_t offset = block->offset.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				size_t aligned = (size_t)(((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+				if (aligned + size > block->size) break;
+				if (block->offset.compare_exchange_weak(offset, aligned + size, std::memory_order_relaxed))
+				{
+					return block->data + aligned;
+				}
+			}
+		}
+
+		// out of space: the first thread to get here adds a block, the others retry on it
+		std::lock_guard<std::mutex> lock(grow_mutex);
+		if (current.load(std::memory_order_acquire) == block)
+		{
+			addBlock(std::max(min_block_size, size + alignment));
+		}
+	}
+}
+
+
+void Arena::reserve(size_t size)
+{
+	Block* block = current.load(std::memory_order_relaxed);
+	size_t available = block ? block->size - block->offset.load(std::memory_order_relaxed) : 0;
+	if (available < size) addBlock(std::max(min_block_size, size));
+}
+
+
+void Arena::reset()
+{
+	size_t capacity = getCapacity();
+	if (blocks.size() > 1)
+	{
+		for (Block* block : blocks)
+		{
+			delete[] block->data;
+			delete block;
+		}
+		blocks.clear();
+		addBlock(capacity);
+	}
+	else if (!blocks.empty())
+	{
+		blocks[0]->offset.store(0, std::memory_order_relaxed);
+	}
+}
+
+
+size_t Arena::getUsed() const
+{
+	size_t used = 0;
+	for (const Block* block : blocks) used += block->offset.load(std::memory_order_relaxed);
+	return used;
+}
+
+
+size_t Arena::getCapacity() const
+{
+	size_t capacity = 0;
+	for (const Block* block : blocks) capacity += block->size;
+	return capacity;
+}
@@ -0,0 +1,128 @@
+#include "background-import.hpp"
+#include "mesh-cache.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+
+BackgroundImport::~BackgroundImport()
+{
+	cancelled.store(true, std::memory_order_relaxed);
+	if (worker.joinable()) worker.join();
+	while (std::unique_ptr<FBXImporter::ImportMesh> mesh = pop()) {}
+	if (importer) importer->clearSources();
+}
+
+
+void BackgroundImport::start(const std::string& fbx_path, const FBXImporter& settings, FileSource::Mode mode)
+{
+	assert(!worker.joinable());
+	path = fbx_path;
+	importer.reset(new FBXImporter(settings));
+	// only the settings are wanted, the sources still belong to the caller
+	importer->scenes.clear();
+	importer->meshes.clear();
+	importer->materials.clear();
+	importer->animations.clear();
+	importer->bones.clear();
+	worker_done.store(false, std::memory_order_relaxed);
+	worker = std::thread(&BackgroundImport::run, this, mode);
+}
+
+
+std::unique_ptr<FBXImporter::ImportMesh> BackgroundImport::pop()
+{
+	FBXImporter::ImportMesh* mesh = nullptr;
+	finished.pop(&mesh);
+	return std::unique_ptr<FBXImporter::ImportMesh>(mesh);
+}
+
+
+bool BackgroundImport::isDone()
+{
+	return worker_done.load(std::memory_order_acquire) && finished.isEmpty();
+}
+
+
+void BackgroundImport::run(FileSource::Mode mode)
+{
+	TRACE_THREAD_NAME("Import");
+	// the destructor joins this thread, so a cancelled import stops at the next stage; it
+	// writes no cooked file, its meshes would be missing the stages after that
+	auto isCancelled = [this]() { return cancelled.load(std::memory_order_relaxed); };
+	auto load_start = std::chrono::steady_clock::now();
+	std::string cooked_path = path + ".cooked";
+	FileSource source;
+	if (source.open(path.c_str(), mode))
+	{
+		size_t file_size = source.size();
+		bool mapped = source.isMapped();
+		// the cooked file is only trusted when it was built from these exact bytes and settings;
+		// it holds the meshes alone, so a cache hit imports no animations
+		uint64_t key = getCookedMeshKey(source.data(), file_size, *importer);
+		if (!loadCookedMeshes(cooked_path.c_str(), key, &importer->meshes))
+		{
+			// OpenFBX takes an int size and keeps its own copy of the data
+			ofbx::IScene* scene = nullptr;
+			{
+				TRACE_ZONE("ofbx::load");
+				if (file_size <= INT_MAX && !isCancelled()) scene = ofbx::load(source.data(), (int)file_size);
+				source.close();
+			}
+			if (scene)
+			{
+				importer->scenes.push_back(scene);
+				if (!isCancelled()) importer->gatherMeshes(scene);
+				if (!isCancelled())
+				{
+					// gatherMeshes gathered the bones the tracks are sampled for
+					importer->gatherAnimations(scene);
+					importer->importAnimations();
+				}
+				if (!isCancelled()) importer->postprocessMeshes();
+				if (!isCancelled()) importer->generateLODs();
+				if (!isCancelled()) importer->optimizeMeshes();
+				if (!isCancelled() && !saveCookedMeshes(cooked_path.c_str(), key, importer->meshes))
+				{
+					fprintf(stderr, "Failed to write %s\n", cooked_path.c_str());
+				}
+			}
+			else if (!isCancelled())
+			{
+				fprintf(stderr, "%s\n", file_size <= INT_MAX ? ofbx::getError() : "File too large for OpenFBX");
+			}
+		}
+		source.close();
+		// the cooked file keeps the float vertices, the compact ones are cheap to rebuild
+		if (importer->quantize_vertices && !isCancelled()) importer->quantizeMeshes();
+		if (!isCancelled())
+		{
+			std::chrono::duration<double, std::milli> load_time = std::chrono::steady_clock::now() - load_start;
+			printf("%s: %.1f MB %s, loaded in %.1f ms, peak RSS %.1f MB\n", path.c_str(),
+				file_size / (1024.0 * 1024.0), mapped ? "mapped" : "read",
+				load_time.count(), getPeakResidentMemory() / (1024.0 * 1024.0));
+		}
+	}
+	else
+	{
+		fprintf(stderr, "Failed to open %s\n", path.c_str());
+	}
+
+	// the consumer drains the queue once per frame, wait for room instead of spinning
+	for (FBXImporter::ImportMesh& mesh : importer->meshes)
+	{
+		if (isCancelled()) break;
+		FBXImporter::ImportMesh* item = new FBXImporter::ImportMesh(std::move(mesh));
+		while (!finished.push(std::move(item)))
+		{
+			if (isCancelled())
+			{
+				delete item;
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	worker_done.store(true, std::memory_order_release);
+}
@@ -0,0 +1,110 @@
+#include "bounding-sphere.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// how much the first refinement pass shrinks the sphere before growing it back, the
+// later ones less and less, settling on the optimum
+const float REFINE_SHRINK = 0.4f;
+
+inline glm::vec3 getPosition(const float* positions, size_t stride, int vertex)
+{
+	const float* p = (const float*)((const uint8_t*)positions + stride * vertex);
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+void findExtremeVertices(const float* positions, size_t stride, int count, int extremes[6])
+{
+	glm::vec3 min = getPosition(positions, stride, 0), max = min;
+	std::fill(extremes, extremes + 6, 0);
+	for (int v = 1; v < count; ++v)
+	{
+		glm::vec3 p = getPosition(positions, stride, v);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (p[axis] < min[axis]) min[axis] = p[axis], extremes[axis * 2] = v;
+			if (p[axis] > max[axis]) max[axis] = p[axis], extremes[axis * 2 + 1] = v;
+		}
+	}
+}
+
+// Ritter's update: a point outside moves the sphere towards it just enough that the new
+// one touches both the point and the far side of the old one, so it still encloses it.
+// Visits every point once, starting at \p first and walking backwards when \p reverse.
+void growSphere(BoundingSphere* sphere, const float* positions, size_t stride, int count, int first, bool reverse)
+{
+	float radius_squared = sphere->radius * sphere->radius;
+	int step = reverse ? -1 : 1;
+	for (int i = 0, v = first; i < count; ++i, v += step)
+	{
+		if (v == count) v = 0;
+		else if (v < 0) v = count - 1;
+		glm::vec3 d = getPosition(positions, stride, v) - sphere->center;
+		float distance_squared = glm::dot(d, d);
+		if (distance_squared <= radius_squared) continue;
+
+		float distance = sqrtf(distance_squared);
+		float radius = (sphere->radius + distance) * 0.5f;
+		sphere->center += d * ((radius - sphere->radius) / distance);
+		sphere->radius = radius;
+		radius_squared = radius * radius;
+	}
+}
+
+// The center is what growing decides, the radius is measured again from it: the updates
+// round, this makes the sphere exact for its center and never misses a point.
+void fitRadius(BoundingSphere* sphere, const float* positions, size_t stride, int count)
+{
+	float radius_squared = 0;
+	for (int v = 0; v < count; ++v)
+	{
+		glm::vec3 d = getPosition(positions, stride, v) - sphere->center;
+		radius_squared = std::max(radius_squared, glm::dot(d, d));
+	}
+	sphere->radius = sqrtf(radius_squared);
+}
+
+} // anonymous namespace
+
+
+// Jack Ritter, "An Efficient Bounding Sphere", Graphics Gems, 1990; the refinement is
+// the iterative one of Thomas Larsson, "Fast and Tight Fitting Bounding Spheres", 2008.
+BoundingSphere computeBoundingSphere(const float* positions, size_t position_stride, int count,
+	const int* extreme_vertices, int refine_passes)
+{
+	BoundingSphere sphere;
+	if (count <= 0) return sphere;
+
+	int extremes[6];
+	if (extreme_vertices) std::copy(extreme_vertices, extreme_vertices + 6, extremes);
+	else findExtremeVertices(positions, position_stride, count, extremes);
+
+	float max_distance_squared = -1;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		glm::vec3 a = getPosition(positions, position_stride, extremes[axis * 2]);
+		glm::vec3 b = getPosition(positions, position_stride, extremes[axis * 2 + 1]);
+		float distance_squared = glm::dot(b - a, b - a);
+		if (distance_squared <= max_distance_squared) continue;
+		max_distance_squared = distance_squared;
+		sphere.center = (a + b) * 0.5f;
+		sphere.radius = sqrtf(distance_squared) * 0.5f;
+	}
+	growSphere(&sphere, positions, position_stride, count, 0, false);
+
+	// every pass starts the walk somewhere else, the order decides where growing ends up
+	BoundingSphere candidate;
+	for (int pass = 0; pass < refine_passes; ++pass)
+	{
+		candidate.center = sphere.center;
+		candidate.radius = sphere.radius * (1.0f - REFINE_SHRINK / (pass + 1));
+		int first = (int)((int64_t)count * (pass + 1) / (refine_passes + 1));
+		growSphere(&candidate, positions, position_stride, count, first, pass % 2 == 0);
+		if (candidate.radius < sphere.radius) sphere = candidate;
+	}
+	fitRadius(&sphere, positions, position_stride, count);
+	return sphere;
+}
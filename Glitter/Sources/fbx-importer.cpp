@@ -0,0 +1,1017 @@
+#include "fbx-importer.hpp"
+#include "mesh-simplify.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include "vertex-transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+using ImportMesh = FBXImporter::ImportMesh;
+
+// grid cells beyond 2^62 would overflow the key, see WeldKey
+const float MAX_GRID_CELL = 4611686018427387904.0f;
+
+// Hashes the vertex attributes snapped to a grid of 1 / inv_epsilon, or their exact
+// bit patterns when inv_epsilon is 0. Two vertices weld iff their keys are equal.
+struct WeldKey
+{
+	static const int MAX_COMPONENTS = 23; // a float vertex with every attribute
+
+	WeldKey(const float* src, int component_count, float inv_epsilon) : count(component_count)
+	{
+		assert(count <= MAX_COMPONENTS);
+		hash = 0x9e3779b97f4a7c15ULL;
+		for (int i = 0; i < count; ++i)
+		{
+			float f = src[i];
+			float snapped = std::floor(f * inv_epsilon + 0.5f);
+			// NaN, infinity and values too large for the grid keep their bits, offset so
+			// they never equal a grid cell
+			if (inv_epsilon > 0 && std::fabs(snapped) < MAX_GRID_CELL)
+			{
+				components[i] = (int64_t)snapped;
+			}
+			else
+			{
+				if (f == 0) f = 0; // -0 and +0 weld
+				uint32_t bits;
+				memcpy(&bits, &f, sizeof(bits));
+				components[i] = inv_epsilon > 0 ? INT64_MIN + bits : bits;
+			}
+			hash ^= (uint64_t)components[i] + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+		}
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+	}
+
+	bool operator==(const WeldKey& rhs) const
+	{
+		return count == rhs.count && memcmp(components, rhs.components, sizeof(components[0]) * count) == 0;
+	}
+
+	int64_t components[MAX_COMPONENTS];
+	int count;
+	uint64_t hash;
+};
+
+
+// For every vertex the first one with an equal WeldKey, the vertex itself when none comes before it.
+std::vector<int> findFirstEqualVertices(const float* vertices, int vertex_count, int component_count, float inv_epsilon)
+{
+	size_t table_size = 1;
+	while (table_size < (size_t)vertex_count * 2) table_size <<= 1;
+	const size_t mask = table_size - 1;
+	std::vector<int> table(table_size, -1);
+	std::vector<WeldKey> keys;
+	std::vector<int> owners; // the vertex each key came from
+	std::vector<int> first(vertex_count);
+	keys.reserve(vertex_count);
+	owners.reserve(vertex_count);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		WeldKey key(vertices + component_count * i, component_count, inv_epsilon);
+		for (size_t slot = key.hash & mask;; slot = (slot + 1) & mask)
+		{
+			int unique_idx = table[slot];
+			if (unique_idx < 0)
+			{
+				table[slot] = (int)keys.size();
+				keys.push_back(key);
+				owners.push_back(i);
+				first[i] = i;
+				break;
+			}
+			if (keys[unique_idx] == key)
+			{
+				first[i] = owners[unique_idx];
+				break;
+			}
+		}
+	}
+	return first;
+}
+
+
+// Writes everything transformVertices does not: UVs, colors, skinning and the identity
+// index list. Whether the mesh has them is a template parameter so the loop is branch
+// free; getFillAttributes picks the instantiation once per mesh.
+template <bool HAS_UVS, bool HAS_COLORS, bool HAS_SKIN>
+void fillAttributes(ImportMesh& mesh, const int* src, const ofbx::Vec2* uvs, const ofbx::Vec4* colors,
+	const FBXImporter::Skin* skinning)
+{
+	uint8_t* vertices = (uint8_t*)mesh.vertices.data();
+	int* indices = mesh.indices.data();
+	const VertexLayout& layout = mesh.layout;
+	size_t uv_offset = layout.attributes[VERTEX_UV].offset;
+	size_t color_offset = layout.attributes[VERTEX_COLOR].offset;
+	size_t joints_offset = layout.attributes[VERTEX_JOINTS].offset;
+	size_t weights_offset = layout.attributes[VERTEX_WEIGHTS].offset;
+	for (int i = 0, c = mesh.getVertexCount(); i < c; ++i)
+	{
+		uint8_t* v = vertices + layout.stride * i;
+		if (HAS_UVS)
+		{
+			const ofbx::Vec2& uv = uvs[src[i]];
+			float* dst = (float*)(v + uv_offset);
+			dst[0] = (float)uv.x;
+			dst[1] = (float)uv.y;
+		}
+		if (HAS_COLORS)
+		{
+			const ofbx::Vec4& color = colors[src[i]];
+			float* dst = (float*)(v + color_offset);
+			dst[0] = (float)color.x;
+			dst[1] = (float)color.y;
+			dst[2] = (float)color.z;
+			dst[3] = (float)color.w;
+		}
+		if (HAS_SKIN)
+		{
+			const FBXImporter::Skin& skin = skinning[src[i]];
+			float* joints = (float*)(v + joints_offset);
+			float* weights = (float*)(v + weights_offset);
+			for (int j = 0; j < 4; ++j)
+			{
+				joints[j] = skin.joints[j];
+				weights[j] = skin.weights[j];
+			}
+		}
+		indices[i] = i;
+	}
+}
+
+typedef void (*FillAttributesFn)(ImportMesh&, const int*, const ofbx::Vec2*, const ofbx::Vec4*, const FBXImporter::Skin*);
+
+FillAttributesFn getFillAttributes(bool has_uvs, bool has_colors, bool has_skin)
+{
+	static const FillAttributesFn fns[] = {
+		fillAttributes<false, false, false>, fillAttributes<false, false, true>,
+		fillAttributes<false, true, false>, fillAttributes<false, true, true>,
+		fillAttributes<true, false, false>, fillAttributes<true, false, true>,
+		fillAttributes<true, true, false>, fillAttributes<true, true, true>
+	};
+	return fns[(has_uvs ? 4 : 0) + (has_colors ? 2 : 0) + (has_skin ? 1 : 0)];
+}
+
+
+// A level of detail of base: the same submesh drawn with the simplified indices, keeping
+// only the vertices they use, in order of first use.
+ImportMesh makeLODMesh(const ImportMesh& base, const int* indices, int index_count, int level, int refine_passes,
+	Arena* arena)
+{
+	ImportMesh lod;
+	lod.fbx = base.fbx;
+	lod.fbx_mat = base.fbx_mat;
+	lod.material_index = base.material_index;
+	lod.material_name = base.material_name;
+	lod.import = base.import;
+	lod.import_physics = base.import_physics;
+	lod.lod = level;
+	lod.layout = base.layout;
+	lod.vertices = ArenaVector<float>(arena);
+	lod.indices = ArenaVector<int>(arena);
+	lod.index_data = ArenaVector<uint8_t>(arena);
+
+	int base_vertex_count = base.getVertexCount();
+	std::vector<int> remap(base_vertex_count);
+	int vertex_count = optimizeVertexFetchRemap(remap.data(), indices, index_count, base_vertex_count);
+	size_t vertex_floats = base.layout.stride / sizeof(float);
+	lod.vertices.resize(vertex_floats * vertex_count);
+	for (int v = 0; v < base_vertex_count; ++v)
+	{
+		if (remap[v] < 0) continue;
+		memcpy(&lod.vertices[vertex_floats * remap[v]], &base.vertices[vertex_floats * v], base.layout.stride);
+	}
+	lod.indices.resize(index_count);
+	for (int i = 0; i < index_count; ++i) lod.indices[i] = remap[indices[i]];
+
+	lod.aabb.setNull();
+	const float* position = lod.getAttribute(VERTEX_POSITION);
+	for (int v = 0; v < vertex_count; ++v) lod.aabb.extend(glm::make_vec3(position + vertex_floats * v));
+	lod.bounding_sphere = computeBoundingSphere(position, base.layout.stride, vertex_count, nullptr, refine_passes);
+	FBXImporter::packIndices(lod);
+	return lod;
+}
+
+
+// ASCII files name stacks "AnimStack::Take 001", binary ones just "Take 001"
+const char* getStackName(const ofbx::AnimationStack& stack)
+{
+	const char* prefix = "AnimStack::";
+	return strncmp(stack.name, prefix, strlen(prefix)) == 0 ? stack.name + strlen(prefix) : stack.name;
+}
+
+
+const ofbx::TakeInfo* getTakeInfo(const ofbx::IScene& scene, const ofbx::AnimationStack& stack)
+{
+	const ofbx::TakeInfo* take = scene.getTakeInfo(stack.name);
+	return take ? take : scene.getTakeInfo(getStackName(stack));
+}
+
+
+// getRotation for matrices with scaling: the quaternion of the normalized axes
+glm::quat getUnscaledRotation(const ofbx::Matrix& mtx)
+{
+	glm::mat3 m;
+	for (int i = 0; i < 3; ++i)
+	{
+		glm::vec3 axis((float)mtx.m[i * 4], (float)mtx.m[i * 4 + 1], (float)mtx.m[i * 4 + 2]);
+		float length = glm::length(axis);
+		m[i] = length > 0 ? axis / length : axis;
+	}
+	return glm::normalize(glm::quat_cast(m));
+}
+
+} // anonymous namespace
+
+
+// only the attributes the source has are stored, the renderer gets the same layout
+VertexLayout FBXImporter::getSourceLayout(const ofbx::Mesh& mesh) const
+{
+	const ofbx::Geometry* geom = mesh.getGeometry();
+	uint32_t attribute_mask = (geom->getNormals() ? 1u << VERTEX_NORMAL : 0)
+		| (geom->getTangents() ? 1u << VERTEX_TANGENT : 0)
+		| (import_vertex_colors && geom->getColors() ? 1u << VERTEX_COLOR : 0)
+		| (geom->getUVs() ? 1u << VERTEX_UV : 0)
+		| (isSkinned(mesh) ? (1u << VERTEX_JOINTS) | (1u << VERTEX_WEIGHTS) : 0);
+	return makeFloatVertexLayout(attribute_mask);
+}
+
+
+// Gathers the four strongest influences of every geometry vertex, normalized to add up to 1.
+// OpenFBX already maps cluster indices to the triangulated vertices, so this is one pass
+// over the cluster weights with a hash lookup per cluster for the joint.
+void FBXImporter::fillSkinInfo(std::vector<Skin>* skinning, const ofbx::Mesh& mesh) const
+{
+	TRACE_ZONE("FBXImporter::fillSkinInfo");
+	const ofbx::Geometry* geom = mesh.getGeometry();
+	const ofbx::Skin* skin = geom->getSkin();
+	int vertex_count = geom->getVertexCount();
+	skinning->assign(vertex_count, Skin());
+
+	for (int i = 0, c = skin->getClusterCount(); i < c; ++i)
+	{
+		const ofbx::Cluster* cluster = skin->getCluster(i);
+		if (cluster->getIndicesCount() == 0 || !cluster->getLink()) continue;
+		// clusters gatherBones skipped have no bone, the others may still not fit a joint index
+		int joint = getBoneIndex(cluster->getLink());
+		if (joint < 0) continue;
+		if (joint > INT16_MAX)
+		{
+			printf("mesh %s: bone %d is past the last joint index %d, its weights are dropped\n", mesh.name, joint, INT16_MAX);
+			continue;
+		}
+		const int* indices = cluster->getIndices();
+		const double* weights = cluster->getWeights();
+		for (int j = 0, n = std::min(cluster->getIndicesCount(), cluster->getWeightsCount()); j < n; ++j)
+		{
+			int idx = indices[j];
+			float weight = (float)weights[j];
+			if (idx < 0 || idx >= vertex_count || !(weight > 0)) continue;
+			Skin& s = (*skinning)[idx];
+			if (s.count < 4)
+			{
+				s.weights[s.count] = weight;
+				s.joints[s.count] = (int16_t)joint;
+				++s.count;
+				continue;
+			}
+			// full: replace the weakest influence if this one is stronger
+			int min = 0;
+			for (int m = 1; m < 4; ++m)
+			{
+				if (s.weights[m] < s.weights[min]) min = m;
+			}
+			if (s.weights[min] < weight)
+			{
+				s.weights[min] = weight;
+				s.joints[min] = (int16_t)joint;
+			}
+		}
+	}
+
+	for (Skin& s : *skinning)
+	{
+		float sum = 0;
+		for (int j = 0; j < s.count; ++j) sum += s.weights[j];
+		if (sum > 0)
+		{
+			for (int j = 0; j < s.count; ++j) s.weights[j] /= sum;
+		}
+		else
+		{
+			// not influenced by any cluster: follows the root
+			s.weights[0] = 1.0f;
+			s.joints[0] = 0;
+			s.count = 1;
+		}
+		// unused slots point at the root with no weight
+		for (int j = s.count; j < 4; ++j)
+		{
+			s.weights[j] = 0.0f;
+			s.joints[j] = 0;
+		}
+	}
+}
+
+
+// Collects every bone a cluster links to, plus their parents up to the root, parents
+// first. One hash lookup per cluster and per new parent keeps it linear in the clusters,
+// and bone_infos answers getBoneIndex, getAnyMeshFromBone and getBindPoseMatrix afterwards.
+void FBXImporter::gatherBones()
+{
+	TRACE_ZONE("FBXImporter::gatherBones");
+	bones.clear();
+	bone_infos.clear();
+	if (ignore_skeleton) return;
+
+	const ofbx::Mesh* previous = nullptr;
+	for (const ImportMesh& mesh : meshes)
+	{
+		// every material of a mesh has its own entry, the skin is the same
+		if (mesh.fbx == previous) continue;
+		previous = mesh.fbx;
+		const ofbx::Skin* skin = mesh.fbx->getGeometry()->getSkin();
+		if (!skin) continue;
+
+		for (int i = 0, c = skin->getClusterCount(); i < c; ++i)
+		{
+			const ofbx::Cluster* cluster = skin->getCluster(i);
+			const ofbx::Object* link = cluster->getLink();
+			if (!link) continue;
+			// insertion order, not the hash map's, decides the bone order below
+			if (!bone_infos.count(link)) bones.push_back(link);
+			BoneInfo& info = bone_infos[link];
+			if (!info.mesh)
+			{
+				info.mesh = mesh.fbx;
+				info.bind_pose = cluster->getTransformLinkMatrix();
+			}
+			// a known parent already brought in the rest of the chain
+			for (const ofbx::Object* parent = link->getParent(); parent && !bone_infos.count(parent); parent = parent->getParent())
+			{
+				bones.push_back(parent);
+				bone_infos[parent];
+			}
+		}
+	}
+
+	// a parent is always shallower than its children
+	std::vector<int> depths(bones.size());
+	std::vector<int> order(bones.size());
+	for (size_t i = 0; i < bones.size(); ++i)
+	{
+		depths[i] = getDepth(bones[i]);
+		order[i] = (int)i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&depths](int a, int b) { return depths[a] < depths[b]; });
+	std::vector<const ofbx::Object*> sorted(bones.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		sorted[i] = bones[order[i]];
+		bone_infos[sorted[i]].index = (int)i;
+	}
+	bones.swap(sorted);
+}
+
+
+// Collapses identical vertices of the mesh in place and points its indices at the survivors,
+// keeping the first occurrence of every vertex so the result is deterministic.
+void FBXImporter::weldVertices(ImportMesh& mesh, float epsilon)
+{
+	TRACE_ZONE("FBXImporter::weldVertices");
+	int vertex_count = mesh.getVertexCount();
+	if (vertex_count == 0) return;
+
+	const int component_count = (int)(mesh.layout.stride / sizeof(float));
+	float* vertices = mesh.vertices.data();
+	float inv_epsilon = epsilon > 0 ? 1.0f / epsilon : 0.0f;
+	std::vector<int> first = findFirstEqualVertices(vertices, vertex_count, component_count, inv_epsilon);
+	std::vector<int> remap(vertex_count);
+	int unique_count = 0;
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		if (first[i] < i)
+		{
+			remap[i] = remap[first[i]];
+			continue;
+		}
+		// survivors are compacted to the front, unique_count <= i so nothing unread is overwritten
+		memmove(vertices + component_count * unique_count, vertices + component_count * i, mesh.layout.stride);
+		remap[i] = unique_count++;
+	}
+
+	mesh.vertices.resize((size_t)component_count * unique_count);
+	// arena memory is not given back anyway, only heap storage is worth reallocating
+	if (!mesh.vertices.get_allocator().getArena()) mesh.vertices.shrink_to_fit();
+	for (int& idx : mesh.indices) idx = remap[idx];
+}
+
+
+void FBXImporter::packIndices(ImportMesh& mesh)
+{
+	bool are_16bit = mesh.getVertexCount() <= 0x10000;
+	mesh.index_size = are_16bit ? sizeof(uint16_t) : sizeof(uint32_t);
+	mesh.index_data.resize(mesh.indices.size() * mesh.index_size);
+	if (are_16bit)
+	{
+		uint16_t* out = (uint16_t*)mesh.index_data.data();
+		for (size_t i = 0; i < mesh.indices.size(); ++i) out[i] = (uint16_t)mesh.indices[i];
+	}
+	else
+	{
+		uint32_t* out = (uint32_t*)mesh.index_data.data();
+		for (size_t i = 0; i < mesh.indices.size(); ++i) out[i] = (uint32_t)mesh.indices[i];
+	}
+}
+
+
+// Splits the geometry shared by meshes[first, first + count) into their per-material
+// submeshes in a single pass over the vertices. gatherMeshes emits those entries
+// back to back, one per material slot of the same ofbx::Mesh.
+void FBXImporter::postprocessMeshGroup(int first, int count)
+{
+	TRACE_ZONE("FBXImporter::postprocessMeshGroup");
+	ImportMesh* group = &meshes[first];
+	const ofbx::Mesh& mesh = *group->fbx;
+	const ofbx::Geometry* geom = mesh.getGeometry();
+	int vertex_count = geom->getVertexCount();
+	const ofbx::Vec3* vertices = geom->getVertices();
+	const ofbx::Vec3* normals = geom->getNormals();
+	const ofbx::Vec3* tangents = geom->getTangents();
+	const ofbx::Vec4* colors = import_vertex_colors ? geom->getColors() : nullptr;
+	const ofbx::Vec2* uvs = geom->getUVs();
+
+	glm::mat4 transform_matrix = glm::mat4x4(); 
+	glm::mat4 geometry_matrix = glm::make_mat4x4(mesh.getGeometricMatrix().m);
+	glm::mat4 global_transform = glm::make_mat4x4(mesh.getGlobalTransform().m);
+	transform_matrix = global_transform * geometry_matrix;
+	if (center_mesh) transform_matrix[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	std::vector<Skin> skinning;
+	bool is_skinned = isSkinned(mesh);
+	if (is_skinned) fillSkinInfo(&skinning, mesh);
+
+	VertexLayout layout = getSourceLayout(mesh);
+
+	// material index -> position of its submesh in the group, -1 if it has none
+	std::vector<int> buckets(mesh.getMaterialCount(), -1);
+	for (int k = 0; k < count; ++k)
+	{
+		ImportMesh& import_mesh = group[k];
+		assert(import_mesh.fbx == &mesh);
+		assert(import_mesh.material_index >= 0 && import_mesh.material_index < (int)buckets.size());
+		buckets[import_mesh.material_index] = k;
+		// fresh storage from the arena; ImportMesh copies made by gatherMeshes went to the heap
+		import_mesh.layout = layout;
+		import_mesh.vertices = ArenaVector<float>(arena);
+		import_mesh.indices = ArenaVector<int>(arena);
+		import_mesh.index_data = ArenaVector<uint8_t>(arena);
+	}
+
+	// geometry without per-triangle materials goes entirely to the first material
+	const int* materials = geom->getMaterials();
+	auto getBucket = [&](int vertex_idx) {
+		int material_idx = materials ? materials[vertex_idx / 3] : 0;
+		if (material_idx < 0 || material_idx >= (int)buckets.size()) return -1;
+		return buckets[material_idx];
+	};
+
+	// bucket the source vertex indices by material first, so every stream below is read once
+	std::vector<int> bucket_sizes(count, 0);
+	for (int i = 0; i < vertex_count; i += 3)
+	{
+		int bucket = getBucket(i);
+		if (bucket >= 0) bucket_sizes[bucket] += glm::min(3, vertex_count - i);
+	}
+	std::vector<std::vector<int>> sources(count);
+	for (int k = 0; k < count; ++k) sources[k].reserve(bucket_sizes[k]);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		int bucket = getBucket(i);
+		if (bucket >= 0) sources[bucket].push_back(i);
+	}
+
+	// the orientation fix is a signed axis permutation, folding it into the matrix is exact
+	glm::mat4 orientation_matrix(1.0f);
+	orientation_matrix[0] = glm::vec4(fixOrientation(glm::vec3(1, 0, 0)), 0.0f);
+	orientation_matrix[1] = glm::vec4(fixOrientation(glm::vec3(0, 1, 0)), 0.0f);
+	orientation_matrix[2] = glm::vec4(fixOrientation(glm::vec3(0, 0, 1)), 0.0f);
+	glm::mat4 vertex_matrix = orientation_matrix * transform_matrix;
+
+	FillAttributesFn fill_attributes = getFillAttributes(uvs != nullptr, colors != nullptr, is_skinned);
+
+	for (int k = 0; k < count; ++k)
+	{
+		ImportMesh& import_mesh = group[k];
+		const std::vector<int>& src = sources[k];
+		int submesh_vertex_count = (int)src.size();
+		if (submesh_vertex_count == 0)
+		{
+			import_mesh.aabb.setNull();
+			import_mesh.bounding_sphere = BoundingSphere();
+			packIndices(import_mesh);
+			continue;
+		}
+
+		import_mesh.vertices.resize((size_t)submesh_vertex_count * layout.stride / sizeof(float));
+		import_mesh.indices.resize(submesh_vertex_count);
+		fill_attributes(import_mesh, src.data(), uvs, colors, skinning.data());
+
+		// premultiply control points here, so we can have constantly-scaled meshes without scale in bones
+		VertexTransformInput input;
+		input.positions = &vertices->x;
+		input.normals = normals ? &normals->x : nullptr;
+		input.tangents = tangents ? &tangents->x : nullptr;
+		input.remap = src.data();
+		input.count = submesh_vertex_count;
+		VertexTransformOutput output;
+		output.positions = import_mesh.getAttribute(VERTEX_POSITION);
+		output.normals = import_mesh.getAttribute(VERTEX_NORMAL);
+		output.tangents = import_mesh.getAttribute(VERTEX_TANGENT);
+		output.stride = layout.stride;
+		transformVertices(input, glm::value_ptr(vertex_matrix), mesh_scale, &output);
+		import_mesh.aabb = AABB(glm::make_vec3(output.bounds_min), glm::make_vec3(output.bounds_max));
+		// before welding, which renumbers the vertices the extremes refer to
+		import_mesh.bounding_sphere = computeBoundingSphere(output.positions, output.stride, submesh_vertex_count,
+			output.extreme_vertices, bounding_sphere_refine_passes);
+
+		if (weld_vertices) weldVertices(import_mesh, weld_epsilon);
+		packIndices(import_mesh);
+	}
+}
+
+
+void FBXImporter::postprocessMeshes()
+{
+	TRACE_ZONE("FBXImporter::postprocessMeshes");
+	struct Group
+	{
+		int first;
+		int count;
+		int vertex_count;
+		int vertex_size;
+	};
+
+	std::vector<Group> groups;
+	for (int i = 0, n = (int)meshes.size(); i < n;)
+	{
+		int end = i + 1;
+		while (end < n && meshes[end].fbx == meshes[i].fbx) ++end;
+		const ofbx::Mesh& fbx = *meshes[i].fbx;
+		groups.push_back({i, end - i, fbx.getGeometry()->getVertexCount(), (int)getSourceLayout(fbx).stride});
+		i = end;
+	}
+
+	// every group only reads its own geometry and writes its own submeshes, so they can be
+	// processed in any order; hand out the biggest ones first to keep the tail short
+	std::stable_sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) {
+		return a.vertex_count > b.vertex_count;
+	});
+	// size the arena from the source vertex counts so the workers below never have to
+	// grow it: every submesh vertex costs a vertex, an index and at most 4 bytes of index data
+	if (arena)
+	{
+		size_t bytes = 0;
+		for (const Group& group : groups)
+		{
+			bytes += (size_t)group.vertex_count * (group.vertex_size + sizeof(int) + sizeof(uint32_t));
+			bytes += (size_t)group.count * 3 * alignof(float);
+		}
+		arena->reserve(bytes);
+	}
+	parallelFor((int)groups.size(), max_threads, [this, &groups](int job) {
+		postprocessMeshGroup(groups[job].first, groups[job].count);
+	});
+	// for (int mesh_idx = meshes.size() - 1; mesh_idx >= 0; --mesh_idx)
+	// {
+	// 	if (meshes[mesh_idx].indices.empty()) meshes.eraseFast(mesh_idx);
+	// }
+}
+
+
+// Reorders the triangles of a welded mesh for the post-transform cache, optionally sorts
+// them for overdraw, then renumbers the vertices in order of first use, splits the
+// triangles into meshlets and builds the ray cast BVH of the base level.
+void FBXImporter::optimizeMesh(ImportMesh& mesh, VertexCacheStats* before, VertexCacheStats* after) const
+{
+	TRACE_ZONE("FBXImporter::optimizeMesh");
+	int index_count = (int)mesh.indices.size();
+	int vertex_count = mesh.getVertexCount();
+	*before = analyzeVertexCache(mesh.indices.data(), index_count, vertex_count, vertex_cache_size);
+
+	std::vector<int> indices(index_count);
+	optimizeVertexCache(indices.data(), mesh.indices.data(), index_count, vertex_count, vertex_cache_size);
+	if (optimize_overdraw)
+	{
+		optimizeOverdraw(indices.data(), index_count, mesh.getAttribute(VERTEX_POSITION), mesh.layout.stride,
+			vertex_count, vertex_cache_size);
+	}
+
+	std::vector<int> remap(vertex_count);
+	int used_count = optimizeVertexFetchRemap(remap.data(), indices.data(), index_count, vertex_count);
+	const int component_count = (int)(mesh.layout.stride / sizeof(float));
+	std::vector<float> vertices((size_t)component_count * used_count);
+	for (int v = 0; v < vertex_count; ++v)
+	{
+		if (remap[v] < 0) continue;
+		memcpy(&vertices[(size_t)component_count * remap[v]], &mesh.vertices[(size_t)component_count * v], mesh.layout.stride);
+	}
+	for (int& idx : indices) idx = remap[idx];
+
+	// copy back into the mesh's own storage (which may be arena memory) rather than swapping
+	std::copy(vertices.begin(), vertices.end(), mesh.vertices.begin());
+	mesh.vertices.resize(vertices.size());
+	std::copy(indices.begin(), indices.end(), mesh.indices.begin());
+	packIndices(mesh);
+	*after = analyzeVertexCache(mesh.indices.data(), index_count, used_count, vertex_cache_size);
+
+	mesh.meshlets.clear();
+	if (meshlet_max_triangles > 0)
+	{
+		buildMeshlets(&mesh.meshlets, mesh.indices.data(), index_count, mesh.getAttribute(VERTEX_POSITION),
+			mesh.layout.stride, used_count, meshlet_max_vertices, meshlet_max_triangles);
+	}
+	mesh.bvh.clear();
+	if (build_bvh && mesh.lod == 0)
+	{
+		mesh.bvh.build(mesh.indices.data(), index_count, mesh.getAttribute(VERTEX_POSITION), mesh.layout.stride, used_count);
+	}
+}
+
+
+void FBXImporter::optimizeMeshes()
+{
+	TRACE_ZONE("FBXImporter::optimizeMeshes");
+	std::vector<VertexCacheStats> before(meshes.size());
+	std::vector<VertexCacheStats> after(meshes.size());
+	parallelFor((int)meshes.size(), max_threads, [&](int mesh_idx) {
+		if (meshes[mesh_idx].indices.empty()) return;
+		optimizeMesh(meshes[mesh_idx], &before[mesh_idx], &after[mesh_idx]);
+	});
+
+	VertexCacheStats total_before;
+	VertexCacheStats total_after;
+	size_t meshlet_count = 0;
+	size_t meshlet_vertices = 0;
+	size_t bvh_nodes = 0;
+	size_t bvh_blocks = 0;
+	for (int i = 0; i < (int)meshes.size(); ++i)
+	{
+		total_before.misses += before[i].misses;
+		total_before.triangle_count += before[i].triangle_count;
+		total_before.vertex_count += before[i].vertex_count;
+		total_after.misses += after[i].misses;
+		total_after.triangle_count += after[i].triangle_count;
+		total_after.vertex_count += after[i].vertex_count;
+		meshlet_count += meshes[i].meshlets.size();
+		for (const Meshlet& meshlet : meshes[i].meshlets) meshlet_vertices += meshlet.vertex_count;
+		bvh_nodes += meshes[i].bvh.getNodes().size();
+		bvh_blocks += meshes[i].bvh.getBlocks().size();
+	}
+	if (!verbose) return;
+	printf("vertex cache (%d entries): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		vertex_cache_size,
+		total_before.acmr(),
+		total_after.acmr(),
+		total_before.atvr(),
+		total_after.atvr());
+	if (meshlet_count)
+	{
+		printf("meshlets: %zu, %.1f triangles and %.1f vertices on average\n",
+			meshlet_count,
+			(double)total_after.triangle_count / meshlet_count,
+			(double)meshlet_vertices / meshlet_count);
+	}
+	if (bvh_nodes)
+	{
+		printf("ray cast BVH: %zu nodes, %zu triangle blocks, %.1f MB (%s)\n",
+			bvh_nodes,
+			bvh_blocks,
+			(bvh_nodes * sizeof(MeshBVH::Node) + bvh_blocks * sizeof(MeshBVH::TriangleBlock)) / (1024.0 * 1024.0),
+			MeshBVH::getISA());
+	}
+}
+
+
+void FBXImporter::quantizeMeshes()
+{
+	TRACE_ZONE("FBXImporter::quantizeMeshes");
+	parallelFor((int)meshes.size(), max_threads, [this](int mesh_idx) {
+		ImportMesh& mesh = meshes[mesh_idx];
+		VertexQuantizeInput input;
+		input.positions = mesh.getAttribute(VERTEX_POSITION);
+		input.normals = mesh.getAttribute(VERTEX_NORMAL);
+		input.tangents = mesh.getAttribute(VERTEX_TANGENT);
+		input.colors = mesh.getAttribute(VERTEX_COLOR);
+		input.uvs = mesh.getAttribute(VERTEX_UV);
+		input.joints = mesh.getAttribute(VERTEX_JOINTS);
+		input.weights = mesh.getAttribute(VERTEX_WEIGHTS);
+		input.stride = mesh.layout.stride;
+		input.count = mesh.getVertexCount();
+		mesh.quantized_vertices = ArenaVector<uint8_t>(arena);
+		mesh.quantized_vertices.resize(getVertexQuantization(vertex_quantize, mesh.layout.getMask()).layout.stride * input.count);
+		quantizeVertices(input, vertex_quantize, mesh.quantized_vertices.data(), &mesh.quantization, &mesh.quantization_error);
+	});
+
+	QuantizationError total_error;
+	size_t float_bytes = 0;
+	size_t quantized_bytes = 0;
+	for (const ImportMesh& mesh : meshes)
+	{
+		total_error.merge(mesh.quantization_error);
+		float_bytes += mesh.vertices.size() * sizeof(float);
+		quantized_bytes += mesh.quantized_vertices.size();
+	}
+	if (!verbose) return;
+	printf("quantized vertices: %.2f -> %.2f MB, max error: position %g, normal %.3f deg, tangent %.3f deg, uv %g, color %g, weight %g\n",
+		float_bytes / (1024.0 * 1024.0),
+		quantized_bytes / (1024.0 * 1024.0),
+		total_error.position,
+		total_error.normal,
+		total_error.tangent,
+		total_error.uv,
+		total_error.color,
+		total_error.weight);
+}
+
+
+// Builds simplified copies of every base submesh for the levels lods_distances leaves
+// room for: level i + 1 exists when level i has a finite distance. Each level starts
+// from the previous one and stops at its lods_triangle_ratio or lods_max_error, with
+// seams and borders locked; a level that barely removes anything ends the chain. The
+// levels follow their base mesh in meshes. Run it between postprocessMeshes and
+// optimizeMeshes, so the levels get their own vertex cache order.
+void FBXImporter::generateLODs()
+{
+	TRACE_ZONE("FBXImporter::generateLODs");
+	int level_count = 1;
+	while (level_count < 4 && lods_distances[level_count - 1] > 0) ++level_count;
+	if (level_count == 1) return;
+
+	std::vector<std::vector<ImportMesh>> lods(meshes.size());
+	parallelFor((int)meshes.size(), max_threads, [&](int mesh_idx) {
+		const ImportMesh& base = meshes[mesh_idx];
+		if (base.lod != 0 || base.indices.empty()) return;
+		std::vector<int> indices(base.indices.begin(), base.indices.end());
+		if (!weld_vertices)
+		{
+			// every corner of an unwelded mesh has its own vertex, so the simplifier would lock
+			// them all as seams and borders; identical copies are interchangeable, use the first
+			std::vector<int> first = findFirstEqualVertices(base.vertices.data(), base.getVertexCount(),
+				(int)(base.layout.stride / sizeof(float)), 0.0f);
+			for (int& idx : indices) idx = first[idx];
+		}
+		int index_count = (int)indices.size();
+		float diagonal = glm::length(base.aabb.getDiagonal());
+		for (int level = 1; level < level_count; ++level)
+		{
+			int target_index_count = (int)(base.indices.size() / 3 * lods_triangle_ratio[level]) * 3;
+			int count = simplifyMesh(indices.data(), indices.data(), index_count, base.getAttribute(VERTEX_POSITION),
+				base.layout.stride, base.getVertexCount(), target_index_count, lods_max_error[level] * diagonal, nullptr);
+			if (count == 0 || count > index_count * 9 / 10) break;
+			index_count = count;
+			lods[mesh_idx].push_back(makeLODMesh(base, indices.data(), index_count, level, bounding_sphere_refine_passes, arena));
+		}
+	});
+
+	size_t base_triangles = 0;
+	size_t lod_triangles[4] = {};
+	int lod_meshes[4] = {};
+	std::vector<ImportMesh> result;
+	result.reserve(meshes.size() * level_count);
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		base_triangles += meshes[i].indices.size() / 3;
+		result.push_back(std::move(meshes[i]));
+		for (ImportMesh& lod : lods[i])
+		{
+			lod_triangles[lod.lod] += lod.indices.size() / 3;
+			++lod_meshes[lod.lod];
+			result.push_back(std::move(lod));
+		}
+	}
+	meshes.swap(result);
+
+	if (!verbose) return;
+	printf("LODs: %zu base triangles", base_triangles);
+	for (int level = 1; level < level_count; ++level)
+	{
+		printf(", level %d: %zu triangles in %d meshes", level, lod_triangles[level], lod_meshes[level]);
+	}
+	printf("\n");
+}
+
+
+void FBXImporter::gatherMeshes(ofbx::IScene* scene)
+{
+	TRACE_ZONE("FBXImporter::gatherMeshes");
+	int min_lod = 2;
+	int c = scene->getMeshCount();
+	int start_index = meshes.size();
+	for (int i = 0; i < c; ++i)
+	{
+		const ofbx::Mesh* fbx_mesh = (const ofbx::Mesh*)scene->getMesh(i);
+		if (fbx_mesh->getGeometry()->getVertexCount() == 0) continue;
+		for (int j = 0; j < fbx_mesh->getMaterialCount(); ++j)
+		{
+			ImportMesh mesh;
+			mesh.fbx = fbx_mesh;
+			mesh.fbx_mat = fbx_mesh->getMaterial(j);
+			mesh.material_index = j;
+			if (mesh.fbx_mat) mesh.material_name = mesh.fbx_mat->name;
+			//esh.lod = detectMeshLOD(mesh);
+			//min_lod = min(min_lod, mesh.lod);
+			meshes.push_back(mesh);
+		}
+	}
+	// the skinned meshes postprocessMeshes is about to process need their joint indices
+	gatherBones();
+	if (min_lod != 1) return;
+	for (int i = start_index, n = meshes.size(); i < n; ++i)
+	{
+		--meshes[i].lod;
+	}
+}
+
+
+// Every stack of the scene, to be sampled by importAnimations once the bones are gathered.
+void FBXImporter::gatherAnimations(const ofbx::IScene* scene)
+{
+	TRACE_ZONE("FBXImporter::gatherAnimations");
+	for (int i = 0, c = scene->getAnimationStackCount(); i < c; ++i)
+	{
+		ImportAnimation animation;
+		animation.fbx = scene->getAnimationStack(i);
+		animation.scene = scene;
+		animation.output_filename = getStackName(*animation.fbx);
+		animations.push_back(animation);
+	}
+}
+
+
+// The local transform of a bone with the given curve values, scaled and oriented like the meshes.
+void FBXImporter::getBoneLocalTransform(const ofbx::Object& bone, const ofbx::Vec3& translation, const ofbx::Vec3& rotation,
+	glm::vec3* pos, glm::quat* rot) const
+{
+	// evalLocal adds the pivots and pre/post rotations the curves leave out
+	ofbx::Matrix mtx = bone.evalLocal(translation, rotation);
+	glm::vec3 local_pos = getTranslation(mtx) * mesh_scale;
+	glm::quat local_rot = getUnscaledRotation(mtx);
+	// root bones are relative to the scene, the others to their parent bone
+	bool is_root = getBoneIndex(bone.getParent()) < 0;
+	*pos = is_root ? fixRootOrientation(local_pos) : fixOrientation(local_pos);
+	*rot = is_root ? fixRootOrientation(local_rot) : fixOrientation(local_rot);
+}
+
+
+// Samples the local transform of bones[bone_idx] once per frame and keeps only the keys
+// needed to stay within position_error and rotation_error. Leaves track->bone at -1 when
+// no curve of the layer animates the bone.
+void FBXImporter::sampleBoneTrack(const ofbx::AnimationLayer& layer, int bone_idx, double from_time,
+	double sample_period, int frame_count, float frame_rate, BoneTrack* track) const
+{
+	const ofbx::Object& bone = *bones[bone_idx];
+	const ofbx::AnimationCurveNode* translation_node = layer.getCurveNode(bone, "Lcl Translation");
+	const ofbx::AnimationCurveNode* rotation_node = layer.getCurveNode(bone, "Lcl Rotation");
+	if (!translation_node && !rotation_node) return;
+	track->bone = bone_idx;
+
+	std::vector<glm::vec3> positions(frame_count);
+	std::vector<glm::quat> rotations(frame_count);
+	for (int f = 0; f < frame_count; ++f)
+	{
+		double time = from_time + f * sample_period;
+		ofbx::Vec3 local_pos = translation_node ? translation_node->getNodeLocalTransform(time) : bone.getLocalTranslation();
+		ofbx::Vec3 local_rot = rotation_node ? rotation_node->getNodeLocalTransform(time) : bone.getLocalRotation();
+		getBoneLocalTransform(bone, local_pos, local_rot, &positions[f], &rotations[f]);
+	}
+
+	std::vector<int> keys;
+	reduceKeys(positions.data(), frame_count, position_error, &keys);
+	track->translations.reserve(keys.size());
+	for (int f : keys)
+	{
+		TranslationKey key;
+		key.pos = positions[f];
+		key.time = f / frame_rate;
+		key.frame = (uint16_t)f;
+		track->translations.push_back(key);
+	}
+
+	keys.clear();
+	reduceKeys(rotations.data(), frame_count, rotation_error, &keys);
+	track->rotations.reserve(keys.size());
+	for (int f : keys)
+	{
+		PackedRotationKey key;
+		key.rot = packQuat(rotations[f]);
+		key.frame = (uint16_t)f;
+		track->rotations.push_back(key);
+	}
+}
+
+
+// Turns every imported animation into clips, one per split or one for the whole take,
+// with a track per animated bone. Each bone is sampled at the scene frame rate, then the
+// keys that linear interpolation reproduces within the error bounds are dropped and the
+// rotations are packed to 48 bits. Needs the bones, run it after gatherMeshes.
+void FBXImporter::importAnimations()
+{
+	TRACE_ZONE("FBXImporter::importAnimations");
+	struct Job
+	{
+		AnimationClip* clip;
+		const ofbx::AnimationLayer* layer;
+		double from_time;
+		double sample_period;
+		int bone;
+	};
+	std::vector<Job> jobs;
+	for (ImportAnimation& animation : animations)
+	{
+		animation.clips.clear();
+		if (!animation.import || !animation.fbx || bones.empty()) continue;
+		const ofbx::AnimationLayer* layer = animation.fbx->getLayer(0);
+		const ofbx::TakeInfo* take = getTakeInfo(*animation.scene, *animation.fbx);
+		if (!layer || !take)
+		{
+			printf("animation %s: no %s, skipped\n", animation.output_filename.c_str(), layer ? "take info" : "layer");
+			continue;
+		}
+
+		float fbx_frame_rate = animation.scene->getSceneFrameRate();
+		if (fbx_frame_rate <= 0) fbx_frame_rate = 30; // custom time mode
+		// both ends of the take are frames
+		int take_frames = (int)((take->local_time_to - take->local_time_from) * fbx_frame_rate + 0.5) + 1;
+
+		std::vector<ImportAnimation::Split> splits = animation.splits;
+		if (splits.empty())
+		{
+			ImportAnimation::Split whole;
+			whole.to_frame = take_frames - 1;
+			whole.name = animation.output_filename;
+			splits.push_back(whole);
+		}
+
+		animation.clips.resize(splits.size());
+		for (size_t i = 0; i < splits.size(); ++i)
+		{
+			int from = std::max(0, std::min(splits[i].from_frame, take_frames - 1));
+			int to = std::max(from, std::min(splits[i].to_frame, take_frames - 1));
+			AnimationClip& clip = animation.clips[i];
+			clip.name = splits[i].name;
+			clip.frame_rate = fbx_frame_rate / time_scale;
+			clip.frame_count = to - from + 1;
+			if (clip.frame_count > 0x10000)
+			{
+				printf("animation %s: %d frames, the keys address the first 65536\n", clip.name.c_str(), clip.frame_count);
+				clip.frame_count = 0x10000;
+			}
+			clip.tracks.resize(bones.size());
+			for (int bone = 0; bone < (int)bones.size(); ++bone)
+			{
+				jobs.push_back({&clip, layer, take->local_time_from + from / (double)fbx_frame_rate, 1.0 / fbx_frame_rate, bone});
+			}
+		}
+	}
+
+	// every job writes its own track, clips and tracks are sized above
+	parallelFor((int)jobs.size(), max_threads, [this, &jobs](int job_idx) {
+		const Job& job = jobs[job_idx];
+		sampleBoneTrack(*job.layer, job.bone, job.from_time, job.sample_period, job.clip->frame_count,
+			job.clip->frame_rate, &job.clip->tracks[job.bone]);
+	});
+
+	int clip_count = 0;
+	int track_count = 0;
+	size_t sampled_bytes = 0;
+	size_t key_bytes = 0;
+	for (ImportAnimation& animation : animations)
+	{
+		for (AnimationClip& clip : animation.clips)
+		{
+			clip.tracks.erase(std::remove_if(clip.tracks.begin(), clip.tracks.end(), [](const BoneTrack& track) { return track.bone < 0; }),
+				clip.tracks.end());
+			++clip_count;
+			track_count += (int)clip.tracks.size();
+			for (const BoneTrack& track : clip.tracks)
+			{
+				sampled_bytes += clip.frame_count * (sizeof(TranslationKey) + sizeof(RotationKey));
+				key_bytes += track.translations.size() * sizeof(TranslationKey) + track.rotations.size() * sizeof(PackedRotationKey);
+			}
+		}
+	}
+	if (!verbose) return;
+	printf("animations: %d clips, %d tracks, keys %.2f -> %.2f MB\n",
+		clip_count,
+		track_count,
+		sampled_bytes / (1024.0 * 1024.0),
+		key_bytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,66 @@
+#include "file-source.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#define PSAPI_VERSION 2 // K32GetProcessMemoryInfo lives in kernel32, no psapi.lib needed
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+bool FileSource::open(const char* path, Mode mode)
+{
+	close();
+	if (mode != Mode::BUFFERED)
+	{
+		if (mapped.open(path))
+		{
+			mapped.adviseSequential();
+			return true;
+		}
+		if (mode == Mode::MAPPED) return false;
+	}
+
+	FILE* fp = fopen(path, "rb");
+	if (!fp) return false;
+	bool ok = fseek(fp, 0, SEEK_END) == 0;
+	long file_size = ok ? ftell(fp) : -1;
+	ok = file_size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+	if (ok)
+	{
+		buffer.resize((size_t)file_size);
+		ok = fread(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+	}
+	fclose(fp);
+	if (!ok) close();
+	return ok;
+}
+
+
+void FileSource::close()
+{
+	mapped.close();
+	std::vector<uint8_t>().swap(buffer);
+}
+
+
+size_t getPeakResidentMemory()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	#if defined(__APPLE__)
+		return (size_t)usage.ru_maxrss; // bytes
+	#else
+		return (size_t)usage.ru_maxrss * 1024; // kilobytes
+	#endif
+#endif
+}
@@ -0,0 +1,23 @@
+#include "frustum.hpp"
+
+// Gribb and Hartmann: a point is inside when -w <= x, y, z <= w in clip space, so
+// each plane is the last row of the matrix plus or minus one of the others.
+Frustum makeFrustum(const glm::mat4& view_projection)
+{
+	const glm::mat4& m = view_projection;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i) rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	Frustum frustum;
+	for (int i = 0; i < 3; ++i)
+	{
+		frustum.planes[i * 2] = rows[3] + rows[i];
+		frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (glm::vec4& plane : frustum.planes)
+	{
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0) plane /= length;
+	}
+	return frustum;
+}
@@ -2,6 +2,12 @@
 #include "glm-abb.hpp"
 #include <glm/gtx/component_wise.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "simd.hpp"
+
 namespace CPM_GLM_AABB_NS {
 
 AABB::AABB()
@@ -201,4 +207,257 @@ bool AABB::isSimilarTo(const AABB& b, glm::float_t diff) const
   return true;
 }
 
+namespace {
+
+// One register of boxes and a comparison mask over it, helpers from simd.hpp.
+using namespace simd;
+// a size_t like the counts padded to it
+const size_t LANES = simd::LANES;
+
+inline size_t padToLanes(size_t count)
+{
+  return (count + LANES - 1) / LANES * LANES;
+}
+
+// 32 is a multiple of every LANES, so a register never straddles two words
+inline void setBits(uint32_t* result, size_t first, uint32_t laneBits)
+{
+  result[first / 32] |= laneBits << (first % 32);
+}
+
+// bits of the padding lanes past the last box are whatever the kernel computed
+inline void clearPadding(uint32_t* result, size_t count)
+{
+  if (count % 32)
+    result[count / 32] &= (1u << (count % 32)) - 1;
+}
+
+} // anonymous namespace
+
+void AABBArray::clear()
+{
+  resize(0);
+}
+
+void AABBArray::reserve(size_t count)
+{
+  size_t padded = padToLanes(count);
+  mMinX.reserve(padded); mMinY.reserve(padded); mMinZ.reserve(padded);
+  mMaxX.reserve(padded); mMaxY.reserve(padded); mMaxZ.reserve(padded);
+}
+
+void AABBArray::resize(size_t count)
+{
+  size_t padded = padToLanes(count);
+  // new boxes, padding included, start out null
+  mMinX.resize(padded, INFINITY); mMinY.resize(padded, INFINITY); mMinZ.resize(padded, INFINITY);
+  mMaxX.resize(padded, -INFINITY); mMaxY.resize(padded, -INFINITY); mMaxZ.resize(padded, -INFINITY);
+  for (size_t i = count; i < padded; ++i)
+  {
+    mMinX[i] = mMinY[i] = mMinZ[i] = INFINITY;
+    mMaxX[i] = mMaxY[i] = mMaxZ[i] = -INFINITY;
+  }
+  mCount = count;
+}
+
+void AABBArray::push_back(const AABB& aabb)
+{
+  resize(mCount + 1);
+  set(mCount - 1, aabb);
+}
+
+void AABBArray::set(size_t index, const AABB& aabb)
+{
+  assert(index < mCount);
+  if (aabb.isNull())
+  {
+    mMinX[index] = mMinY[index] = mMinZ[index] = INFINITY;
+    mMaxX[index] = mMaxY[index] = mMaxZ[index] = -INFINITY;
+    return;
+  }
+  mMinX[index] = aabb.mMin.x; mMinY[index] = aabb.mMin.y; mMinZ[index] = aabb.mMin.z;
+  mMaxX[index] = aabb.mMax.x; mMaxY[index] = aabb.mMax.y; mMaxZ[index] = aabb.mMax.z;
+}
+
+AABB AABBArray::get(size_t index) const
+{
+  assert(index < mCount);
+  if (mMinX[index] > mMaxX[index])
+    return AABB();
+  return AABB(glm::vec3(mMinX[index], mMinY[index], mMinZ[index]),
+              glm::vec3(mMaxX[index], mMaxY[index], mMaxZ[index]));
+}
+
+void AABBArray::overlaps(const AABB& bb, uint32_t* result) const
+{
+  std::fill(result, result + getMaskSize(), 0u);
+  if (bb.isNull())
+    return;
+
+  Lanes minX = splat(bb.mMin.x), minY = splat(bb.mMin.y), minZ = splat(bb.mMin.z);
+  Lanes maxX = splat(bb.mMax.x), maxY = splat(bb.mMax.y), maxZ = splat(bb.mMax.z);
+  for (size_t i = 0; i < mCount; i += LANES)
+  {
+    // null boxes have min = +inf and max = -inf, which fails both sides
+    Mask m = maskAnd(lessEqual(load(&mMinX[i]), maxX), lessEqual(minX, load(&mMaxX[i])));
+    m = maskAnd(m, maskAnd(lessEqual(load(&mMinY[i]), maxY), lessEqual(minY, load(&mMaxY[i]))));
+    m = maskAnd(m, maskAnd(lessEqual(load(&mMinZ[i]), maxZ), lessEqual(minZ, load(&mMaxZ[i]))));
+    setBits(result, i, bits(m));
+  }
+  clearPadding(result, mCount);
+}
+
+void AABBArray::intersect(const AABB& bb, uint32_t* intersecting, uint32_t* inside) const
+{
+  std::fill(intersecting, intersecting + getMaskSize(), 0u);
+  std::fill(inside, inside + getMaskSize(), 0u);
+  if (bb.isNull())
+    return;
+
+  Lanes minX = splat(bb.mMin.x), minY = splat(bb.mMin.y), minZ = splat(bb.mMin.z);
+  Lanes maxX = splat(bb.mMax.x), maxY = splat(bb.mMax.y), maxZ = splat(bb.mMax.z);
+  for (size_t i = 0; i < mCount; i += LANES)
+  {
+    Lanes boxMinX = load(&mMinX[i]), boxMinY = load(&mMinY[i]), boxMinZ = load(&mMinZ[i]);
+    Lanes boxMaxX = load(&mMaxX[i]), boxMaxY = load(&mMaxY[i]), boxMaxZ = load(&mMaxZ[i]);
+    Mask hit = maskAnd(lessEqual(boxMinX, maxX), lessEqual(minX, boxMaxX));
+    hit = maskAnd(hit, maskAnd(lessEqual(boxMinY, maxY), lessEqual(minY, boxMaxY)));
+    hit = maskAnd(hit, maskAnd(lessEqual(boxMinZ, maxZ), lessEqual(minZ, boxMaxZ)));
+    // a null box would pass the containment test on its own, it never intersects
+    Mask in = maskAnd(lessEqual(minX, boxMinX), lessEqual(boxMaxX, maxX));
+    in = maskAnd(in, maskAnd(lessEqual(minY, boxMinY), lessEqual(boxMaxY, maxY)));
+    in = maskAnd(in, maskAnd(lessEqual(minZ, boxMinZ), lessEqual(boxMaxZ, maxZ)));
+    setBits(intersecting, i, bits(hit));
+    setBits(inside, i, bits(maskAnd(in, hit)));
+  }
+  clearPadding(intersecting, mCount);
+  clearPadding(inside, mCount);
+}
+
+void AABBArray::classify(const glm::vec4* planes, int planeCount, uint32_t* outside,
+                         uint32_t* inside) const
+{
+  std::fill(outside, outside + getMaskSize(), 0u);
+  std::fill(inside, inside + getMaskSize(), 0u);
+
+  // per plane, the corner furthest along its normal and the one furthest against it;
+  // the normal is the same for every box, so that is a choice of arrays, not of lanes
+  const int maxPlanes = 8;
+  assert(planeCount <= maxPlanes);
+  const float* farX[maxPlanes]; const float* farY[maxPlanes]; const float* farZ[maxPlanes];
+  const float* nearX[maxPlanes]; const float* nearY[maxPlanes]; const float* nearZ[maxPlanes];
+  for (int p = 0; p < planeCount; ++p)
+  {
+    farX[p] = planes[p].x >= 0 ? mMaxX.data() : mMinX.data();
+    farY[p] = planes[p].y >= 0 ? mMaxY.data() : mMinY.data();
+    farZ[p] = planes[p].z >= 0 ? mMaxZ.data() : mMinZ.data();
+    nearX[p] = planes[p].x >= 0 ? mMinX.data() : mMaxX.data();
+    nearY[p] = planes[p].y >= 0 ? mMinY.data() : mMaxY.data();
+    nearZ[p] = planes[p].z >= 0 ? mMinZ.data() : mMaxZ.data();
+  }
+
+  Lanes zero = splat(0.0f);
+  for (size_t i = 0; i < mCount; i += LANES)
+  {
+    // infinities times zero normal components give NaNs, null boxes are sorted out apart
+    Mask valid = lessEqual(load(&mMinX[i]), load(&mMaxX[i]));
+    Mask out = maskNone();
+    Mask in = maskAll();
+    for (int p = 0; p < planeCount; ++p)
+    {
+      Lanes nx = splat(planes[p].x), ny = splat(planes[p].y), nz = splat(planes[p].z);
+      Lanes d = splat(planes[p].w);
+      // summed in the order of dot(normal, corner) + d, so boxes touching a plane are
+      // classified exactly as by the scalar test
+      Lanes farDistance = add(add(add(mul(nx, load(farX[p] + i)), mul(ny, load(farY[p] + i))),
+                                  mul(nz, load(farZ[p] + i))), d);
+      Lanes nearDistance = add(add(add(mul(nx, load(nearX[p] + i)), mul(ny, load(nearY[p] + i))),
+                                   mul(nz, load(nearZ[p] + i))), d);
+      out = maskOr(out, less(farDistance, zero));
+      in = maskAnd(in, lessEqual(zero, nearDistance));
+    }
+    setBits(outside, i, bits(maskOr(out, maskAndNot(maskAll(), valid))));
+    setBits(inside, i, bits(maskAnd(in, valid)));
+  }
+  clearPadding(outside, mCount);
+  clearPadding(inside, mCount);
+}
+
+void AABBArray::extend(const AABBArray& other)
+{
+  assert(other.mCount == mCount);
+  for (size_t i = 0; i < mCount; i += LANES)
+  {
+    store(&mMinX[i], min(load(&mMinX[i]), load(&other.mMinX[i])));
+    store(&mMinY[i], min(load(&mMinY[i]), load(&other.mMinY[i])));
+    store(&mMinZ[i], min(load(&mMinZ[i]), load(&other.mMinZ[i])));
+    store(&mMaxX[i], max(load(&mMaxX[i]), load(&other.mMaxX[i])));
+    store(&mMaxY[i], max(load(&mMaxY[i]), load(&other.mMaxY[i])));
+    store(&mMaxZ[i], max(load(&mMaxZ[i]), load(&other.mMaxZ[i])));
+  }
+}
+
+AABB AABBArray::getBounds() const
+{
+  // the padding is null, +inf and -inf leave the reduction alone
+  Lanes minX = splat(INFINITY), minY = splat(INFINITY), minZ = splat(INFINITY);
+  Lanes maxX = splat(-INFINITY), maxY = splat(-INFINITY), maxZ = splat(-INFINITY);
+  for (size_t i = 0; i < mCount; i += LANES)
+  {
+    minX = min(minX, load(&mMinX[i])); minY = min(minY, load(&mMinY[i])); minZ = min(minZ, load(&mMinZ[i]));
+    maxX = max(maxX, load(&mMaxX[i])); maxY = max(maxY, load(&mMaxY[i])); maxZ = max(maxZ, load(&mMaxZ[i]));
+  }
+  glm::vec3 boundsMin(reduceMin(minX), reduceMin(minY), reduceMin(minZ));
+  glm::vec3 boundsMax(reduceMax(maxX), reduceMax(maxY), reduceMax(maxZ));
+  if (boundsMin.x > boundsMax.x)
+    return AABB();
+  return AABB(boundsMin, boundsMax);
+}
+
+// Arvo: the new center is the transformed center, the new half extent along each
+// axis adds up the old half extents scaled by the absolute matrix entries.
+void AABBArray::transform(const glm::mat4& matrix, AABBArray* result) const
+{
+  if (result != this)
+    result->resize(mCount);
+
+  Lanes m[3][4];
+  Lanes a[3][3];
+  for (int row = 0; row < 3; ++row)
+  {
+    for (int col = 0; col < 4; ++col)
+      m[row][col] = splat(matrix[col][row]);
+    for (int col = 0; col < 3; ++col)
+      a[row][col] = splat(std::fabs(matrix[col][row]));
+  }
+  Lanes half = splat(0.5f);
+  Lanes inf = splat(INFINITY);
+  Lanes negInf = splat(-INFINITY);
+  for (size_t i = 0; i < mCount; i += LANES)
+  {
+    Lanes minX = load(&mMinX[i]), minY = load(&mMinY[i]), minZ = load(&mMinZ[i]);
+    Lanes maxX = load(&mMaxX[i]), maxY = load(&mMaxY[i]), maxZ = load(&mMaxZ[i]);
+    Mask valid = lessEqual(minX, maxX);
+    Lanes c[3] = {mul(add(minX, maxX), half), mul(add(minY, maxY), half), mul(add(minZ, maxZ), half)};
+    Lanes e[3] = {mul(sub(maxX, minX), half), mul(sub(maxY, minY), half), mul(sub(maxZ, minZ), half)};
+
+    Lanes outMin[3], outMax[3];
+    for (int row = 0; row < 3; ++row)
+    {
+      Lanes center = add(add(mul(m[row][0], c[0]), mul(m[row][1], c[1])), add(mul(m[row][2], c[2]), m[row][3]));
+      Lanes extent = add(add(mul(a[row][0], e[0]), mul(a[row][1], e[1])), mul(a[row][2], e[2]));
+      // null boxes turn into NaNs above, they stay null
+      outMin[row] = select(valid, sub(center, extent), inf);
+      outMax[row] = select(valid, add(center, extent), negInf);
+    }
+    store(&result->mMinX[i], outMin[0]); store(&result->mMinY[i], outMin[1]); store(&result->mMinZ[i], outMin[2]);
+    store(&result->mMaxX[i], outMax[0]); store(&result->mMaxY[i], outMax[1]); store(&result->mMaxZ[i], outMax[2]);
+  }
+}
+
+const char* AABBArray::getISA()
+{
+  return ISA_NAME;
+}
+
 } // namespace CPM_GLM_AABB_NS
@@ -0,0 +1,149 @@
+#include "keyframe-compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// no component but the largest of a unit quaternion exceeds this
+const float SMALLEST_THREE_RANGE = 0.70710678f;
+const float SMALLEST_THREE_MAX = 32767.0f; // 15 bits
+// longest span reduce grows, in samples: growing one rechecks all the samples inside it,
+// so a track costs at most this many error tests per sample; a nearly linear one gets
+// a key every MAX_SPAN samples it would otherwise not need, 2 s at 30 fps
+const int MAX_SPAN = 64;
+
+inline float positionError(const glm::vec3& a, const glm::vec3& b, float t, const glm::vec3& sample)
+{
+	return glm::length(a + (b - a) * t - sample);
+}
+
+inline float rotationError(const glm::quat& a, const glm::quat& b, float t, const glm::quat& sample)
+{
+	return getRotationAngle(nlerpShortest(a, b, t), sample);
+}
+
+// Greedy: from the last key, grow the span as long as every sample inside it is within
+// max_error of the interpolation between its ends, up to MAX_SPAN, then start the next
+// span at its end.
+template <typename T, typename ErrorFn>
+void reduce(const T* samples, int count, float max_error, ErrorFn error, std::vector<int>* keys)
+{
+	if (count <= 0) return;
+	keys->push_back(0);
+	bool constant = true;
+	for (int i = 1; i < count && constant; ++i)
+	{
+		constant = error(samples[0], samples[0], 0.0f, samples[i]) <= max_error;
+	}
+	if (constant) return;
+
+	int start = 0;
+	while (start < count - 1)
+	{
+		int end = start + 1;
+		while (end + 1 < count && end + 1 - start <= MAX_SPAN)
+		{
+			int candidate = end + 1;
+			bool fits = true;
+			for (int i = start + 1; i < candidate && fits; ++i)
+			{
+				float t = (float)(i - start) / (candidate - start);
+				fits = error(samples[start], samples[candidate], t, samples[i]) <= max_error;
+			}
+			if (!fits) break;
+			end = candidate;
+		}
+		keys->push_back(end);
+		start = end;
+	}
+}
+
+} // anonymous namespace
+
+
+PackedQuat packQuat(const glm::quat& q)
+{
+	float components[4] = {q.x, q.y, q.z, q.w};
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+	{
+		if (fabsf(components[i]) > fabsf(components[largest])) largest = i;
+	}
+	// -q is the same rotation, flip it so the dropped component is positive
+	float sign = components[largest] < 0 ? -1.0f : 1.0f;
+	float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	float scale = length > 0 ? sign / length : 1.0f;
+
+	uint64_t bits = (uint64_t)largest << 45;
+	int shift = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		float v = std::max(-SMALLEST_THREE_RANGE, std::min(SMALLEST_THREE_RANGE, components[i] * scale));
+		uint64_t quantized = (uint64_t)lrintf((v + SMALLEST_THREE_RANGE) / (2 * SMALLEST_THREE_RANGE) * SMALLEST_THREE_MAX);
+		bits |= quantized << shift;
+		shift += 15;
+	}
+
+	PackedQuat packed;
+	packed.data[0] = (uint16_t)bits;
+	packed.data[1] = (uint16_t)(bits >> 16);
+	packed.data[2] = (uint16_t)(bits >> 32);
+	return packed;
+}
+
+
+glm::quat unpackQuat(const PackedQuat& packed)
+{
+	uint64_t bits = (uint64_t)packed.data[0] | ((uint64_t)packed.data[1] << 16) | ((uint64_t)packed.data[2] << 32);
+	int largest = (int)(bits >> 45) & 3;
+
+	float components[4];
+	float sum = 0;
+	int shift = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		float v = ((bits >> shift) & 0x7fff) / SMALLEST_THREE_MAX * (2 * SMALLEST_THREE_RANGE) - SMALLEST_THREE_RANGE;
+		components[i] = v;
+		sum += v * v;
+		shift += 15;
+	}
+	components[largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+	return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+
+// the rotation angle is twice the angle between a and the closer of +-b on the unit
+// 4-sphere; taken from the chords since acos of the dot product loses small angles
+float getRotationAngle(const glm::quat& a, const glm::quat& b)
+{
+	float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1.0f : 1.0f;
+	float dx = a.x - sign * b.x, dy = a.y - sign * b.y, dz = a.z - sign * b.z, dw = a.w - sign * b.w;
+	float sx = a.x + sign * b.x, sy = a.y + sign * b.y, sz = a.z + sign * b.z, sw = a.w + sign * b.w;
+	return 4.0f * atan2f(sqrtf(dx * dx + dy * dy + dz * dz + dw * dw), sqrtf(sx * sx + sy * sy + sz * sz + sw * sw));
+}
+
+
+glm::quat nlerpShortest(const glm::quat& a, const glm::quat& b, float t)
+{
+	float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	float tb = d < 0 ? -t : t;
+	float ta = 1.0f - t;
+	glm::quat r(ta * a.w + tb * b.w, ta * a.x + tb * b.x, ta * a.y + tb * b.y, ta * a.z + tb * b.z);
+	float length = sqrtf(r.x * r.x + r.y * r.y + r.z * r.z + r.w * r.w);
+	return length > 0 ? glm::quat(r.w / length, r.x / length, r.y / length, r.z / length) : a;
+}
+
+
+void reduceKeys(const glm::vec3* samples, int count, float max_error, std::vector<int>* keys)
+{
+	reduce(samples, count, max_error, positionError, keys);
+}
+
+
+void reduceKeys(const glm::quat* samples, int count, float max_angle, std::vector<int>* keys)
+{
+	reduce(samples, count, max_angle, rotationError, keys);
+}
@@ -0,0 +1,115 @@
+#include "mapped-file.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path)
+{
+	close();
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	file_handle = file;
+	is_open = true;
+	if (size.QuadPart == 0) return true;
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		if (mapping) CloseHandle(mapping);
+		close();
+		return false;
+	}
+	mapping_handle = mapping;
+	mapped = (const uint8_t*)view;
+	mapped_size = (size_t)size.QuadPart;
+	return true;
+}
+
+
+void MappedFile::close()
+{
+	if (mapped) UnmapViewOfFile(mapped);
+	if (mapping_handle) CloseHandle((HANDLE)mapping_handle);
+	if (file_handle) CloseHandle((HANDLE)file_handle);
+	mapped = nullptr;
+	mapped_size = 0;
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+	is_open = false;
+}
+
+
+void MappedFile::adviseSequential() const
+{
+	// no portable equivalent before PrefetchVirtualMemory, the file cache reads ahead on its own
+}
+
+#else
+
+bool MappedFile::open(const char* path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	// the mapping keeps the file referenced, the descriptor is not needed past this point
+	void* view = nullptr;
+	if (st.st_size > 0)
+	{
+		view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			::close(fd);
+			return false;
+		}
+	}
+	::close(fd);
+
+	mapped = (const uint8_t*)view;
+	mapped_size = (size_t)st.st_size;
+	is_open = true;
+	return true;
+}
+
+
+void MappedFile::close()
+{
+	if (mapped) munmap((void*)mapped, mapped_size);
+	mapped = nullptr;
+	mapped_size = 0;
+	is_open = false;
+}
+
+
+void MappedFile::adviseSequential() const
+{
+	if (mapped) posix_madvise((void*)mapped, mapped_size, POSIX_MADV_SEQUENTIAL);
+}
+
+#endif
@@ -0,0 +1,694 @@
+#include "mesh-bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+namespace {
+
+typedef MeshBVH::Node Node;
+typedef MeshBVH::TriangleBlock TriangleBlock;
+
+const int BIN_COUNT = 16;
+const int WIDTH = MeshBVH::WIDTH;
+// a leaf is one triangle block, tested at once, so splitting it further gains nothing
+const int MAX_LEAF_SIZE = WIDTH;
+// past this depth nodes split at the triangle median, which halves them every level,
+// so the trees stay below MAX_DEPTH
+const int SAH_MAX_DEPTH = 32;
+const int MAX_DEPTH = 64;
+// a node pushes all the children it passes but the one walked next
+const int MAX_STACK = (WIDTH - 1) * MAX_DEPTH;
+// the exit distances of the slab test grow by a few rounding errors, so a ray through
+// the edge of a box still reaches the triangles on it (Ize, "Robust BVH Ray Traversal", 2013)
+const float EXIT_SCALE = 1.0f + 8 * 1.1920929e-7f;
+// stands in for the infinite inverse of a zero direction component: a box this tilt would
+// change is 1e-30 away
+const float MAX_INVERSE = 1e30f;
+// rays per job of the batched raycast
+const int RAYS_PER_JOB = 256;
+
+// WIDTH lanes, one per child of a node or triangle of a block: as many simd.hpp registers
+// as that takes, one with AVX2, two with SSE2. Masks are bits, lane 0 lowest.
+const int PARTS = WIDTH / simd::LANES;
+static_assert(WIDTH % simd::LANES == 0, "nodes and blocks are whole registers");
+
+struct Lanes
+{
+	simd::Lanes part[PARTS];
+};
+inline Lanes splat(float f)
+{
+	Lanes r;
+	for (int i = 0; i < PARTS; ++i) r.part[i] = simd::splat(f);
+	return r;
+}
+inline Lanes load(const float* p)
+{
+	Lanes r;
+	for (int i = 0; i < PARTS; ++i) r.part[i] = simd::load(p + i * simd::LANES);
+	return r;
+}
+inline void store(float* p, Lanes v)
+{
+	for (int i = 0; i < PARTS; ++i) simd::store(p + i * simd::LANES, v.part[i]);
+}
+template <typename Op>
+inline Lanes apply(Lanes a, Lanes b, Op op)
+{
+	for (int i = 0; i < PARTS; ++i) a.part[i] = op(a.part[i], b.part[i]);
+	return a;
+}
+inline Lanes add(Lanes a, Lanes b) { return apply(a, b, [](simd::Lanes x, simd::Lanes y) { return simd::add(x, y); }); }
+inline Lanes sub(Lanes a, Lanes b) { return apply(a, b, [](simd::Lanes x, simd::Lanes y) { return simd::sub(x, y); }); }
+inline Lanes mul(Lanes a, Lanes b) { return apply(a, b, [](simd::Lanes x, simd::Lanes y) { return simd::mul(x, y); }); }
+inline Lanes div(Lanes a, Lanes b) { return apply(a, b, [](simd::Lanes x, simd::Lanes y) { return simd::div(x, y); }); }
+inline Lanes min(Lanes a, Lanes b) { return apply(a, b, [](simd::Lanes x, simd::Lanes y) { return simd::min(x, y); }); }
+inline Lanes max(Lanes a, Lanes b) { return apply(a, b, [](simd::Lanes x, simd::Lanes y) { return simd::max(x, y); }); }
+inline int lessEqual(Lanes a, Lanes b)
+{
+	int mask = 0;
+	for (int i = 0; i < PARTS; ++i) mask |= (int)simd::bits(simd::lessEqual(a.part[i], b.part[i])) << (i * simd::LANES);
+	return mask;
+}
+inline int greaterEqual(Lanes a, Lanes b) { return lessEqual(b, a); }
+
+inline int lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+inline glm::vec3 getPosition(const float* positions, size_t stride, int vertex)
+{
+	const float* p = (const float*)((const uint8_t*)positions + stride * vertex);
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+inline float getHalfArea(const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+struct Bin
+{
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+	int count = 0;
+};
+
+// what the partitions move around, kept together so every pass reads memory in order
+struct BuildItem
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 centroid;
+	int triangle;
+};
+
+// the binary tree the build makes first, laid out like SceneBVH's
+struct BinaryNode
+{
+	glm::vec3 min;
+	uint32_t first; ///< Inner nodes: left child, the right one follows. Leaves: first item.
+	glm::vec3 max;
+	uint32_t count; ///< Items in a leaf, 0 for inner nodes.
+};
+
+struct BuildTask
+{
+	uint32_t node;
+	uint32_t begin;
+	uint32_t end;
+	int depth;
+};
+
+struct CollapseTask
+{
+	uint32_t node;
+	uint32_t binary_node;
+	int depth;
+};
+
+// Binned SAH as in SceneBVH::build, except that any run that fits a triangle block is a
+// leaf and any other is split: a block costs as much to test as one triangle.
+std::vector<BinaryNode> buildBinaryTree(std::vector<BuildItem>& items)
+{
+	std::vector<BinaryNode> nodes;
+	uint32_t item_count = (uint32_t)items.size();
+	nodes.reserve(item_count / 2 + 1);
+	nodes.push_back(BinaryNode());
+	std::vector<BuildTask> tasks;
+	tasks.push_back({0, 0, item_count, 1});
+	while (!tasks.empty())
+	{
+		BuildTask task = tasks.back();
+		tasks.pop_back();
+		uint32_t task_count = task.end - task.begin;
+
+		glm::vec3 min(INFINITY), max(-INFINITY), centroid_min(INFINITY), centroid_max(-INFINITY);
+		for (uint32_t i = task.begin; i < task.end; ++i)
+		{
+			min = glm::min(min, items[i].min);
+			max = glm::max(max, items[i].max);
+			centroid_min = glm::min(centroid_min, items[i].centroid);
+			centroid_max = glm::max(centroid_max, items[i].centroid);
+		}
+		nodes[task.node].min = min;
+		nodes[task.node].max = max;
+		if (task_count <= MAX_LEAF_SIZE)
+		{
+			nodes[task.node].first = task.begin;
+			nodes[task.node].count = task_count;
+			continue;
+		}
+
+		glm::vec3 extent = centroid_max - centroid_min;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		uint32_t split = task.begin;
+		if (extent[axis] > 0 && task.depth < SAH_MAX_DEPTH)
+		{
+			Bin bins[BIN_COUNT];
+			float scale = BIN_COUNT / extent[axis];
+			auto getBin = [&](const BuildItem& item) {
+				return std::min(BIN_COUNT - 1, (int)((item.centroid[axis] - centroid_min[axis]) * scale));
+			};
+			for (uint32_t i = task.begin; i < task.end; ++i)
+			{
+				Bin& bin = bins[getBin(items[i])];
+				bin.min = glm::min(bin.min, items[i].min);
+				bin.max = glm::max(bin.max, items[i].max);
+				++bin.count;
+			}
+
+			// right to left sweep first, then the left to right one evaluates every split
+			float right_cost[BIN_COUNT];
+			Bin right;
+			for (int b = BIN_COUNT - 1; b > 0; --b)
+			{
+				right.min = glm::min(right.min, bins[b].min);
+				right.max = glm::max(right.max, bins[b].max);
+				right.count += bins[b].count;
+				right_cost[b] = right.count ? getHalfArea(right.min, right.max) * right.count : 0.0f;
+			}
+			Bin left;
+			float best_cost = INFINITY;
+			int best_bin = 0;
+			for (int b = 1; b < BIN_COUNT; ++b)
+			{
+				left.min = glm::min(left.min, bins[b - 1].min);
+				left.max = glm::max(left.max, bins[b - 1].max);
+				left.count += bins[b - 1].count;
+				float cost = (left.count ? getHalfArea(left.min, left.max) * left.count : 0.0f) + right_cost[b];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_bin = b;
+				}
+			}
+			split = (uint32_t)(std::partition(items.begin() + task.begin, items.begin() + task.end,
+				[&](const BuildItem& item) { return getBin(item) < best_bin; }) - items.begin());
+		}
+		else if (extent[axis] > 0)
+		{
+			split = task.begin + task_count / 2;
+			std::nth_element(items.begin() + task.begin, items.begin() + split, items.begin() + task.end,
+				[&](const BuildItem& a, const BuildItem& b) { return a.centroid[axis] < b.centroid[axis]; });
+		}
+		// every centroid in one spot, or all in one bin: any split is as good as another
+		if (split == task.begin || split == task.end) split = task.begin + task_count / 2;
+
+		uint32_t left = (uint32_t)nodes.size();
+		nodes[task.node].first = left;
+		nodes[task.node].count = 0;
+		nodes.resize(nodes.size() + 2);
+		tasks.push_back({left + 1, split, task.end, task.depth + 1});
+		tasks.push_back({left, task.begin, split, task.depth + 1});
+	}
+	return nodes;
+}
+
+void setEmptySlot(Node* node, int slot)
+{
+	node->min_x[slot] = node->min_y[slot] = node->min_z[slot] = INFINITY;
+	node->max_x[slot] = node->max_y[slot] = node->max_z[slot] = -INFINITY;
+	node->children[slot] = 0;
+	node->block_counts[slot] = 0;
+}
+
+bool isEmptySlot(const Node& node, int slot)
+{
+	return node.min_x[slot] == INFINITY && node.min_y[slot] == INFINITY && node.min_z[slot] == INFINITY
+		&& node.max_x[slot] == -INFINITY && node.max_y[slot] == -INFINITY && node.max_z[slot] == -INFINITY
+		&& node.block_counts[slot] == 0;
+}
+
+void setSlotBounds(Node* node, int slot, const BinaryNode& child)
+{
+	node->min_x[slot] = child.min.x;
+	node->min_y[slot] = child.min.y;
+	node->min_z[slot] = child.min.z;
+	node->max_x[slot] = child.max.x;
+	node->max_y[slot] = child.max.y;
+	node->max_z[slot] = child.max.z;
+}
+
+TriangleBlock makeBlock(const BuildItem* items, int count, const int* indices, const float* positions, size_t stride)
+{
+	TriangleBlock block;
+	memset(&block, 0, sizeof(block));
+	for (int lane = 0; lane < MAX_LEAF_SIZE; ++lane)
+	{
+		if (lane >= count)
+		{
+			block.triangles[lane] = -1;
+			continue;
+		}
+		const int* triangle = indices + 3 * items[lane].triangle;
+		glm::vec3 v0 = getPosition(positions, stride, triangle[0]);
+		glm::vec3 e1 = getPosition(positions, stride, triangle[1]) - v0;
+		glm::vec3 e2 = getPosition(positions, stride, triangle[2]) - v0;
+		block.v0_x[lane] = v0.x;
+		block.v0_y[lane] = v0.y;
+		block.v0_z[lane] = v0.z;
+		block.e1_x[lane] = e1.x;
+		block.e1_y[lane] = e1.y;
+		block.e1_z[lane] = e1.z;
+		block.e2_x[lane] = e2.x;
+		block.e2_y[lane] = e2.y;
+		block.e2_z[lane] = e2.z;
+		block.triangles[lane] = items[lane].triangle;
+	}
+	return block;
+}
+
+// The ray in lanes, with the offsets of the near and far bounds in a node: for a
+// positive direction the slab is entered at its min, for a negative one at its max.
+// Exits are measured with an inverse grown by EXIT_SCALE.
+struct RayLanes
+{
+	Lanes origin_x, origin_y, origin_z;
+	Lanes direction_x, direction_y, direction_z;
+	Lanes inverse_x, inverse_y, inverse_z;
+	Lanes far_inverse_x, far_inverse_y, far_inverse_z;
+	size_t near_x, near_y, near_z;
+	size_t far_x, far_y, far_z;
+
+	explicit RayLanes(const MeshRay& ray)
+	{
+		glm::vec3 inverse = glm::vec3(1.0f) / ray.direction;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			// 1 / -0 is -infinity, the sign survives
+			if (!(fabsf(inverse[axis]) <= MAX_INVERSE)) inverse[axis] = copysignf(MAX_INVERSE, inverse[axis]);
+		}
+		origin_x = splat(ray.origin.x);
+		origin_y = splat(ray.origin.y);
+		origin_z = splat(ray.origin.z);
+		direction_x = splat(ray.direction.x);
+		direction_y = splat(ray.direction.y);
+		direction_z = splat(ray.direction.z);
+		inverse_x = splat(inverse.x);
+		inverse_y = splat(inverse.y);
+		inverse_z = splat(inverse.z);
+		far_inverse_x = splat(inverse.x * EXIT_SCALE);
+		far_inverse_y = splat(inverse.y * EXIT_SCALE);
+		far_inverse_z = splat(inverse.z * EXIT_SCALE);
+		bool positive_x = inverse.x >= 0, positive_y = inverse.y >= 0, positive_z = inverse.z >= 0;
+		near_x = positive_x ? offsetof(Node, min_x) : offsetof(Node, max_x);
+		near_y = positive_y ? offsetof(Node, min_y) : offsetof(Node, max_y);
+		near_z = positive_z ? offsetof(Node, min_z) : offsetof(Node, max_z);
+		far_x = positive_x ? offsetof(Node, max_x) : offsetof(Node, min_x);
+		far_y = positive_y ? offsetof(Node, max_y) : offsetof(Node, min_y);
+		far_z = positive_z ? offsetof(Node, max_z) : offsetof(Node, min_z);
+	}
+};
+
+inline Lanes loadBounds(const Node& node, size_t offset)
+{
+	return load((const float*)((const uint8_t*)&node + offset));
+}
+
+// Slab test (Kay and Kajiya) on the children of a node: a child is hit when its largest
+// entry is before its smallest exit within [0, limit]. With the inverse kept finite a ray
+// parallel to a slab gets infinite distances outside it and 0 on its boundary, never a
+// NaN, so the reductions need no particular operand order. Empty slots enter at infinity
+// and never pass.
+inline int intersectChildren(const Node& node, const RayLanes& ray, float limit, Lanes* entry)
+{
+	Lanes near_x = mul(sub(loadBounds(node, ray.near_x), ray.origin_x), ray.inverse_x);
+	Lanes near_y = mul(sub(loadBounds(node, ray.near_y), ray.origin_y), ray.inverse_y);
+	Lanes near_z = mul(sub(loadBounds(node, ray.near_z), ray.origin_z), ray.inverse_z);
+	Lanes far_x = mul(sub(loadBounds(node, ray.far_x), ray.origin_x), ray.far_inverse_x);
+	Lanes far_y = mul(sub(loadBounds(node, ray.far_y), ray.origin_y), ray.far_inverse_y);
+	Lanes far_z = mul(sub(loadBounds(node, ray.far_z), ray.origin_z), ray.far_inverse_z);
+	*entry = max(max(near_x, near_y), max(near_z, splat(0.0f)));
+	Lanes exit = min(min(far_x, far_y), min(far_z, splat(limit)));
+	return lessEqual(*entry, exit);
+}
+
+// Möller and Trumbore, "Fast, Minimum Storage Ray/Triangle Intersection", 1997, on the
+// triangles of a block, either face. Returns the mask of those hit within [0, limit].
+// Parallel rays divide by a zero determinant; the infinities and NaNs fail the barycentric
+// tests, as do the zero edges of unused columns.
+inline int intersectBlock(const TriangleBlock& block, const RayLanes& ray, float limit, Lanes* t, Lanes* u, Lanes* v)
+{
+	Lanes e1_x = load(block.e1_x), e1_y = load(block.e1_y), e1_z = load(block.e1_z);
+	Lanes e2_x = load(block.e2_x), e2_y = load(block.e2_y), e2_z = load(block.e2_z);
+	Lanes p_x = sub(mul(ray.direction_y, e2_z), mul(ray.direction_z, e2_y));
+	Lanes p_y = sub(mul(ray.direction_z, e2_x), mul(ray.direction_x, e2_z));
+	Lanes p_z = sub(mul(ray.direction_x, e2_y), mul(ray.direction_y, e2_x));
+	Lanes determinant = add(add(mul(e1_x, p_x), mul(e1_y, p_y)), mul(e1_z, p_z));
+	Lanes inverse = div(splat(1.0f), determinant);
+
+	Lanes s_x = sub(ray.origin_x, load(block.v0_x));
+	Lanes s_y = sub(ray.origin_y, load(block.v0_y));
+	Lanes s_z = sub(ray.origin_z, load(block.v0_z));
+	*u = mul(add(add(mul(s_x, p_x), mul(s_y, p_y)), mul(s_z, p_z)), inverse);
+	Lanes q_x = sub(mul(s_y, e1_z), mul(s_z, e1_y));
+	Lanes q_y = sub(mul(s_z, e1_x), mul(s_x, e1_z));
+	Lanes q_z = sub(mul(s_x, e1_y), mul(s_y, e1_x));
+	*v = mul(add(add(mul(ray.direction_x, q_x), mul(ray.direction_y, q_y)), mul(ray.direction_z, q_z)), inverse);
+	*t = mul(add(add(mul(e2_x, q_x), mul(e2_y, q_y)), mul(e2_z, q_z)), inverse);
+
+	Lanes zero = splat(0.0f);
+	return greaterEqual(*u, zero) & greaterEqual(*v, zero) & lessEqual(add(*u, *v), splat(1.0f))
+		& greaterEqual(*t, zero) & lessEqual(*t, splat(limit));
+}
+
+struct StackEntry
+{
+	int32_t child;        ///< As in Node::children, the root is 0.
+	uint32_t block_count;
+	float entry;          ///< Where the ray enters the child's box.
+};
+
+// Depth first, nearest child first: of the children a node's test passes the nearest is
+// walked next and the others are pushed far to near; an entry whose box starts beyond
+// the closest hit so far is dropped when popped. One child, the common case deep in the
+// tree, takes neither the stack nor a comparison. With \p any_hit the first triangle
+// found ends the walk.
+bool traverse(const std::vector<Node>& nodes, const std::vector<TriangleBlock>& blocks, const MeshRay& ray,
+	bool any_hit, MeshRayHit* hit)
+{
+	if (nodes.empty()) return false;
+	RayLanes lanes(ray);
+	float closest = ray.max_distance;
+	bool found = false;
+
+	StackEntry stack[MAX_STACK];
+	int stack_size = 0;
+	StackEntry current = {0, 0, 0.0f};
+	while (true)
+	{
+		if (current.child >= 0)
+		{
+			const Node& node = nodes[current.child];
+			Lanes entry;
+			int mask = intersectChildren(node, lanes, closest, &entry);
+			if (mask)
+			{
+				float entries[WIDTH];
+				store(entries, entry);
+				int slot = lowestBit(mask);
+				mask &= mask - 1;
+				if (!mask)
+				{
+					current = {node.children[slot], node.block_counts[slot], entries[slot]};
+					continue;
+				}
+
+				// insertion sort of the rest, farthest first, then the nearest is walked
+				int order[WIDTH] = {slot};
+				int order_count = 1;
+				for (; mask; mask &= mask - 1)
+				{
+					slot = lowestBit(mask);
+					int i = order_count++;
+					for (; i > 0 && entries[order[i - 1]] < entries[slot]; --i) order[i] = order[i - 1];
+					order[i] = slot;
+				}
+				// build and isValid keep the trees within MAX_DEPTH, which bounds the stack
+				assert(stack_size + order_count - 1 <= MAX_STACK);
+				for (int i = 0; i < order_count - 1; ++i)
+				{
+					slot = order[i];
+					stack[stack_size++] = {node.children[slot], node.block_counts[slot], entries[slot]};
+				}
+				slot = order[order_count - 1];
+				current = {node.children[slot], node.block_counts[slot], entries[slot]};
+				continue;
+			}
+		}
+		else
+		{
+			uint32_t first = (uint32_t)~current.child;
+			for (uint32_t b = first; b < first + current.block_count; ++b)
+			{
+				const TriangleBlock& block = blocks[b];
+				Lanes t, u, v;
+				int mask = intersectBlock(block, lanes, closest, &t, &u, &v);
+				if (!mask) continue;
+				if (any_hit) return true;
+
+				float ts[WIDTH], us[WIDTH], vs[WIDTH];
+				store(ts, t);
+				store(us, u);
+				store(vs, v);
+				for (; mask; mask &= mask - 1)
+				{
+					int lane = lowestBit(mask);
+					if (found && ts[lane] >= closest) continue;
+					found = true;
+					closest = ts[lane];
+					hit->triangle = block.triangles[lane];
+					hit->distance = ts[lane];
+					hit->u = us[lane];
+					hit->v = vs[lane];
+				}
+			}
+		}
+
+		do
+		{
+			if (!stack_size) return found;
+			current = stack[--stack_size];
+		} while (current.entry > closest);
+	}
+}
+
+} // anonymous namespace
+
+
+// The binary tree is built first, then collapsed into WIDTH wide nodes top down: each
+// takes the two children of a binary node and keeps opening the one with the largest
+// area, the likeliest to be hit, until there are WIDTH.
+void MeshBVH::build(const int* indices, int index_count, const float* positions, size_t position_stride,
+	int vertex_count)
+{
+	TRACE_ZONE("MeshBVH::build");
+	clear();
+	int triangle_count = index_count / 3;
+	std::vector<BuildItem> items;
+	items.reserve(triangle_count);
+	for (int t = 0; t < triangle_count; ++t)
+	{
+		const int* triangle = indices + 3 * t;
+		if (triangle[0] < 0 || triangle[0] >= vertex_count || triangle[1] < 0 || triangle[1] >= vertex_count
+			|| triangle[2] < 0 || triangle[2] >= vertex_count)
+		{
+			continue;
+		}
+		glm::vec3 a = getPosition(positions, position_stride, triangle[0]);
+		glm::vec3 b = getPosition(positions, position_stride, triangle[1]);
+		glm::vec3 c = getPosition(positions, position_stride, triangle[2]);
+		glm::vec3 sum = glm::abs(a) + glm::abs(b) + glm::abs(c);
+		if (!std::isfinite(sum.x + sum.y + sum.z)) continue;
+		BuildItem item;
+		item.min = glm::min(a, glm::min(b, c));
+		item.max = glm::max(a, glm::max(b, c));
+		item.centroid = (item.min + item.max) * 0.5f;
+		item.triangle = t;
+		items.push_back(item);
+	}
+	if (items.empty()) return;
+
+	std::vector<BinaryNode> binary = buildBinaryTree(items);
+	nodes.reserve(binary.size() / 3 + 1);
+	blocks.reserve(items.size() / 2 + 1);
+	nodes.push_back(Node());
+	std::vector<CollapseTask> tasks;
+	tasks.push_back({0, 0, 1});
+	while (!tasks.empty())
+	{
+		CollapseTask task = tasks.back();
+		tasks.pop_back();
+		depth = std::max(depth, task.depth);
+
+		// a root that is a leaf takes one slot of its own
+		uint32_t children[WIDTH];
+		int child_count = 0;
+		const BinaryNode& parent = binary[task.binary_node];
+		if (parent.count) children[child_count++] = task.binary_node;
+		else
+		{
+			children[child_count++] = parent.first;
+			children[child_count++] = parent.first + 1;
+		}
+		while (child_count < WIDTH)
+		{
+			int largest = -1;
+			float largest_area = -1;
+			for (int i = 0; i < child_count; ++i)
+			{
+				const BinaryNode& child = binary[children[i]];
+				float area = getHalfArea(child.min, child.max);
+				if (!child.count && area > largest_area)
+				{
+					largest = i;
+					largest_area = area;
+				}
+			}
+			if (largest < 0) break;
+			uint32_t opened = children[largest];
+			children[largest] = binary[opened].first;
+			children[child_count++] = binary[opened].first + 1;
+		}
+
+		for (int slot = 0; slot < WIDTH; ++slot)
+		{
+			Node& node = nodes[task.node];
+			if (slot >= child_count)
+			{
+				setEmptySlot(&node, slot);
+				continue;
+			}
+			const BinaryNode& child = binary[children[slot]];
+			setSlotBounds(&node, slot, child);
+			if (child.count)
+			{
+				node.children[slot] = ~(int32_t)blocks.size();
+				node.block_counts[slot] = 1;
+				blocks.push_back(makeBlock(&items[child.first], (int)child.count, indices, positions, position_stride));
+			}
+			else
+			{
+				uint32_t index = (uint32_t)nodes.size();
+				node.children[slot] = (int32_t)index;
+				node.block_counts[slot] = 0;
+				tasks.push_back({index, children[slot], task.depth + 1});
+				nodes.push_back(Node());
+			}
+		}
+	}
+}
+
+
+bool MeshBVH::assign(const Node* nodes, int node_count, const TriangleBlock* blocks, int block_count)
+{
+	clear();
+	if (!isValid(nodes, node_count, blocks, block_count)) return false;
+	this->nodes.assign(nodes, nodes + node_count);
+	this->blocks.assign(blocks, blocks + block_count);
+	std::vector<int> depths(node_count, 1);
+	for (int n = 0; n < node_count; ++n)
+	{
+		depth = std::max(depth, depths[n]);
+		for (int slot = 0; slot < WIDTH; ++slot)
+		{
+			int32_t child = nodes[n].children[slot];
+			if (child > 0) depths[child] = std::max(depths[child], depths[n] + 1);
+		}
+	}
+	return true;
+}
+
+
+// Children after their parent rule out cycles; with the depth bounded the traversal
+// stacks cannot overflow.
+bool MeshBVH::isValid(const Node* nodes, int node_count, const TriangleBlock* blocks, int block_count)
+{
+	if (node_count < 0 || block_count < 0) return false;
+	if (node_count == 0) return block_count == 0;
+	if (!nodes || (block_count && !blocks)) return false;
+
+	std::vector<int> depths(node_count, 1);
+	for (int n = 0; n < node_count; ++n)
+	{
+		for (int slot = 0; slot < WIDTH; ++slot)
+		{
+			int32_t child = nodes[n].children[slot];
+			uint32_t block_count_of_child = nodes[n].block_counts[slot];
+			if (child > 0)
+			{
+				if (child <= n || child >= node_count || block_count_of_child) return false;
+				depths[child] = std::max(depths[child], depths[n] + 1);
+				if (depths[child] > MAX_DEPTH) return false;
+			}
+			else if (child < 0)
+			{
+				uint32_t first = (uint32_t)~child;
+				if (!block_count_of_child || first >= (uint32_t)block_count || block_count_of_child > (uint32_t)block_count - first)
+				{
+					return false;
+				}
+			}
+			// the boxes of empty slots must miss every ray, or the walk would enter node 0 again
+			else if (!isEmptySlot(nodes[n], slot)) return false;
+		}
+	}
+	return true;
+}
+
+
+bool MeshBVH::raycast(const MeshRay& ray, MeshRayHit* hit) const
+{
+	*hit = MeshRayHit();
+	return traverse(nodes, blocks, ray, false, hit);
+}
+
+
+bool MeshBVH::occluded(const MeshRay& ray) const
+{
+	MeshRayHit hit;
+	return traverse(nodes, blocks, ray, true, &hit);
+}
+
+
+void MeshBVH::raycast(const MeshRay* rays, int count, MeshRayHit* hits, int max_threads) const
+{
+	TRACE_ZONE("MeshBVH::raycastBatch");
+	parallelFor((count + RAYS_PER_JOB - 1) / RAYS_PER_JOB, max_threads, [&](int job) {
+		int end = std::min(count, (job + 1) * RAYS_PER_JOB);
+		for (int i = job * RAYS_PER_JOB; i < end; ++i) raycast(rays[i], &hits[i]);
+	});
+}
+
+
+void MeshBVH::clear()
+{
+	nodes.clear();
+	blocks.clear();
+	depth = 0;
+}
+
+
+const char* MeshBVH::getISA()
+{
+	return simd::ISA_NAME;
+}
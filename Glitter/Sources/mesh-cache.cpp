@@ -0,0 +1,269 @@
+#include "mesh-cache.hpp"
+#include "hash.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+
+const size_t COOKED_ALIGNMENT = 16;
+
+static_assert(sizeof(MeshBVH::Node) % COOKED_ALIGNMENT == 0, "the triangle blocks follow the nodes unpadded");
+
+inline uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + COOKED_ALIGNMENT - 1) & ~(uint64_t)(COOKED_ALIGNMENT - 1);
+}
+
+// appends a setting to the key buffer byte by byte, the struct it comes from may have padding
+template <typename T>
+void appendSetting(std::vector<uint8_t>* settings, const T& value)
+{
+	const uint8_t* bytes = (const uint8_t*)&value;
+	settings->insert(settings->end(), bytes, bytes + sizeof(value));
+}
+
+bool writePadded(FILE* fp, const void* data, size_t size, uint64_t* offset)
+{
+	static const uint8_t zeros[COOKED_ALIGNMENT] = {};
+	size_t padding = (size_t)(alignOffset(*offset) - *offset);
+	if (padding && fwrite(zeros, 1, padding, fp) != padding) return false;
+	if (size && fwrite(data, 1, size, fp) != size) return false;
+	*offset += padding + size;
+	return true;
+}
+
+} // anonymous namespace
+
+
+uint64_t getCookedMeshKey(const void* fbx_data, size_t fbx_size, const FBXImporter& importer)
+{
+	TRACE_ZONE("getCookedMeshKey");
+	std::vector<uint8_t> settings;
+	appendSetting(&settings, COOKED_MESH_VERSION);
+	appendSetting(&settings, importer.mesh_scale);
+	appendSetting(&settings, (int)importer.orientation);
+	appendSetting(&settings, (int)importer.root_orientation);
+	appendSetting(&settings, importer.center_mesh);
+	appendSetting(&settings, importer.import_vertex_colors);
+	appendSetting(&settings, importer.ignore_skeleton);
+	appendSetting(&settings, importer.weld_vertices);
+	appendSetting(&settings, importer.weld_epsilon);
+	appendSetting(&settings, importer.vertex_cache_size);
+	appendSetting(&settings, importer.optimize_overdraw);
+	appendSetting(&settings, importer.meshlet_max_vertices);
+	appendSetting(&settings, importer.meshlet_max_triangles);
+	appendSetting(&settings, importer.bounding_sphere_refine_passes);
+	appendSetting(&settings, importer.build_bvh);
+	appendSetting(&settings, importer.lods_distances);
+	appendSetting(&settings, importer.lods_triangle_ratio);
+	appendSetting(&settings, importer.lods_max_error);
+
+	uint64_t seed = hash64(settings.data(), settings.size());
+	return hash64(fbx_data, fbx_size, seed);
+}
+
+
+bool saveCookedMeshes(const char* path, uint64_t key, const std::vector<FBXImporter::ImportMesh>& meshes)
+{
+	TRACE_ZONE("saveCookedMeshes");
+	CookedMeshHeader header = {};
+	header.magic = COOKED_MESH_MAGIC;
+	header.version = COOKED_MESH_VERSION;
+	header.key = key;
+	header.mesh_count = (uint32_t)meshes.size();
+
+	// lay the payload out first so the table can be written in one go
+	std::vector<CookedMesh> table(meshes.size());
+	uint64_t offset = sizeof(CookedMeshHeader) + sizeof(CookedMesh) * table.size();
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		const FBXImporter::ImportMesh& mesh = meshes[i];
+		CookedMesh& cooked = table[i];
+		memset(&cooked, 0, sizeof(cooked));
+
+		cooked.vertex_count = (uint32_t)mesh.getVertexCount();
+		cooked.index_count = (uint32_t)mesh.indices.size();
+		cooked.meshlet_count = (uint32_t)mesh.meshlets.size();
+		cooked.bvh_node_count = (uint32_t)mesh.bvh.getNodes().size();
+		cooked.bvh_block_count = (uint32_t)mesh.bvh.getBlocks().size();
+		cooked.index_size = (uint32_t)mesh.index_size;
+		cooked.vertex_attributes = mesh.layout.getMask();
+		cooked.vertex_stride = mesh.layout.stride;
+		cooked.material_index = mesh.material_index;
+		cooked.lod = mesh.lod;
+		glm::vec3 min = mesh.aabb.getMin();
+		glm::vec3 max = mesh.aabb.getMax();
+		memcpy(cooked.aabb_min, &min.x, sizeof(cooked.aabb_min));
+		memcpy(cooked.aabb_max, &max.x, sizeof(cooked.aabb_max));
+		memcpy(cooked.sphere_center, &mesh.bounding_sphere.center.x, sizeof(cooked.sphere_center));
+		cooked.sphere_radius = mesh.bounding_sphere.radius;
+		strncpy(cooked.material_name, mesh.material_name.c_str(), sizeof(cooked.material_name) - 1);
+
+		offset = alignOffset(offset);
+		cooked.vertex_offset = offset;
+		offset += sizeof(float) * mesh.vertices.size();
+		offset = alignOffset(offset);
+		cooked.index_offset = offset;
+		offset += mesh.index_data.size();
+		offset = alignOffset(offset);
+		cooked.meshlet_offset = offset;
+		offset += sizeof(Meshlet) * mesh.meshlets.size();
+		offset = alignOffset(offset);
+		cooked.bvh_offset = offset;
+		offset += sizeof(MeshBVH::Node) * cooked.bvh_node_count + sizeof(MeshBVH::TriangleBlock) * cooked.bvh_block_count;
+	}
+	header.file_size = offset;
+
+	std::string tmp_path = std::string(path) + ".tmp";
+	FILE* fp = fopen(tmp_path.c_str(), "wb");
+	if (!fp) return false;
+
+	uint64_t written = 0;
+	bool ok = writePadded(fp, &header, sizeof(header), &written);
+	ok = ok && writePadded(fp, table.data(), sizeof(CookedMesh) * table.size(), &written);
+	for (size_t i = 0; ok && i < meshes.size(); ++i)
+	{
+		const FBXImporter::ImportMesh& mesh = meshes[i];
+		ok = writePadded(fp, mesh.vertices.data(), sizeof(float) * mesh.vertices.size(), &written);
+		ok = ok && writePadded(fp, mesh.index_data.data(), mesh.index_data.size(), &written);
+		ok = ok && writePadded(fp, mesh.meshlets.data(), sizeof(Meshlet) * mesh.meshlets.size(), &written);
+		const std::vector<MeshBVH::Node>& nodes = mesh.bvh.getNodes();
+		const std::vector<MeshBVH::TriangleBlock>& blocks = mesh.bvh.getBlocks();
+		ok = ok && writePadded(fp, nodes.data(), sizeof(MeshBVH::Node) * nodes.size(), &written);
+		ok = ok && writePadded(fp, blocks.data(), sizeof(MeshBVH::TriangleBlock) * blocks.size(), &written);
+	}
+	ok = fclose(fp) == 0 && ok;
+	ok = ok && written == header.file_size;
+
+	if (ok)
+	{
+		// rename does not replace an existing file everywhere
+		remove(path);
+		ok = rename(tmp_path.c_str(), path) == 0;
+	}
+	if (!ok) remove(tmp_path.c_str());
+	return ok;
+}
+
+
+bool CookedMeshFile::open(const char* path, uint64_t key)
+{
+	if (!file.open(path)) return false;
+
+	bool valid = file.size() >= sizeof(CookedMeshHeader);
+	if (valid)
+	{
+		const CookedMeshHeader& header = getHeader();
+		valid = header.magic == COOKED_MESH_MAGIC
+			&& header.version == COOKED_MESH_VERSION
+			&& header.key == key
+			&& header.file_size == file.size()
+			&& header.mesh_count <= (file.size() - sizeof(CookedMeshHeader)) / sizeof(CookedMesh);
+	}
+
+	for (int i = 0; valid && i < getMeshCount(); ++i)
+	{
+		const CookedMesh& mesh = getMesh(i);
+		uint64_t vertex_bytes = (uint64_t)mesh.vertex_count * mesh.vertex_stride;
+		uint64_t index_bytes = (uint64_t)mesh.index_count * mesh.index_size;
+		uint64_t meshlet_bytes = (uint64_t)mesh.meshlet_count * sizeof(Meshlet);
+		uint64_t bvh_bytes = (uint64_t)mesh.bvh_node_count * sizeof(MeshBVH::Node)
+			+ (uint64_t)mesh.bvh_block_count * sizeof(MeshBVH::TriangleBlock);
+		valid = mesh.vertex_attributes < (1u << VERTEX_ATTRIBUTE_COUNT)
+			&& (mesh.vertex_attributes & (1u << VERTEX_POSITION))
+			&& mesh.vertex_stride == makeFloatVertexLayout(mesh.vertex_attributes).stride
+			&& (mesh.index_size == 2 || mesh.index_size == 4 || (mesh.index_size == 0 && mesh.index_count == 0))
+			&& mesh.vertex_offset % COOKED_ALIGNMENT == 0
+			&& mesh.index_offset % COOKED_ALIGNMENT == 0
+			&& mesh.meshlet_offset % COOKED_ALIGNMENT == 0
+			&& mesh.bvh_offset % COOKED_ALIGNMENT == 0
+			&& mesh.vertex_offset <= file.size() && vertex_bytes <= file.size() - mesh.vertex_offset
+			&& mesh.index_offset <= file.size() && index_bytes <= file.size() - mesh.index_offset
+			&& mesh.meshlet_offset <= file.size() && meshlet_bytes <= file.size() - mesh.meshlet_offset
+			&& mesh.bvh_offset <= file.size() && bvh_bytes <= file.size() - mesh.bvh_offset;
+		if (valid && mesh.index_size == 2)
+		{
+			const uint16_t* indices = (const uint16_t*)getIndices(i);
+			for (uint32_t j = 0; valid && j < mesh.index_count; ++j) valid = indices[j] < mesh.vertex_count;
+		}
+		else if (valid && mesh.index_size == 4)
+		{
+			const uint32_t* indices = (const uint32_t*)getIndices(i);
+			for (uint32_t j = 0; valid && j < mesh.index_count; ++j) valid = indices[j] < mesh.vertex_count;
+		}
+		for (uint32_t j = 0; valid && j < mesh.meshlet_count; ++j)
+		{
+			const Meshlet& meshlet = getMeshlets(i)[j];
+			valid = meshlet.index_offset <= mesh.index_count && meshlet.triangle_count <= (mesh.index_count - meshlet.index_offset) / 3;
+		}
+		valid = valid && MeshBVH::isValid(getBVHNodes(i), (int)mesh.bvh_node_count, getBVHBlocks(i), (int)mesh.bvh_block_count);
+		for (uint32_t j = 0; valid && j < mesh.bvh_block_count; ++j)
+		{
+			const MeshBVH::TriangleBlock& block = getBVHBlocks(i)[j];
+			for (int k = 0; valid && k < MeshBVH::WIDTH; ++k)
+			{
+				valid = block.triangles[k] >= -1 && block.triangles[k] < (int64_t)(mesh.index_count / 3);
+			}
+		}
+	}
+
+	if (!valid) file.close();
+	return valid;
+}
+
+
+bool loadCookedMeshes(const char* path, uint64_t key, std::vector<FBXImporter::ImportMesh>* meshes)
+{
+	TRACE_ZONE("loadCookedMeshes");
+	CookedMeshFile file;
+	if (!file.open(path, key)) return false;
+
+	std::vector<FBXImporter::ImportMesh> loaded(file.getMeshCount());
+	for (int i = 0; i < file.getMeshCount(); ++i)
+	{
+		const CookedMesh& cooked = file.getMesh(i);
+		FBXImporter::ImportMesh& mesh = loaded[i];
+
+		mesh.material_index = cooked.material_index;
+		mesh.material_name.assign(cooked.material_name, strnlen(cooked.material_name, sizeof(cooked.material_name)));
+		mesh.lod = cooked.lod;
+		glm::vec3 min = glm::make_vec3(cooked.aabb_min);
+		glm::vec3 max = glm::make_vec3(cooked.aabb_max);
+		mesh.aabb.setNull();
+		if (min.x <= max.x)
+		{
+			mesh.aabb.extend(min);
+			mesh.aabb.extend(max);
+		}
+		mesh.bounding_sphere.center = glm::make_vec3(cooked.sphere_center);
+		mesh.bounding_sphere.radius = cooked.sphere_radius;
+
+		mesh.layout = makeFloatVertexLayout(cooked.vertex_attributes);
+		const float* vertices = (const float*)file.getVertices(i);
+		mesh.vertices.assign(vertices, vertices + (size_t)cooked.vertex_count * cooked.vertex_stride / sizeof(float));
+
+		const uint8_t* index_data = (const uint8_t*)file.getIndices(i);
+		mesh.index_data.assign(index_data, index_data + (size_t)cooked.index_count * cooked.index_size);
+		mesh.index_size = (int)cooked.index_size;
+		mesh.indices.resize(cooked.index_count);
+		if (cooked.index_size == 2)
+		{
+			const uint16_t* src = (const uint16_t*)index_data;
+			for (uint32_t j = 0; j < cooked.index_count; ++j) mesh.indices[j] = src[j];
+		}
+		else if (cooked.index_size == 4)
+		{
+			memcpy(mesh.indices.data(), index_data, sizeof(int) * cooked.index_count);
+		}
+
+		const Meshlet* meshlets = file.getMeshlets(i);
+		mesh.meshlets.assign(meshlets, meshlets + cooked.meshlet_count);
+		mesh.bvh.assign(file.getBVHNodes(i), (int)cooked.bvh_node_count, file.getBVHBlocks(i), (int)cooked.bvh_block_count);
+	}
+
+	meshes->swap(loaded);
+	return true;
+}
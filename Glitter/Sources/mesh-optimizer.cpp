@@ -0,0 +1,226 @@
+#include "mesh-optimizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Both the analyzer and Tipsify model a FIFO cache with timestamps: a vertex is
+// resident while fewer than cache_size misses happened since it was loaded.
+VertexCacheStats analyzeVertexCache(const int* indices, int index_count, int vertex_count, int cache_size)
+{
+	VertexCacheStats stats;
+	stats.triangle_count = index_count / 3;
+
+	std::vector<int> cache_time(vertex_count, 0);
+	int time = cache_size + 1;
+	for (int i = 0; i < index_count; ++i)
+	{
+		int v = indices[i];
+		assert(v >= 0 && v < vertex_count);
+		if (cache_time[v] == 0) ++stats.vertex_count;
+		if (time - cache_time[v] > cache_size)
+		{
+			cache_time[v] = time++;
+			++stats.misses;
+		}
+	}
+	return stats;
+}
+
+
+void optimizeVertexCache(int* dst, const int* indices, int index_count, int vertex_count, int cache_size)
+{
+	assert(dst != indices);
+	int triangle_count = index_count / 3;
+
+	// vertex -> triangles adjacency, compressed
+	std::vector<int> offsets(vertex_count + 1, 0);
+	for (int i = 0; i < triangle_count * 3; ++i) ++offsets[indices[i] + 1];
+	for (int v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+	std::vector<int> adjacency(triangle_count * 3);
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	for (int t = 0; t < triangle_count; ++t)
+	{
+		for (int k = 0; k < 3; ++k) adjacency[fill[indices[t * 3 + k]]++] = t;
+	}
+
+	std::vector<int> live(vertex_count);
+	for (int v = 0; v < vertex_count; ++v) live[v] = offsets[v + 1] - offsets[v];
+	std::vector<int> cache_time(vertex_count, 0);
+	std::vector<char> emitted(triangle_count, 0);
+	std::vector<int> dead_end;
+	dead_end.reserve(triangle_count * 3);
+	std::vector<int> candidates;
+
+	int time = cache_size + 1;
+	int cursor = 0;
+	int out = 0;
+	int fanning = 0;
+	while (fanning < vertex_count && live[fanning] == 0) ++fanning;
+
+	while (fanning < vertex_count)
+	{
+		candidates.clear();
+		for (int a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+		{
+			int t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = 1;
+			for (int k = 0; k < 3; ++k)
+			{
+				int v = indices[t * 3 + k];
+				dst[out++] = v;
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+			}
+		}
+
+		// prefer the candidate that stays in the cache while its remaining triangles are emitted,
+		// and among those the one that entered the cache earliest
+		int next = -1;
+		int best_priority = -1;
+		for (int v : candidates)
+		{
+			if (live[v] == 0) continue;
+			int priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+			if (priority > best_priority)
+			{
+				best_priority = priority;
+				next = v;
+			}
+		}
+
+		// dead end: try recently referenced vertices first, then scan for anything left
+		while (next < 0 && !dead_end.empty())
+		{
+			int v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0) next = v;
+		}
+		if (next < 0)
+		{
+			while (cursor < vertex_count && live[cursor] == 0) ++cursor;
+			next = cursor;
+		}
+		fanning = next;
+	}
+	assert(out == triangle_count * 3);
+	// a trailing partial triangle is not part of any triangle, keep it as is
+	for (int i = out; i < index_count; ++i) dst[i] = indices[i];
+}
+
+
+void optimizeOverdraw(int* indices, int index_count, const float* positions, size_t position_stride,
+	int vertex_count, int cache_size)
+{
+	int triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	auto getPosition = [&](int v) {
+		return (const float*)((const char*)positions + v * position_stride);
+	};
+
+	// cluster boundaries: triangles that miss the cache on all three vertices
+	std::vector<int> clusters;
+	{
+		std::vector<int> cache_time(vertex_count, 0);
+		int time = cache_size + 1;
+		for (int t = 0; t < triangle_count; ++t)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				int v = indices[t * 3 + k];
+				if (time - cache_time[v] > cache_size)
+				{
+					cache_time[v] = time++;
+					++misses;
+				}
+			}
+			if (t == 0 || misses == 3) clusters.push_back(t);
+		}
+	}
+	int cluster_count = (int)clusters.size();
+	if (cluster_count < 2) return;
+	clusters.push_back(triangle_count);
+
+	struct ClusterInfo
+	{
+		float centroid[3];
+		float normal[3];
+		float area;
+	};
+	std::vector<ClusterInfo> infos(cluster_count);
+	float mesh_centroid[3] = {0, 0, 0};
+	float mesh_area = 0;
+	for (int c = 0; c < cluster_count; ++c)
+	{
+		ClusterInfo& info = infos[c];
+		memset(&info, 0, sizeof(info));
+		for (int t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			const float* p0 = getPosition(indices[t * 3 + 0]);
+			const float* p1 = getPosition(indices[t * 3 + 1]);
+			const float* p2 = getPosition(indices[t * 3 + 2]);
+			float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+			float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int i = 0; i < 3; ++i)
+			{
+				info.centroid[i] += (p0[i] + p1[i] + p2[i]) * (area / 3);
+				info.normal[i] += n[i];
+			}
+			info.area += area;
+		}
+		for (int i = 0; i < 3; ++i) mesh_centroid[i] += info.centroid[i];
+		mesh_area += info.area;
+		float inv_area = info.area > 0 ? 1.0f / info.area : 0.0f;
+		for (int i = 0; i < 3; ++i) info.centroid[i] *= inv_area;
+	}
+	if (mesh_area <= 0) return;
+	for (int i = 0; i < 3; ++i) mesh_centroid[i] /= mesh_area;
+
+	std::vector<float> sort_keys(cluster_count);
+	for (int c = 0; c < cluster_count; ++c)
+	{
+		const ClusterInfo& info = infos[c];
+		float len = sqrtf(info.normal[0] * info.normal[0] + info.normal[1] * info.normal[1] + info.normal[2] * info.normal[2]);
+		float inv_len = len > 0 ? 1.0f / len : 0.0f;
+		float key = 0;
+		for (int i = 0; i < 3; ++i) key += (info.centroid[i] - mesh_centroid[i]) * info.normal[i] * inv_len;
+		sort_keys[c] = key;
+	}
+
+	std::vector<int> order(cluster_count);
+	for (int c = 0; c < cluster_count; ++c) order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return sort_keys[a] > sort_keys[b]; });
+
+	std::vector<int> src(indices, indices + triangle_count * 3);
+	int out = 0;
+	for (int c : order)
+	{
+		int first = clusters[c] * 3;
+		int last = clusters[c + 1] * 3;
+		memcpy(indices + out, src.data() + first, (last - first) * sizeof(int));
+		out += last - first;
+	}
+}
+
+
+int optimizeVertexFetchRemap(int* remap, const int* indices, int index_count, int vertex_count)
+{
+	for (int v = 0; v < vertex_count; ++v) remap[v] = -1;
+	int next = 0;
+	for (int i = 0; i < index_count; ++i)
+	{
+		int v = indices[i];
+		if (remap[v] < 0) remap[v] = next++;
+	}
+	return next;
+}
@@ -0,0 +1,272 @@
+#include "mesh-simplify.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Sum of squared distances to a set of planes, weighted by triangle area:
+// Q(p) = p^T A p + 2 b^T p + c with A symmetric, kept in double since the
+// terms cancel out for points close to the planes.
+struct Quadric
+{
+	double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+
+	void addPlane(double nx, double ny, double nz, double d, double w)
+	{
+		a00 += w * nx * nx;
+		a11 += w * ny * ny;
+		a22 += w * nz * nz;
+		a01 += w * nx * ny;
+		a02 += w * nx * nz;
+		a12 += w * ny * nz;
+		b0 += w * nx * d;
+		b1 += w * ny * d;
+		b2 += w * nz * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric& q)
+	{
+		a00 += q.a00;
+		a11 += q.a11;
+		a22 += q.a22;
+		a01 += q.a01;
+		a02 += q.a02;
+		a12 += q.a12;
+		b0 += q.b0;
+		b1 += q.b1;
+		b2 += q.b2;
+		c += q.c;
+		weight += q.weight;
+	}
+
+	double evaluate(const float* p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		return a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2 * (b0 * x + b1 * y + b2 * z)
+			+ c;
+	}
+};
+
+struct Collapse
+{
+	int from;
+	int to;
+	float error;
+};
+
+inline const float* getPosition(const float* positions, size_t stride, int vertex)
+{
+	return (const float*)((const uint8_t*)positions + stride * vertex);
+}
+
+inline void triangleNormal(const float* p0, const float* p1, const float* p2, double n[3])
+{
+	double e1[3] = {(double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2]};
+	double e2[3] = {(double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2]};
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Vertices that must stay where they are: copies of a position, which is how UV and
+// normal seams look after welding, and the ends of edges that do not have exactly two
+// triangles, i.e. borders and non-manifold edges. Vertices no triangle uses are no
+// seam, the caller may have pointed the indices away from them.
+std::vector<char> findLockedVertices(const int* indices, int index_count, const float* positions, size_t stride,
+	int vertex_count)
+{
+	std::vector<char> locked(vertex_count, 0);
+
+	std::vector<char> used(vertex_count, 0);
+	for (int i = 0; i < index_count; ++i) used[indices[i]] = 1;
+	std::vector<int> order;
+	order.reserve(vertex_count);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		if (used[i]) order.push_back(i);
+	}
+	auto less = [&](int a, int b) {
+		const float* pa = getPosition(positions, stride, a);
+		const float* pb = getPosition(positions, stride, b);
+		return std::lexicographical_compare(pa, pa + 3, pb, pb + 3);
+	};
+	std::sort(order.begin(), order.end(), less);
+	for (size_t i = 1; i < order.size(); ++i)
+	{
+		if (less(order[i - 1], order[i])) continue;
+		locked[order[i - 1]] = 1;
+		locked[order[i]] = 1;
+	}
+
+	std::unordered_map<uint64_t, int> edge_triangles;
+	edge_triangles.reserve(index_count);
+	for (int i = 0; i < index_count; i += 3)
+	{
+		for (int e = 0; e < 3; ++e)
+		{
+			int a = indices[i + e];
+			int b = indices[i + (e + 1) % 3];
+			if (a > b) std::swap(a, b);
+			++edge_triangles[((uint64_t)a << 32) | (uint32_t)b];
+		}
+	}
+	for (const auto& edge : edge_triangles)
+	{
+		if (edge.second == 2) continue;
+		locked[(int)(edge.first >> 32)] = 1;
+		locked[(int)(edge.first & 0xffffffff)] = 1;
+	}
+	return locked;
+}
+
+} // anonymous namespace
+
+
+// Works in passes: every pass ranks all possible collapses by error and performs them
+// cheapest first, skipping any that touches the neighbourhood of an earlier one in the
+// same pass, so the adjacency and flip tests stay valid without incremental updates.
+int simplifyMesh(int* dst, const int* indices, int index_count, const float* positions, size_t position_stride,
+	int vertex_count, int target_index_count, float target_error, float* result_error)
+{
+	assert(index_count % 3 == 0);
+	std::vector<int> result(indices, indices + index_count);
+	std::vector<char> locked = findLockedVertices(indices, index_count, positions, position_stride, vertex_count);
+
+	std::vector<Quadric> quadrics(vertex_count);
+	for (int i = 0; i < index_count; i += 3)
+	{
+		const float* p0 = getPosition(positions, position_stride, indices[i]);
+		double n[3];
+		triangleNormal(p0, getPosition(positions, position_stride, indices[i + 1]),
+			getPosition(positions, position_stride, indices[i + 2]), n);
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0) continue;
+		n[0] /= length;
+		n[1] /= length;
+		n[2] /= length;
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		for (int k = 0; k < 3; ++k) quadrics[indices[i + k]].addPlane(n[0], n[1], n[2], d, length * 0.5);
+	}
+
+	std::vector<int> remap(vertex_count);
+	std::vector<char> touched(vertex_count);
+	std::vector<int> offsets(vertex_count + 1);
+	std::vector<int> adjacency;
+	std::vector<Collapse> collapses;
+	float max_error = 0;
+	int current_count = index_count;
+	while (current_count > target_index_count)
+	{
+		// vertex -> triangles
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (int i = 0; i < current_count; ++i) ++offsets[result[i] + 1];
+		for (int v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+		adjacency.resize(current_count);
+		std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < current_count; ++i) adjacency[cursor[result[i]]++] = i / 3;
+
+		// a manifold edge is walked in both directions by its two triangles, seeing it
+		// once is enough to consider both collapse directions
+		collapses.clear();
+		for (int i = 0; i < current_count; i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				int a = result[i + e];
+				int b = result[i + (e + 1) % 3];
+				if (a > b) continue;
+				for (int k = 0; k < 2; ++k)
+				{
+					int from = k ? b : a;
+					int to = k ? a : b;
+					if (locked[from]) continue;
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+					double error = q.weight > 0 ? sqrt(std::max(0.0, q.evaluate(getPosition(positions, position_stride, to))) / q.weight) : 0;
+					collapses.push_back({from, to, (float)error});
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		for (int v = 0; v < vertex_count; ++v) remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+		int triangle_count = current_count / 3;
+		int target_triangle_count = target_index_count / 3;
+		int performed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > target_error || triangle_count <= target_triangle_count) break;
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+
+			// the triangles that keep their area must keep facing the same way
+			const float* target = getPosition(positions, position_stride, collapse.to);
+			bool flips = false;
+			int removed = 0;
+			for (int j = offsets[collapse.from]; j < offsets[collapse.from + 1] && !flips; ++j)
+			{
+				const int* tri = &result[adjacency[j] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+				{
+					++removed;
+					continue;
+				}
+				const float* p[3];
+				const float* moved[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					p[k] = getPosition(positions, position_stride, tri[k]);
+					moved[k] = tri[k] == collapse.from ? target : p[k];
+				}
+				double before[3], after[3];
+				triangleNormal(p[0], p[1], p[2], before);
+				triangleNormal(moved[0], moved[1], moved[2], after);
+				double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				double lengths = sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2])
+					* (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+				flips = dot <= 0.25 * lengths;
+			}
+			if (flips) continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			for (int j = offsets[collapse.from]; j < offsets[collapse.from + 1]; ++j)
+			{
+				const int* tri = &result[adjacency[j] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			max_error = std::max(max_error, collapse.error);
+			triangle_count -= removed;
+			++performed;
+		}
+		if (!performed) break;
+
+		int write = 0;
+		for (int i = 0; i < current_count; i += 3)
+		{
+			int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || a == c) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		current_count = write;
+	}
+
+	memcpy(dst, result.data(), sizeof(int) * current_count);
+	if (result_error) *result_error = max_error;
+	return current_count;
+}
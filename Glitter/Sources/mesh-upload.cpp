@@ -0,0 +1,157 @@
+#include "mesh-upload.hpp"
+#include "renderable.h"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+// the vertex stream that goes to the GPU: the compact one when the mesh was quantized
+const void* getVertexData(const FBXImporter::ImportMesh& mesh, size_t* size)
+{
+	if (!mesh.quantized_vertices.empty())
+	{
+		*size = mesh.quantized_vertices.size();
+		return mesh.quantized_vertices.data();
+	}
+	*size = sizeof(float) * mesh.vertices.size();
+	return mesh.vertices.data();
+}
+
+// creates the VAO and allocates both buffers at full size, the data follows in chunks
+void createBuffers(const FBXImporter::ImportMesh& mesh, GpuMesh* gpu)
+{
+	TRACE_ZONE("createBuffers");
+	glGenVertexArrays(1, &gpu->vertex_array);
+	glGenBuffers(1, &gpu->vertex_buffer);
+	glGenBuffers(1, &gpu->index_buffer);
+
+	size_t vertex_bytes;
+	getVertexData(mesh, &vertex_bytes);
+	gpu->quantized = !mesh.quantized_vertices.empty();
+	gpu->quantization = mesh.quantization;
+	gpu->layout = gpu->quantized ? mesh.quantization.layout : mesh.layout;
+
+	glBindVertexArray(gpu->vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, gpu->vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertex_bytes, nullptr, GL_STATIC_DRAW);
+	glVertexLayout(gpu->layout);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu->index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.index_data.size(), nullptr, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	gpu->index_count = (GLsizei)mesh.indices.size();
+	gpu->index_type = mesh.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	gpu->material_index = mesh.material_index;
+	gpu->lod = mesh.lod;
+	gpu->aabb.extend(mesh.aabb);
+	gpu->bounding_sphere = mesh.bounding_sphere;
+	gpu->meshlets = mesh.meshlets;
+}
+
+// GL_COPY_WRITE_BUFFER leaves the element array binding, which is VAO state, alone
+size_t uploadChunk(GLuint buffer, const void* data, size_t size, size_t* done, size_t max_bytes)
+{
+	size_t chunk = std::min(size - *done, max_bytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)*done, (GLsizeiptr)chunk, (const uint8_t*)data + *done);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	*done += chunk;
+	return chunk;
+}
+
+} // anonymous namespace
+
+
+void drawMeshlets(const GpuMesh& mesh, const std::vector<MeshletDraw>& draws)
+{
+	if (draws.empty()) return;
+	size_t index_size = mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	std::vector<GLsizei> counts(draws.size());
+	std::vector<const void*> offsets(draws.size());
+	for (size_t i = 0; i < draws.size(); ++i)
+	{
+		counts[i] = (GLsizei)draws[i].index_count;
+		offsets[i] = (const void*)(draws[i].index_offset * index_size);
+	}
+	glBindVertexArray(mesh.vertex_array);
+	glMultiDrawElements(GL_TRIANGLES, counts.data(), mesh.index_type, offsets.data(), (GLsizei)draws.size());
+}
+
+
+void MeshUploader::clear()
+{
+	for (const GpuMesh& mesh : meshes)
+	{
+		glDeleteVertexArrays(1, &mesh.vertex_array);
+		glDeleteBuffers(1, &mesh.vertex_buffer);
+		glDeleteBuffers(1, &mesh.index_buffer);
+	}
+	for (const PendingUpload& upload : pending)
+	{
+		if (!upload.allocated) continue;
+		glDeleteVertexArrays(1, &upload.gpu.vertex_array);
+		glDeleteBuffers(1, &upload.gpu.vertex_buffer);
+		glDeleteBuffers(1, &upload.gpu.index_buffer);
+	}
+	meshes.clear();
+	pending.clear();
+}
+
+
+void MeshUploader::enqueue(std::unique_ptr<FBXImporter::ImportMesh> mesh)
+{
+	pending.emplace_back();
+	pending.back().mesh = std::move(mesh);
+}
+
+
+size_t MeshUploader::update(const UploadBudget& budget)
+{
+	TRACE_ZONE("MeshUploader::update");
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	size_t max_bytes = budget.bytes_per_frame ? budget.bytes_per_frame : SIZE_MAX;
+	size_t uploaded = 0;
+	// the first step always runs so every frame makes progress; any later one may be
+	// over time even if nothing was uploaded yet, buffer creation and empty meshes cost too
+	for (bool first = true; !pending.empty() && uploaded < max_bytes; first = false)
+	{
+		if (!first && budget.milliseconds_per_frame > 0)
+		{
+			std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+			if (elapsed.count() >= budget.milliseconds_per_frame) break;
+		}
+
+		PendingUpload& upload = pending.front();
+		const FBXImporter::ImportMesh& mesh = *upload.mesh;
+		if (!upload.allocated)
+		{
+			createBuffers(mesh, &upload.gpu);
+			upload.allocated = true;
+		}
+
+		size_t vertex_bytes;
+		const void* vertex_data = getVertexData(mesh, &vertex_bytes);
+		if (upload.vertex_bytes_done < vertex_bytes)
+		{
+			uploaded += uploadChunk(upload.gpu.vertex_buffer, vertex_data, vertex_bytes,
+				&upload.vertex_bytes_done, max_bytes - uploaded);
+			continue;
+		}
+		if (upload.index_bytes_done < mesh.index_data.size())
+		{
+			uploaded += uploadChunk(upload.gpu.index_buffer, mesh.index_data.data(), mesh.index_data.size(),
+				&upload.index_bytes_done, max_bytes - uploaded);
+			continue;
+		}
+
+		meshes.push_back(upload.gpu);
+		pending.pop_front();
+	}
+	return uploaded;
+}
@@ -0,0 +1,157 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+inline glm::vec3 getPosition(const float* positions, size_t stride, int vertex)
+{
+	const float* p = (const float*)((const uint8_t*)positions + stride * vertex);
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+} // anonymous namespace
+
+
+// Splits the index buffer greedily: a meshlet ends as soon as the next triangle would
+// take it past either limit.
+size_t buildMeshlets(std::vector<Meshlet>* meshlets, const int* indices, int index_count, const float* positions,
+	size_t position_stride, int vertex_count, int max_vertices, int max_triangles)
+{
+	meshlets->clear();
+	// the meshlet that last used each vertex, so distinct vertices are counted without a set
+	std::vector<int> last_use(vertex_count, -1);
+	Meshlet meshlet = {};
+	for (int i = 0; i < index_count; i += 3)
+	{
+		int current = (int)meshlets->size();
+		int added = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			// a triangle may repeat a vertex only if it is degenerate, count it once anyway
+			int v = indices[i + k];
+			added += last_use[v] != current && (k == 0 || v != indices[i]) && (k < 2 || v != indices[i + 1]);
+		}
+		if (meshlet.triangle_count && ((int)(meshlet.vertex_count + added) > max_vertices
+			|| (int)meshlet.triangle_count >= max_triangles))
+		{
+			computeMeshletBounds(&meshlet, indices + meshlet.index_offset, meshlet.triangle_count, positions, position_stride);
+			meshlets->push_back(meshlet);
+			meshlet = Meshlet();
+			meshlet.index_offset = i;
+			current = (int)meshlets->size();
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			int& last = last_use[indices[i + k]];
+			if (last == current) continue;
+			last = current;
+			++meshlet.vertex_count;
+		}
+		++meshlet.triangle_count;
+	}
+	if (meshlet.triangle_count)
+	{
+		computeMeshletBounds(&meshlet, indices + meshlet.index_offset, meshlet.triangle_count, positions, position_stride);
+		meshlets->push_back(meshlet);
+	}
+	return meshlets->size();
+}
+
+
+// The sphere is centered on the bounds of the vertices, which for the small, mostly flat
+// patches meshlets are is close to the smallest one. The cone axis is the average normal
+// and its angle covers the normal furthest from it; a cone wider than about 84 degrees
+// would hardly ever cull and is left empty. The apex is moved back along the axis until it
+// is behind every triangle plane, so a viewer inside the cone sees all triangles from the
+// back (Arseny Kapoulkine, meshoptimizer).
+void computeMeshletBounds(Meshlet* meshlet, const int* indices, int triangle_count, const float* positions,
+	size_t position_stride)
+{
+	glm::vec3 min(INFINITY), max(-INFINITY);
+	for (int i = 0; i < triangle_count * 3; ++i)
+	{
+		glm::vec3 p = getPosition(positions, position_stride, indices[i]);
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+	glm::vec3 center = (min + max) * 0.5f;
+	float radius_squared = 0;
+	for (int i = 0; i < triangle_count * 3; ++i)
+	{
+		glm::vec3 d = getPosition(positions, position_stride, indices[i]) - center;
+		radius_squared = std::max(radius_squared, glm::dot(d, d));
+	}
+	memcpy(meshlet->center, &center.x, sizeof(meshlet->center));
+	meshlet->radius = sqrtf(radius_squared);
+
+	std::vector<glm::vec3> normals(triangle_count);
+	glm::vec3 normal_sum(0.0f);
+	for (int t = 0; t < triangle_count; ++t)
+	{
+		glm::vec3 p0 = getPosition(positions, position_stride, indices[t * 3]);
+		glm::vec3 p1 = getPosition(positions, position_stride, indices[t * 3 + 1]);
+		glm::vec3 p2 = getPosition(positions, position_stride, indices[t * 3 + 2]);
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		// degenerate triangles have no facing, they cannot prevent culling either
+		normals[t] = length > 0 ? n / length : glm::vec3(0.0f);
+		normal_sum += normals[t];
+	}
+
+	memcpy(meshlet->cone_apex, &center.x, sizeof(meshlet->cone_apex));
+	memset(meshlet->cone_axis, 0, sizeof(meshlet->cone_axis));
+	meshlet->cone_cutoff = 1;
+	float sum_length = glm::length(normal_sum);
+	if (sum_length == 0) return;
+	glm::vec3 axis = normal_sum / sum_length;
+	float min_dot = 1;
+	for (const glm::vec3& n : normals)
+	{
+		if (n != glm::vec3(0.0f)) min_dot = std::min(min_dot, glm::dot(n, axis));
+	}
+	if (min_dot <= 0.1f) return;
+
+	float max_t = 0;
+	for (int t = 0; t < triangle_count; ++t)
+	{
+		if (normals[t] == glm::vec3(0.0f)) continue;
+		glm::vec3 p0 = getPosition(positions, position_stride, indices[t * 3]);
+		max_t = std::max(max_t, glm::dot(center - p0, normals[t]) / glm::dot(axis, normals[t]));
+	}
+	glm::vec3 apex = center - axis * max_t;
+	memcpy(meshlet->cone_apex, &apex.x, sizeof(meshlet->cone_apex));
+	memcpy(meshlet->cone_axis, &axis.x, sizeof(meshlet->cone_axis));
+	meshlet->cone_cutoff = sqrtf(1 - min_dot * min_dot);
+}
+
+
+int cullMeshlets(const Meshlet* meshlets, int meshlet_count, const Frustum& frustum,
+	const glm::vec3& camera_position, std::vector<MeshletDraw>* draws)
+{
+	int visible = 0;
+	uint32_t run_end = UINT32_MAX;
+	for (int i = 0; i < meshlet_count; ++i)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		if (!frustum.intersectsSphere(glm::vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2]), meshlet.radius))
+		{
+			continue;
+		}
+		if (meshlet.cone_cutoff < 1)
+		{
+			glm::vec3 view = glm::vec3(meshlet.cone_apex[0], meshlet.cone_apex[1], meshlet.cone_apex[2]) - camera_position;
+			glm::vec3 axis(meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2]);
+			if (glm::dot(view, axis) >= meshlet.cone_cutoff * glm::length(view)) continue;
+		}
+
+		++visible;
+		uint32_t index_count = meshlet.triangle_count * 3;
+		if (meshlet.index_offset == run_end) draws->back().index_count += index_count;
+		else draws->push_back({meshlet.index_offset, index_count});
+		run_end = meshlet.index_offset + index_count;
+	}
+	return visible;
+}
@@ -0,0 +1,296 @@
+#include "occlusion-culler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// A tile is one parallel job; its width is a multiple of every LANES, so the vector stores
+// of a tile never touch the pixels of its neighbour.
+const int TILE_WIDTH = 64;
+const int TILE_HEIGHT = 32;
+// rows are padded to this many pixels so a vector never runs past the end of one
+const int ROW_ALIGNMENT = 8;
+// triangles smaller than this many square pixels hide nothing worth the setup
+const float MIN_AREA = 1e-6f;
+// boxes are tested on the coarsest level at which they span at most this many texels
+const int TEST_SPAN = 4;
+// edge functions are only as precise as the coordinates they start from, triangles with
+// vertices further off screen than this are left out rather than drawn a bit too large
+const float MAX_PIXEL_COORDINATE = 1 << 20;
+
+// A row of LANES pixels per register, helpers from simd.hpp.
+using namespace simd;
+
+inline glm::vec3 getPosition(const float* positions, size_t stride, int vertex)
+{
+	const float* p = (const float*)((const uint8_t*)positions + stride * vertex);
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+inline bool reachesNearPlane(const glm::vec4& clip)
+{
+	return clip.w <= 0 || clip.z < -clip.w;
+}
+
+} // anonymous namespace
+
+
+void OcclusionCuller::resize(int width, int height)
+{
+	this->width = std::max(width, 1);
+	this->height = std::max(height, 1);
+	tiles_x = (this->width + TILE_WIDTH - 1) / TILE_WIDTH;
+	tiles_y = (this->height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	bins.assign(tiles_x * tiles_y, std::vector<uint32_t>());
+
+	levels.clear();
+	int level_width = this->width, level_height = this->height;
+	while (true)
+	{
+		Level level;
+		level.width = level_width;
+		level.height = level_height;
+		level.pitch = levels.empty() ? (level_width + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT : level_width;
+		level.depth.assign((size_t)level.pitch * level_height, 1.0f);
+		levels.push_back(std::move(level));
+		if (level_width == 1 && level_height == 1) break;
+		level_width = (level_width + 1) / 2;
+		level_height = (level_height + 1) / 2;
+	}
+}
+
+
+void OcclusionCuller::begin(const glm::mat4& view_projection)
+{
+	if (levels.empty()) resize(256, 128);
+	this->view_projection = view_projection;
+	triangles.clear();
+}
+
+
+// Everything per triangle that does not depend on the pixel happens here, once: the
+// rasterizer only evaluates planes.
+void OcclusionCuller::addOccluder(const int* indices, int index_count, const float* positions,
+	size_t position_stride, int vertex_count, const glm::mat4& model)
+{
+	TRACE_ZONE("OcclusionCuller::addOccluder");
+	glm::mat4 matrix = view_projection * model;
+	clip_positions.resize(vertex_count);
+	for (int v = 0; v < vertex_count; ++v) clip_positions[v] = matrix * glm::vec4(getPosition(positions, position_stride, v), 1.0f);
+
+	for (int i = 0; i + 2 < index_count; i += 3)
+	{
+		const glm::vec4* clip[3] = {&clip_positions[indices[i]], &clip_positions[indices[i + 1]], &clip_positions[indices[i + 2]]};
+		if (reachesNearPlane(*clip[0]) || reachesNearPlane(*clip[1]) || reachesNearPlane(*clip[2])) continue;
+
+		// pixel coordinates, y up like NDC, and depth in [0, 1]
+		glm::vec3 p[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			float inv_w = 1.0f / clip[k]->w;
+			p[k] = glm::vec3((clip[k]->x * inv_w * 0.5f + 0.5f) * width, (clip[k]->y * inv_w * 0.5f + 0.5f) * height,
+				clip[k]->z * inv_w * 0.5f + 0.5f);
+		}
+		bool in_range = true;
+		for (int k = 0; k < 3; ++k) in_range &= fabsf(p[k].x) < MAX_PIXEL_COORDINATE && fabsf(p[k].y) < MAX_PIXEL_COORDINATE;
+		if (!in_range) continue;
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+		if (!(fabsf(area) > MIN_AREA)) continue;
+		// either facing hides what is behind it; counter-clockwise keeps the inside positive
+		if (area < 0)
+		{
+			std::swap(p[1], p[2]);
+			area = -area;
+		}
+
+		Triangle triangle;
+		// pixel centers are at +0.5, the first and last ones that can be inside
+		triangle.min_x = std::max(0, (int)ceilf(std::min(std::min(p[0].x, p[1].x), p[2].x) - 0.5f));
+		triangle.min_y = std::max(0, (int)ceilf(std::min(std::min(p[0].y, p[1].y), p[2].y) - 0.5f));
+		triangle.max_x = std::min(width - 1, (int)floorf(std::max(std::max(p[0].x, p[1].x), p[2].x) - 0.5f));
+		triangle.max_y = std::min(height - 1, (int)floorf(std::max(std::max(p[0].y, p[1].y), p[2].y) - 0.5f));
+		triangle.depth_max = std::max(std::max(p[0].z, p[1].z), p[2].z);
+		if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y
+			|| std::min(std::min(p[0].z, p[1].z), p[2].z) > 1.0f)
+		{
+			continue;
+		}
+
+		// written so that the neighbour sharing an edge, which walks it the other way, gets
+		// exactly the negated coefficients: a pixel center on the edge then rounds inside
+		// at least one of the two and meshes rasterize without cracks
+		for (int k = 0; k < 3; ++k)
+		{
+			const glm::vec3& from = p[k];
+			const glm::vec3& to = p[(k + 1) % 3];
+			triangle.edge_a[k] = from.y - to.y;
+			triangle.edge_b[k] = to.x - from.x;
+			triangle.edge_c[k] = from.x * to.y - to.x * from.y;
+		}
+		// the plane gives the depth at the pixel center; anywhere else on the pixel the
+		// triangle can be up to half a pixel's slope further away, and occluders must
+		// never claim to be nearer than they are
+		float dz1 = p[1].z - p[0].z, dz2 = p[2].z - p[0].z;
+		triangle.depth_x = (dz1 * (p[2].y - p[0].y) - dz2 * (p[1].y - p[0].y)) / area;
+		triangle.depth_y = (dz2 * (p[1].x - p[0].x) - dz1 * (p[2].x - p[0].x)) / area;
+		triangle.depth_c = p[0].z - triangle.depth_x * p[0].x - triangle.depth_y * p[0].y
+			+ 0.5f * (fabsf(triangle.depth_x) + fabsf(triangle.depth_y));
+		triangles.push_back(triangle);
+	}
+}
+
+
+void OcclusionCuller::rasterize(int max_threads)
+{
+	TRACE_ZONE("OcclusionCuller::rasterize");
+	if (levels.empty()) resize(256, 128);
+	for (std::vector<uint32_t>& bin : bins) bin.clear();
+	for (uint32_t t = 0; t < (uint32_t)triangles.size(); ++t)
+	{
+		const Triangle& triangle = triangles[t];
+		for (int y = triangle.min_y / TILE_HEIGHT; y <= triangle.max_y / TILE_HEIGHT; ++y)
+		{
+			for (int x = triangle.min_x / TILE_WIDTH; x <= triangle.max_x / TILE_WIDTH; ++x) bins[y * tiles_x + x].push_back(t);
+		}
+	}
+
+	parallelFor(tiles_x * tiles_y, max_threads, [this](int tile) { rasterizeTile(tile); });
+	buildHierarchy();
+}
+
+
+// Clears the tile and draws its bin, a row of LANES pixels at a time: the three edge
+// functions and the depth plane are evaluated for every pixel center of the row and
+// the nearer depth is kept where all edges are non-negative.
+void OcclusionCuller::rasterizeTile(int tile)
+{
+	Level& target = levels[0];
+	int tile_x0 = tile % tiles_x * TILE_WIDTH;
+	int tile_y0 = tile / tiles_x * TILE_HEIGHT;
+	int tile_x1 = std::min(tile_x0 + TILE_WIDTH, target.pitch) - 1;
+	int tile_y1 = std::min(tile_y0 + TILE_HEIGHT, height) - 1;
+	for (int y = tile_y0; y <= tile_y1; ++y)
+	{
+		float* row = &target.depth[(size_t)y * target.pitch];
+		std::fill(row + tile_x0, row + tile_x1 + 1, 1.0f);
+	}
+
+	Lanes centers = add(laneOffsets(), splat(0.5f));
+	Lanes zero = splat(0.0f);
+	for (uint32_t t : bins[tile])
+	{
+		const Triangle& triangle = triangles[t];
+		int x0 = std::max(triangle.min_x, tile_x0);
+		int x1 = std::min(triangle.max_x, tile_x1);
+		int y0 = std::max(triangle.min_y, tile_y0);
+		int y1 = std::min(triangle.max_y, tile_y1);
+		// the first vector starts aligned to the tile, lanes left and right of the
+		// triangle's bounds are masked off
+		int first_x = x0 - (x0 - tile_x0) % LANES;
+		Lanes a0 = splat(triangle.edge_a[0]), a1 = splat(triangle.edge_a[1]), a2 = splat(triangle.edge_a[2]);
+		Lanes depth_x = splat(triangle.depth_x);
+		Lanes depth_max = splat(triangle.depth_max);
+		Lanes left = splat((float)x0), right = splat((float)(x1 + 1));
+		for (int y = y0; y <= y1; ++y)
+		{
+			float center_y = y + 0.5f;
+			Lanes c0 = splat(triangle.edge_b[0] * center_y + triangle.edge_c[0]);
+			Lanes c1 = splat(triangle.edge_b[1] * center_y + triangle.edge_c[1]);
+			Lanes c2 = splat(triangle.edge_b[2] * center_y + triangle.edge_c[2]);
+			Lanes depth_c = splat(triangle.depth_y * center_y + triangle.depth_c);
+			float* row = &target.depth[(size_t)y * target.pitch];
+			for (int x = first_x; x <= x1; x += LANES)
+			{
+				Lanes center_x = add(splat((float)x), centers);
+				Mask inside = maskAnd(greaterEqual(center_x, left), less(center_x, right));
+				inside = maskAnd(inside, greaterEqual(add(mul(a0, center_x), c0), zero));
+				inside = maskAnd(inside, greaterEqual(add(mul(a1, center_x), c1), zero));
+				inside = maskAnd(inside, greaterEqual(add(mul(a2, center_x), c2), zero));
+				Lanes depth = min(add(mul(depth_x, center_x), depth_c), depth_max);
+				Lanes old = load(row + x);
+				store(row + x, select(inside, min(old, depth), old));
+			}
+		}
+	}
+}
+
+
+void OcclusionCuller::buildHierarchy()
+{
+	TRACE_ZONE("OcclusionCuller::buildHierarchy");
+	for (size_t l = 1; l < levels.size(); ++l)
+	{
+		const Level& below = levels[l - 1];
+		Level& level = levels[l];
+		for (int y = 0; y < level.height; ++y)
+		{
+			// an odd row or column at the edge has no partner, it is taken twice
+			const float* row0 = &below.depth[(size_t)(y * 2) * below.pitch];
+			const float* row1 = &below.depth[(size_t)std::min(y * 2 + 1, below.height - 1) * below.pitch];
+			float* out = &level.depth[(size_t)y * level.pitch];
+			for (int x = 0; x < level.width; ++x)
+			{
+				int x0 = x * 2, x1 = std::min(x * 2 + 1, below.width - 1);
+				out[x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+
+// The nearest corner of the box against the farthest occluder depth over the pixels its
+// screen rectangle touches, read from the level where that is only a few texels.
+bool OcclusionCuller::isVisible(const CPM_GLM_AABB_NS::AABB& box) const
+{
+	if (box.isNull()) return false;
+	if (levels.empty()) return true;
+	glm::vec3 min = box.getMin(), max = box.getMax();
+	glm::vec3 screen_min(INFINITY), screen_max(-INFINITY);
+	int behind = 0;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec4 p(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z, 1.0f);
+		glm::vec4 clip = view_projection * p;
+		if (reachesNearPlane(clip))
+		{
+			++behind;
+			continue;
+		}
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		screen_min = glm::min(screen_min, ndc);
+		screen_max = glm::max(screen_max, ndc);
+	}
+	// a box across the near plane has no rectangle on screen
+	if (behind) return behind < 8;
+	if (screen_max.x < -1 || screen_min.x > 1 || screen_max.y < -1 || screen_min.y > 1 || screen_min.z > 1) return false;
+
+	int x0 = std::max(0, (int)floorf((screen_min.x * 0.5f + 0.5f) * width));
+	int y0 = std::max(0, (int)floorf((screen_min.y * 0.5f + 0.5f) * height));
+	int x1 = std::min(width - 1, (int)floorf((screen_max.x * 0.5f + 0.5f) * width));
+	int y1 = std::min(height - 1, (int)floorf((screen_max.y * 0.5f + 0.5f) * height));
+	float depth = screen_min.z * 0.5f + 0.5f;
+
+	int l = 0;
+	while (l + 1 < (int)levels.size() && std::max(x1 - x0, y1 - y0) >> l >= TEST_SPAN) ++l;
+	const Level& level = levels[l];
+	for (int y = y0 >> l; y <= y1 >> l; ++y)
+	{
+		const float* row = &level.depth[(size_t)y * level.pitch];
+		for (int x = x0 >> l; x <= x1 >> l; ++x)
+		{
+			if (depth <= row[x]) return true;
+		}
+	}
+	return false;
+}
+
+
+const char* OcclusionCuller::getISA()
+{
+	return ISA_NAME;
+}
@@ -0,0 +1,299 @@
+#include "pose-sampler.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+// A lane per instance; the kernel below poses LANES instances per batch, helpers from
+// simd.hpp.
+using namespace simd;
+
+// instances a worker takes at a time, whole batches
+const int INSTANCES_PER_JOB = 64;
+static_assert(INSTANCES_PER_JOB % LANES == 0, "jobs are made of whole batches");
+
+// model space transform of one bone in every instance of a batch
+struct alignas(32) BoneLanes
+{
+	float px[LANES], py[LANES], pz[LANES];
+	float rx[LANES], ry[LANES], rz[LANES], rw[LANES];
+};
+
+// the keys around each lane's frame for one bone, and how far between them the frame is
+struct alignas(32) KeyLanes
+{
+	float ax[LANES], ay[LANES], az[LANES], aw[LANES];
+	float bx[LANES], by[LANES], bz[LANES], bw[LANES];
+	float t[LANES];
+};
+
+// Last key at or before frame in [first, end), the one after it and the blend factor.
+// Past the last key both are the last one. The search is branchless: with every
+// instance at its own time the comparisons are coin flips to the branch predictor.
+inline void findKeys(const float* frames, uint32_t first, uint32_t end, float frame, uint32_t* a, uint32_t* b, float* t)
+{
+	const float* base = frames + first;
+	for (uint32_t n = end - first; n > 1;)
+	{
+		uint32_t half = n / 2;
+		base = base[half] <= frame ? base + half : base;
+		n -= half;
+	}
+	*a = (uint32_t)(base - frames);
+	*b = *a + 1 < end ? *a + 1 : *a;
+	float span = frames[*b] - frames[*a];
+	*t = span > 0 ? std::max(0.0f, std::min(1.0f, (frame - frames[*a]) / span)) : 0.0f;
+}
+
+// Samples every bone of LANES instances, parents before children, so each bone's
+// parent is in model space by the time the bone needs it. Lanes past count repeat
+// the last instance and are not written out.
+void sampleBatch(const PoseSkeleton& skeleton, const PoseInstance* instances, int count, BoneLanes* model,
+	BoneTransform* poses)
+{
+	int bone_count = skeleton.getBoneCount();
+	const PoseClip* clips[LANES];
+	float frames[LANES];
+	for (int lane = 0; lane < LANES; ++lane)
+	{
+		const PoseInstance& instance = instances[std::min(lane, count - 1)];
+		clips[lane] = instance.clip;
+		frames[lane] = std::max(0.0f, std::min(instance.time, instance.clip->getDuration())) * instance.clip->frame_rate;
+	}
+
+	const Lanes one = splat(1.0f);
+	KeyLanes keys;
+	for (int bone = 0; bone < bone_count; ++bone)
+	{
+		for (int lane = 0; lane < LANES; ++lane)
+		{
+			const PoseClip& clip = *clips[lane];
+			uint32_t a, b;
+			findKeys(clip.translation_frames.data(), clip.translation_first[bone], clip.translation_first[bone + 1],
+				frames[lane], &a, &b, &keys.t[lane]);
+			keys.ax[lane] = clip.translation_x[a];
+			keys.ay[lane] = clip.translation_y[a];
+			keys.az[lane] = clip.translation_z[a];
+			keys.bx[lane] = clip.translation_x[b];
+			keys.by[lane] = clip.translation_y[b];
+			keys.bz[lane] = clip.translation_z[b];
+		}
+		Lanes t = loadAligned(keys.t);
+		Lanes ax = loadAligned(keys.ax), ay = loadAligned(keys.ay), az = loadAligned(keys.az);
+		Lanes px = madd(sub(loadAligned(keys.bx), ax), t, ax);
+		Lanes py = madd(sub(loadAligned(keys.by), ay), t, ay);
+		Lanes pz = madd(sub(loadAligned(keys.bz), az), t, az);
+
+		for (int lane = 0; lane < LANES; ++lane)
+		{
+			const PoseClip& clip = *clips[lane];
+			uint32_t a, b;
+			findKeys(clip.rotation_frames.data(), clip.rotation_first[bone], clip.rotation_first[bone + 1],
+				frames[lane], &a, &b, &keys.t[lane]);
+			keys.ax[lane] = clip.rotation_x[a];
+			keys.ay[lane] = clip.rotation_y[a];
+			keys.az[lane] = clip.rotation_z[a];
+			keys.aw[lane] = clip.rotation_w[a];
+			keys.bx[lane] = clip.rotation_x[b];
+			keys.by[lane] = clip.rotation_y[b];
+			keys.bz[lane] = clip.rotation_z[b];
+			keys.bw[lane] = clip.rotation_w[b];
+		}
+		// nlerp, along the shorter arc: b is negated where the keys point apart
+		t = loadAligned(keys.t);
+		ax = loadAligned(keys.ax);
+		ay = loadAligned(keys.ay);
+		az = loadAligned(keys.az);
+		Lanes aw = loadAligned(keys.aw);
+		Lanes bx = loadAligned(keys.bx), by = loadAligned(keys.by), bz = loadAligned(keys.bz), bw = loadAligned(keys.bw);
+		Lanes d = madd(ax, bx, madd(ay, by, madd(az, bz, mul(aw, bw))));
+		Lanes tb = flipSign(t, d);
+		Lanes ta = sub(one, t);
+		Lanes rx = madd(ta, ax, mul(tb, bx));
+		Lanes ry = madd(ta, ay, mul(tb, by));
+		Lanes rz = madd(ta, az, mul(tb, bz));
+		Lanes rw = madd(ta, aw, mul(tb, bw));
+		Lanes inv_len = div(one, sqrt(max(madd(rx, rx, madd(ry, ry, madd(rz, rz, mul(rw, rw)))), splat(FLT_MIN))));
+		rx = mul(rx, inv_len);
+		ry = mul(ry, inv_len);
+		rz = mul(rz, inv_len);
+		rw = mul(rw, inv_len);
+
+		BoneLanes& out = model[bone];
+		int parent = skeleton.parents[bone];
+		if (parent >= 0)
+		{
+			const BoneLanes& p = model[parent];
+			Lanes qx = loadAligned(p.rx), qy = loadAligned(p.ry), qz = loadAligned(p.rz), qw = loadAligned(p.rw);
+			// position: parent position + parent rotation * local position,
+			// v' = v + w * c + q x c with c = 2 * q x v
+			Lanes cx = mul(splat(2.0f), sub(mul(qy, pz), mul(qz, py)));
+			Lanes cy = mul(splat(2.0f), sub(mul(qz, px), mul(qx, pz)));
+			Lanes cz = mul(splat(2.0f), sub(mul(qx, py), mul(qy, px)));
+			Lanes mx = add(madd(qw, cx, px), sub(mul(qy, cz), mul(qz, cy)));
+			Lanes my = add(madd(qw, cy, py), sub(mul(qz, cx), mul(qx, cz)));
+			Lanes mz = add(madd(qw, cz, pz), sub(mul(qx, cy), mul(qy, cx)));
+			px = add(loadAligned(p.px), mx);
+			py = add(loadAligned(p.py), my);
+			pz = add(loadAligned(p.pz), mz);
+			// rotation: parent rotation * local rotation
+			Lanes mrx = add(sub(madd(qw, rx, mul(qx, rw)), mul(qz, ry)), mul(qy, rz));
+			Lanes mry = add(sub(madd(qw, ry, mul(qy, rw)), mul(qx, rz)), mul(qz, rx));
+			Lanes mrz = add(sub(madd(qw, rz, mul(qz, rw)), mul(qy, rx)), mul(qx, ry));
+			Lanes mrw = sub(mul(qw, rw), madd(qx, rx, madd(qy, ry, mul(qz, rz))));
+			rx = mrx;
+			ry = mry;
+			rz = mrz;
+			rw = mrw;
+		}
+		storeAligned(out.px, px);
+		storeAligned(out.py, py);
+		storeAligned(out.pz, pz);
+		storeAligned(out.rx, rx);
+		storeAligned(out.ry, ry);
+		storeAligned(out.rz, rz);
+		storeAligned(out.rw, rw);
+
+		BoneTransform* dst = poses + bone;
+		for (int lane = 0; lane < count; ++lane, dst += bone_count)
+		{
+			dst->rotation[0] = out.rx[lane];
+			dst->rotation[1] = out.ry[lane];
+			dst->rotation[2] = out.rz[lane];
+			dst->rotation[3] = out.rw[lane];
+			dst->position[0] = out.px[lane];
+			dst->position[1] = out.py[lane];
+			dst->position[2] = out.pz[lane];
+		}
+	}
+}
+
+} // anonymous namespace
+
+
+PoseSkeleton makePoseSkeleton(const FBXImporter& importer)
+{
+	PoseSkeleton skeleton;
+	int bone_count = (int)importer.bones.size();
+	skeleton.parents.resize(bone_count);
+	skeleton.rest_pose.resize(bone_count * 7);
+	for (int i = 0; i < bone_count; ++i)
+	{
+		const ofbx::Object& bone = *importer.bones[i];
+		skeleton.parents[i] = importer.getBoneIndex(bone.getParent());
+		glm::vec3 pos;
+		glm::quat rot;
+		importer.getBoneLocalTransform(bone, bone.getLocalTranslation(), bone.getLocalRotation(), &pos, &rot);
+		float* rest = &skeleton.rest_pose[i * 7];
+		rest[0] = pos.x;
+		rest[1] = pos.y;
+		rest[2] = pos.z;
+		rest[3] = rot.x;
+		rest[4] = rot.y;
+		rest[5] = rot.z;
+		rest[6] = rot.w;
+	}
+	return skeleton;
+}
+
+
+PoseClip makePoseClip(const FBXImporter::AnimationClip& clip, const PoseSkeleton& skeleton)
+{
+	PoseClip result;
+	result.frame_rate = clip.frame_rate;
+	result.frame_count = clip.frame_count;
+
+	int bone_count = skeleton.getBoneCount();
+	std::vector<const FBXImporter::BoneTrack*> tracks(bone_count, nullptr);
+	for (const FBXImporter::BoneTrack& track : clip.tracks)
+	{
+		if (track.bone >= 0 && track.bone < bone_count) tracks[track.bone] = &track;
+	}
+
+	result.translation_first.reserve(bone_count + 1);
+	result.rotation_first.reserve(bone_count + 1);
+	for (int bone = 0; bone < bone_count; ++bone)
+	{
+		const float* rest = &skeleton.rest_pose[bone * 7];
+		const FBXImporter::BoneTrack* track = tracks[bone];
+
+		result.translation_first.push_back((uint32_t)result.translation_frames.size());
+		if (track && !track->translations.empty())
+		{
+			for (const FBXImporter::TranslationKey& key : track->translations)
+			{
+				result.translation_frames.push_back(key.frame);
+				result.translation_x.push_back(key.pos.x);
+				result.translation_y.push_back(key.pos.y);
+				result.translation_z.push_back(key.pos.z);
+			}
+		}
+		else
+		{
+			result.translation_frames.push_back(0);
+			result.translation_x.push_back(rest[0]);
+			result.translation_y.push_back(rest[1]);
+			result.translation_z.push_back(rest[2]);
+		}
+
+		result.rotation_first.push_back((uint32_t)result.rotation_frames.size());
+		if (track && !track->rotations.empty())
+		{
+			for (const FBXImporter::PackedRotationKey& key : track->rotations)
+			{
+				glm::quat rot = unpackQuat(key.rot);
+				result.rotation_frames.push_back(key.frame);
+				result.rotation_x.push_back(rot.x);
+				result.rotation_y.push_back(rot.y);
+				result.rotation_z.push_back(rot.z);
+				result.rotation_w.push_back(rot.w);
+			}
+		}
+		else
+		{
+			result.rotation_frames.push_back(0);
+			result.rotation_x.push_back(rest[3]);
+			result.rotation_y.push_back(rest[4]);
+			result.rotation_z.push_back(rest[5]);
+			result.rotation_w.push_back(rest[6]);
+		}
+	}
+	result.translation_first.push_back((uint32_t)result.translation_frames.size());
+	result.rotation_first.push_back((uint32_t)result.rotation_frames.size());
+	return result;
+}
+
+
+void samplePoses(const PoseSkeleton& skeleton, const PoseInstance* instances, int instance_count,
+	BoneTransform* poses, int max_threads)
+{
+	TRACE_ZONE("samplePoses");
+	int bone_count = skeleton.getBoneCount();
+	if (bone_count == 0 || instance_count <= 0) return;
+
+	int job_count = (instance_count + INSTANCES_PER_JOB - 1) / INSTANCES_PER_JOB;
+	parallelFor(job_count, max_threads, [&](int job) {
+		// the batch's model space bones, kept by the worker for its next jobs
+		static thread_local std::vector<float> scratch;
+		scratch.resize(bone_count * sizeof(BoneLanes) / sizeof(float) + alignof(BoneLanes) / sizeof(float));
+		BoneLanes* model = (BoneLanes*)(((uintptr_t)scratch.data() + alignof(BoneLanes) - 1) & ~(uintptr_t)(alignof(BoneLanes) - 1));
+
+		int first = job * INSTANCES_PER_JOB;
+		int end = std::min(first + INSTANCES_PER_JOB, instance_count);
+		for (int batch = first; batch < end; batch += LANES)
+		{
+			sampleBatch(skeleton, instances + batch, std::min(LANES, end - batch), model, poses + (size_t)batch * bone_count);
+		}
+	});
+}
+
+
+const char* getPoseSamplerISA()
+{
+	return ISA_NAME;
+}
@@ -0,0 +1,405 @@
+#include "scene-bvh.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+const int BIN_COUNT = 16;
+const int MAX_LEAF_SIZE = 4;
+// in box tests: visiting an inner node tests both children, a leaf one box per object
+const float TRAVERSAL_COST = 2.0f;
+// past this depth nodes split at the object median, which halves them every level,
+// so the traversal stacks below never overflow
+const int SAH_MAX_DEPTH = 32;
+const int MAX_STACK = 64;
+
+inline float getHalfArea(const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+struct Bin
+{
+	glm::vec3 min = glm::vec3(INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+	int count = 0;
+};
+
+// what the partitions move around, kept together so every pass reads memory in order
+struct BuildItem
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec3 centroid;
+	int object;
+};
+
+struct BuildTask
+{
+	uint32_t node;
+	uint32_t begin;
+	uint32_t end;
+	int depth;
+};
+
+} // anonymous namespace
+
+
+// Binned SAH (Wald 2007): centroids are sorted into bins along the longest axis of their
+// bounds and the split with the lowest area times count on both sides wins, unless a
+// leaf is cheaper. Nodes cover contiguous runs of items that are partitioned in place.
+void SceneBVH::build(const CPM_GLM_AABB_NS::AABB* boxes, int count)
+{
+	TRACE_ZONE("SceneBVH::build");
+	nodes.clear();
+	parents.clear();
+	slot_objects.clear();
+	slot_boxes.clear();
+	slot_leaves.clear();
+	object_slots.assign(count, UINT32_MAX);
+	depth = 0;
+
+	std::vector<BuildItem> items;
+	items.reserve(count);
+	for (int i = 0; i < count; ++i)
+	{
+		if (boxes[i].isNull()) continue;
+		BuildItem item;
+		item.min = boxes[i].getMin();
+		item.max = boxes[i].getMax();
+		item.centroid = (item.min + item.max) * 0.5f;
+		item.object = i;
+		items.push_back(item);
+	}
+	uint32_t slot_count = (uint32_t)items.size();
+	if (!slot_count) return;
+
+	nodes.reserve(slot_count * 2 / MAX_LEAF_SIZE + 1);
+	nodes.push_back(Node());
+	parents.push_back(UINT32_MAX);
+	std::vector<BuildTask> tasks;
+	tasks.push_back({0, 0, slot_count, 1});
+	while (!tasks.empty())
+	{
+		BuildTask task = tasks.back();
+		tasks.pop_back();
+		depth = std::max(depth, task.depth);
+		uint32_t task_count = task.end - task.begin;
+
+		glm::vec3 min(INFINITY), max(-INFINITY), centroid_min(INFINITY), centroid_max(-INFINITY);
+		for (uint32_t i = task.begin; i < task.end; ++i)
+		{
+			min = glm::min(min, items[i].min);
+			max = glm::max(max, items[i].max);
+			centroid_min = glm::min(centroid_min, items[i].centroid);
+			centroid_max = glm::max(centroid_max, items[i].centroid);
+		}
+		nodes[task.node].min = min;
+		nodes[task.node].max = max;
+
+		glm::vec3 extent = centroid_max - centroid_min;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		uint32_t split = task.begin;
+		if (task_count > 1 && extent[axis] > 0)
+		{
+			if (task.depth >= SAH_MAX_DEPTH)
+			{
+				split = task.begin + task_count / 2;
+				std::nth_element(items.begin() + task.begin, items.begin() + split, items.begin() + task.end,
+					[&](const BuildItem& a, const BuildItem& b) { return a.centroid[axis] < b.centroid[axis]; });
+			}
+			else
+			{
+				Bin bins[BIN_COUNT];
+				float scale = BIN_COUNT / extent[axis];
+				auto getBin = [&](const BuildItem& item) {
+					return std::min(BIN_COUNT - 1, (int)((item.centroid[axis] - centroid_min[axis]) * scale));
+				};
+				for (uint32_t i = task.begin; i < task.end; ++i)
+				{
+					Bin& bin = bins[getBin(items[i])];
+					bin.min = glm::min(bin.min, items[i].min);
+					bin.max = glm::max(bin.max, items[i].max);
+					++bin.count;
+				}
+
+				// right to left sweep first, then the left to right one evaluates every split
+				float right_cost[BIN_COUNT];
+				Bin right;
+				for (int b = BIN_COUNT - 1; b > 0; --b)
+				{
+					right.min = glm::min(right.min, bins[b].min);
+					right.max = glm::max(right.max, bins[b].max);
+					right.count += bins[b].count;
+					right_cost[b] = right.count ? getHalfArea(right.min, right.max) * right.count : 0.0f;
+				}
+				Bin left;
+				float best_cost = INFINITY;
+				int best_bin = 0;
+				for (int b = 1; b < BIN_COUNT; ++b)
+				{
+					left.min = glm::min(left.min, bins[b - 1].min);
+					left.max = glm::max(left.max, bins[b - 1].max);
+					left.count += bins[b - 1].count;
+					float cost = (left.count ? getHalfArea(left.min, left.max) * left.count : 0.0f) + right_cost[b];
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_bin = b;
+					}
+				}
+
+				float area = getHalfArea(min, max);
+				float leaf_cost = (float)task_count;
+				float split_cost = TRAVERSAL_COST + (area > 0 ? best_cost / area : (float)task_count);
+				if (task_count > MAX_LEAF_SIZE || split_cost < leaf_cost)
+				{
+					split = (uint32_t)(std::partition(items.begin() + task.begin, items.begin() + task.end,
+						[&](const BuildItem& item) { return getBin(item) < best_bin; }) - items.begin());
+				}
+			}
+		}
+		else if (task_count > MAX_LEAF_SIZE)
+		{
+			// every centroid in one spot, any split is as good as another
+			split = task.begin + task_count / 2;
+		}
+
+		if (split == task.begin || split == task.end)
+		{
+			if (task_count <= MAX_LEAF_SIZE)
+			{
+				nodes[task.node].first = task.begin;
+				nodes[task.node].count = task_count;
+				continue;
+			}
+			split = task.begin + task_count / 2;
+		}
+
+		uint32_t left = (uint32_t)nodes.size();
+		nodes[task.node].first = left;
+		nodes[task.node].count = 0;
+		nodes.resize(nodes.size() + 2);
+		parents.push_back(task.node);
+		parents.push_back(task.node);
+		tasks.push_back({left + 1, split, task.end, task.depth + 1});
+		tasks.push_back({left, task.begin, split, task.depth + 1});
+	}
+
+	// the items ended up in tree order, every leaf owns adjacent slots
+	slot_objects.resize(slot_count);
+	slot_boxes.resize(slot_count);
+	slot_leaves.resize(slot_count);
+	for (uint32_t i = 0; i < slot_count; ++i)
+	{
+		slot_objects[i] = items[i].object;
+		slot_boxes[i] = {items[i].min, items[i].max};
+		object_slots[items[i].object] = i;
+	}
+	for (uint32_t n = 0; n < nodes.size(); ++n)
+	{
+		if (!nodes[n].count) continue;
+		for (uint32_t i = 0; i < nodes[n].count; ++i) slot_leaves[nodes[n].first + i] = n;
+	}
+}
+
+
+void SceneBVH::refitNode(uint32_t node_index)
+{
+	Node& node = nodes[node_index];
+	if (node.count)
+	{
+		node.min = slot_boxes[node.first].min;
+		node.max = slot_boxes[node.first].max;
+		for (uint32_t i = 1; i < node.count; ++i)
+		{
+			node.min = glm::min(node.min, slot_boxes[node.first + i].min);
+			node.max = glm::max(node.max, slot_boxes[node.first + i].max);
+		}
+	}
+	else
+	{
+		node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+		node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+	}
+}
+
+
+// Walks up from the object's leaf and stops at the first node whose box did not change,
+// everything above it is still valid.
+void SceneBVH::updateObject(int object, const CPM_GLM_AABB_NS::AABB& box)
+{
+	uint32_t slot = object_slots[object];
+	if (slot == UINT32_MAX || box.isNull()) return;
+	slot_boxes[slot] = {box.getMin(), box.getMax()};
+	for (uint32_t node = slot_leaves[slot]; node != UINT32_MAX; node = parents[node])
+	{
+		glm::vec3 min = nodes[node].min;
+		glm::vec3 max = nodes[node].max;
+		refitNode(node);
+		if (nodes[node].min == min && nodes[node].max == max) break;
+	}
+}
+
+
+void SceneBVH::refit(const CPM_GLM_AABB_NS::AABB* boxes)
+{
+	TRACE_ZONE("SceneBVH::refit");
+	for (uint32_t slot = 0; slot < slot_objects.size(); ++slot)
+	{
+		const CPM_GLM_AABB_NS::AABB& box = boxes[slot_objects[slot]];
+		if (!box.isNull()) slot_boxes[slot] = {box.getMin(), box.getMax()};
+	}
+	// children come after their parent
+	for (size_t n = nodes.size(); n-- > 0;) refitNode((uint32_t)n);
+}
+
+
+// Every stack entry carries the planes its box still straddles: a node inside a plane
+// passes it on to its whole subtree, and a node inside all of them is taken in full.
+void SceneBVH::queryFrustum(const Frustum& frustum, std::vector<int>* objects) const
+{
+	if (nodes.empty()) return;
+	// -1 outside a plane, 0 straddling it, 1 inside
+	auto classify = [&](const glm::vec3& min, const glm::vec3& max, int plane_index) {
+		const glm::vec4& plane = frustum.planes[plane_index];
+		glm::vec3 far(plane.x >= 0 ? max.x : min.x, plane.y >= 0 ? max.y : min.y, plane.z >= 0 ? max.z : min.z);
+		glm::vec3 near(plane.x >= 0 ? min.x : max.x, plane.y >= 0 ? min.y : max.y, plane.z >= 0 ? min.z : max.z);
+		if (glm::dot(glm::vec3(plane), far) + plane.w < 0) return -1;
+		return glm::dot(glm::vec3(plane), near) + plane.w >= 0 ? 1 : 0;
+	};
+
+	uint32_t stack[MAX_STACK];
+	uint32_t masks[MAX_STACK];
+	int stack_size = 0;
+	stack[stack_size] = 0;
+	masks[stack_size++] = 0x3f;
+	while (stack_size)
+	{
+		--stack_size;
+		const Node& node = nodes[stack[stack_size]];
+		uint32_t mask = masks[stack_size];
+		bool outside = false;
+		for (int p = 0; p < 6 && mask; ++p)
+		{
+			if (!(mask & (1u << p))) continue;
+			int side = classify(node.min, node.max, p);
+			if (side < 0)
+			{
+				outside = true;
+				break;
+			}
+			if (side > 0) mask &= ~(1u << p);
+		}
+		if (outside) continue;
+
+		if (!node.count)
+		{
+			stack[stack_size] = node.first + 1;
+			masks[stack_size++] = mask;
+			stack[stack_size] = node.first;
+			masks[stack_size++] = mask;
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; ++i)
+		{
+			bool visible = true;
+			for (int p = 0; p < 6 && visible; ++p)
+			{
+				if (mask & (1u << p)) visible = classify(slot_boxes[i].min, slot_boxes[i].max, p) >= 0;
+			}
+			if (visible) objects->push_back(slot_objects[i]);
+		}
+	}
+}
+
+
+void SceneBVH::queryBox(const CPM_GLM_AABB_NS::AABB& box, std::vector<int>* objects) const
+{
+	if (nodes.empty() || box.isNull()) return;
+	glm::vec3 min = box.getMin();
+	glm::vec3 max = box.getMax();
+	auto overlaps = [&](const glm::vec3& node_min, const glm::vec3& node_max) {
+		return node_min.x <= max.x && node_max.x >= min.x
+			&& node_min.y <= max.y && node_max.y >= min.y
+			&& node_min.z <= max.z && node_max.z >= min.z;
+	};
+
+	uint32_t stack[MAX_STACK];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size)
+	{
+		const Node& node = nodes[stack[--stack_size]];
+		if (!overlaps(node.min, node.max)) continue;
+		if (!node.count)
+		{
+			stack[stack_size++] = node.first + 1;
+			stack[stack_size++] = node.first;
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; ++i)
+		{
+			if (overlaps(slot_boxes[i].min, slot_boxes[i].max)) objects->push_back(slot_objects[i]);
+		}
+	}
+}
+
+
+// Slab test (Kay and Kajiya): the segment is inside the box between the largest entry
+// and the smallest exit over the three axes. A zero direction component gives infinite
+// slab distances, which fall out of the min and max unless the origin lies exactly on
+// the slab, where the NaN makes the comparison fail and the box is skipped.
+void SceneBVH::queryRay(const glm::vec3& origin, const glm::vec3& direction, float max_distance,
+	std::vector<int>* objects) const
+{
+	if (nodes.empty()) return;
+	glm::vec3 inverse = glm::vec3(1.0f) / direction;
+	auto intersects = [&](const glm::vec3& min, const glm::vec3& max) {
+		glm::vec3 t0 = (min - origin) * inverse;
+		glm::vec3 t1 = (max - origin) * inverse;
+		glm::vec3 t_min = glm::min(t0, t1);
+		glm::vec3 t_max = glm::max(t0, t1);
+		float enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.0f));
+		float exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_distance));
+		return enter <= exit;
+	};
+
+	uint32_t stack[MAX_STACK];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size)
+	{
+		const Node& node = nodes[stack[--stack_size]];
+		if (!intersects(node.min, node.max)) continue;
+		if (!node.count)
+		{
+			stack[stack_size++] = node.first + 1;
+			stack[stack_size++] = node.first;
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; ++i)
+		{
+			if (intersects(slot_boxes[i].min, slot_boxes[i].max)) objects->push_back(slot_objects[i]);
+		}
+	}
+}
+
+
+float SceneBVH::getCost() const
+{
+	if (nodes.empty()) return 0;
+	float root_area = getHalfArea(nodes[0].min, nodes[0].max);
+	if (root_area <= 0) return (float)slot_objects.size();
+	float cost = 0;
+	for (const Node& node : nodes)
+	{
+		float area = getHalfArea(node.min, node.max) / root_area;
+		cost += node.count ? area * node.count : area * TRAVERSAL_COST;
+	}
+	return cost;
+}
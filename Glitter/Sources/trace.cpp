@@ -0,0 +1,194 @@
+#include "trace.hpp"
+
+#ifdef GLITTER_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent
+{
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// Events go into fixed size chunks that never move, so the saving thread can
+// read a chunk while its owner keeps appending: the owner publishes each event
+// with a release store of count, the reader only looks below an acquired count.
+const int CHUNK_EVENTS = 16384;
+
+struct TraceChunk
+{
+	TraceEvent events[CHUNK_EVENTS];
+	std::atomic<int> count{0};
+	std::atomic<TraceChunk*> next{nullptr};
+};
+
+struct ThreadBuffer
+{
+	ThreadBuffer(int id) : thread_id(id), first(new TraceChunk), last(first) {}
+	~ThreadBuffer()
+	{
+		for (TraceChunk* chunk = first; chunk;)
+		{
+			TraceChunk* next = chunk->next.load(std::memory_order_relaxed);
+			delete chunk;
+			chunk = next;
+		}
+	}
+
+	int thread_id;
+	std::atomic<const char*> name{nullptr};
+	TraceChunk* first;
+	TraceChunk* last; // owner thread only
+};
+
+// Buffers outlive their threads, worker threads are often gone by the time the trace is
+// saved. A finished thread's buffer goes back to the pool and the next new thread appends
+// to it, so a parallelFor starting fresh workers every call does not add a buffer per
+// worker ever started; the events of both threads end up on one track, one after the other.
+struct TraceRegistry
+{
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> threads;
+	std::vector<ThreadBuffer*> free_buffers;
+};
+
+TraceRegistry& getRegistry()
+{
+	static TraceRegistry registry;
+	return registry;
+}
+
+// Hands the buffer back when its thread exits.
+struct ThreadBufferLease
+{
+	ThreadBuffer* buffer = nullptr;
+
+	~ThreadBufferLease()
+	{
+		if (!buffer) return;
+		TraceRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.free_buffers.push_back(buffer);
+	}
+};
+
+thread_local ThreadBufferLease t_lease;
+
+ThreadBuffer* getThreadBuffer()
+{
+	if (!t_lease.buffer)
+	{
+		TraceRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		if (!registry.free_buffers.empty())
+		{
+			t_lease.buffer = registry.free_buffers.back();
+			registry.free_buffers.pop_back();
+		}
+		else
+		{
+			registry.threads.emplace_back(new ThreadBuffer((int)registry.threads.size() + 1));
+			t_lease.buffer = registry.threads.back().get();
+		}
+	}
+	return t_lease.buffer;
+}
+
+
+void writeString(FILE* fp, const char* str)
+{
+	fputc('"', fp);
+	for (; *str; ++str)
+	{
+		if (*str == '"' || *str == '\\') fputc('\\', fp);
+		if ((unsigned char)*str >= 0x20) fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+} // anonymous namespace
+
+
+uint64_t traceNow()
+{
+	typedef std::chrono::steady_clock Clock;
+	static const Clock::time_point epoch = Clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+}
+
+
+void traceRecord(const char* name, uint64_t begin, uint64_t end)
+{
+	ThreadBuffer* buffer = getThreadBuffer();
+	TraceChunk* chunk = buffer->last;
+	int count = chunk->count.load(std::memory_order_relaxed);
+	if (count == CHUNK_EVENTS)
+	{
+		TraceChunk* next = new TraceChunk;
+		chunk->next.store(next, std::memory_order_release);
+		buffer->last = chunk = next;
+		count = 0;
+	}
+	TraceEvent& event = chunk->events[count];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	chunk->count.store(count + 1, std::memory_order_release);
+}
+
+
+void traceSetThreadName(const char* name)
+{
+	getThreadBuffer()->name.store(name, std::memory_order_release);
+}
+
+
+bool traceSave(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp) return false;
+
+	TraceRegistry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first_event = true;
+	for (const std::unique_ptr<ThreadBuffer>& thread : registry.threads)
+	{
+		const char* thread_name = thread->name.load(std::memory_order_acquire);
+		if (thread_name)
+		{
+			fprintf(fp, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+				first_event ? "" : ",\n", thread->thread_id);
+			writeString(fp, thread_name);
+			fprintf(fp, "}}");
+			first_event = false;
+		}
+
+		for (const TraceChunk* chunk = thread->first; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+		{
+			int count = chunk->count.load(std::memory_order_acquire);
+			for (int i = 0; i < count; ++i)
+			{
+				const TraceEvent& event = chunk->events[i];
+				// timestamps are microseconds, fractions keep sub-microsecond zones visible
+				fprintf(fp, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+					first_event ? "" : ",\n", thread->thread_id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+				writeString(fp, event.name);
+				fputc('}', fp);
+				first_event = false;
+			}
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	return fclose(fp) == 0;
+}
+
+#endif
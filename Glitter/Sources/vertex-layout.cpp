@@ -0,0 +1,74 @@
+#include "vertex-layout.hpp"
+
+#include <cassert>
+
+uint32_t VertexLayout::getMask() const
+{
+	uint32_t mask = 0;
+	for (int i = 0; i < VERTEX_ATTRIBUTE_COUNT; ++i)
+	{
+		if (attributes[i].components) mask |= 1u << i;
+	}
+	return mask;
+}
+
+
+void VertexLayout::add(VertexAttribute attribute, VertexComponentType type, int components, bool normalized)
+{
+	assert(!has(attribute));
+	assert(components > 0 && components <= 4);
+	VertexAttributeFormat& format = attributes[attribute];
+	format.type = type;
+	format.components = (uint8_t)components;
+	format.normalized = normalized;
+	format.offset = (uint16_t)stride;
+	// GL wants every attribute 4 byte aligned, odd sized ones get a padding component
+	stride += (uint32_t)((getVertexComponentSize(type) * components + 3) & ~(size_t)3);
+}
+
+
+size_t getVertexComponentSize(VertexComponentType type)
+{
+	switch (type)
+	{
+		case VertexComponentType::FLOAT32: return 4;
+		case VertexComponentType::FLOAT16: return 2;
+		case VertexComponentType::INT16: return 2;
+		case VertexComponentType::UINT16: return 2;
+		case VertexComponentType::UINT8: return 1;
+	}
+	assert(false);
+	return 0;
+}
+
+
+int getFloatVertexComponents(VertexAttribute attribute)
+{
+	switch (attribute)
+	{
+		case VERTEX_POSITION: return 3;
+		case VERTEX_NORMAL: return 3;
+		case VERTEX_TANGENT: return 3;
+		case VERTEX_COLOR: return 4;
+		case VERTEX_UV: return 2;
+		case VERTEX_JOINTS: return 4;
+		case VERTEX_WEIGHTS: return 4;
+		case VERTEX_ATTRIBUTE_COUNT: break;
+	}
+	assert(false);
+	return 0;
+}
+
+
+VertexLayout makeFloatVertexLayout(uint32_t mask)
+{
+	VertexLayout layout;
+	mask |= 1u << VERTEX_POSITION;
+	for (int i = 0; i < VERTEX_ATTRIBUTE_COUNT; ++i)
+	{
+		if (!(mask & (1u << i))) continue;
+		VertexAttribute attribute = (VertexAttribute)i;
+		layout.add(attribute, VertexComponentType::FLOAT32, getFloatVertexComponents(attribute));
+	}
+	return layout;
+}
@@ -0,0 +1,325 @@
+#include "vertex-quantize.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const float RADIANS_TO_DEGREES = 57.29577951f;
+
+inline const float* stream(const float* base, size_t stride, size_t index)
+{
+	return (const float*)((const uint8_t*)base + stride * index);
+}
+
+inline float signNotZero(float v)
+{
+	return v < 0.0f ? -1.0f : 1.0f;
+}
+
+inline uint16_t encodeUnorm16(float v)
+{
+	return (uint16_t)lrintf(std::max(0.0f, std::min(1.0f, v)) * 65535.0f);
+}
+
+inline uint8_t encodeUnorm8(float v)
+{
+	return (uint8_t)lrintf(std::max(0.0f, std::min(1.0f, v)) * 255.0f);
+}
+
+// octahedral mapping (Meyer et al. 2010): project onto the octahedron |x|+|y|+|z| = 1
+// and fold the lower half over the diagonals, a unit vector becomes two values in [-1, 1]
+void decodeOctahedral(const int16_t encoded[2], float out[3])
+{
+	float x = std::max(encoded[0] / 32767.0f, -1.0f);
+	float y = std::max(encoded[1] / 32767.0f, -1.0f);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f)
+	{
+		float folded_x = (1.0f - fabsf(y)) * signNotZero(x);
+		y = (1.0f - fabsf(x)) * signNotZero(y);
+		x = folded_x;
+	}
+	float length = sqrtf(x * x + y * y + z * z);
+	out[0] = x / length;
+	out[1] = y / length;
+	out[2] = z / length;
+}
+
+// angle in radians between \p a and the unit vector \p b; atan2 stays accurate for tiny angles
+float angleBetween(const float a[3], const float b[3])
+{
+	float cross_x = a[1] * b[2] - a[2] * b[1];
+	float cross_y = a[2] * b[0] - a[0] * b[2];
+	float cross_z = a[0] * b[1] - a[1] * b[0];
+	float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	return atan2f(sqrtf(cross_x * cross_x + cross_y * cross_y + cross_z * cross_z), dot);
+}
+
+// Rounding each coordinate on its own is not the closest encoding once the result is
+// renormalized, so all four floor/ceil combinations are tried and the best one kept.
+// Zero vectors encode to +z. Returns the angle error of the kept encoding.
+float encodeOctahedral(const float v[3], int16_t out[2])
+{
+	float l1 = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+	if (l1 == 0.0f)
+	{
+		out[0] = out[1] = 0;
+		return 0.0f;
+	}
+	float x = v[0] / l1;
+	float y = v[1] / l1;
+	if (v[2] < 0.0f)
+	{
+		float folded_x = (1.0f - fabsf(y)) * signNotZero(x);
+		y = (1.0f - fabsf(x)) * signNotZero(y);
+		x = folded_x;
+	}
+
+	float base_x = floorf(x * 32767.0f);
+	float base_y = floorf(y * 32767.0f);
+	float best_error = FLT_MAX;
+	for (int i = 0; i < 4; ++i)
+	{
+		int16_t candidate[2];
+		candidate[0] = (int16_t)std::max(-32767.0f, std::min(32767.0f, base_x + (i & 1)));
+		candidate[1] = (int16_t)std::max(-32767.0f, std::min(32767.0f, base_y + (i >> 1)));
+		float decoded[3];
+		decodeOctahedral(candidate, decoded);
+		float error = angleBetween(v, decoded);
+		if (error < best_error)
+		{
+			best_error = error;
+			out[0] = candidate[0];
+			out[1] = candidate[1];
+		}
+	}
+	return best_error;
+}
+
+} // anonymous namespace
+
+
+void QuantizationError::merge(const QuantizationError& other)
+{
+	position = std::max(position, other.position);
+	normal = std::max(normal, other.normal);
+	tangent = std::max(tangent, other.tangent);
+	uv = std::max(uv, other.uv);
+	color = std::max(color, other.color);
+	weight = std::max(weight, other.weight);
+}
+
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t magnitude = bits & 0x7fffffff;
+
+	if (magnitude >= 0x7f800000) return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00); // nan, inf
+	if (magnitude > 0x477fe000) return sign | 0x7bff; // clamp to the largest half, 65504
+	if (magnitude < 0x38800000)
+	{
+		// below the smallest normal half: denormals are multiples of 2^-24, and a value
+		// that rounds up to 1024 of them is exactly the smallest normal's bit pattern
+		float abs_value;
+		memcpy(&abs_value, &magnitude, sizeof(abs_value));
+		return sign | (uint16_t)lrintf(abs_value * 16777216.0f);
+	}
+	// rebias the exponent from 127 to 15 and round the mantissa to nearest even
+	uint32_t rebiased = magnitude - 0x38000000;
+	return sign | (uint16_t)((rebiased + 0x0fff + ((rebiased >> 13) & 1)) >> 13);
+}
+
+
+float halfToFloat(uint16_t value)
+{
+	int exponent = (value >> 10) & 0x1f;
+	int mantissa = value & 0x3ff;
+	float magnitude;
+	if (exponent == 0) magnitude = ldexpf((float)mantissa, -24);
+	else if (exponent == 31) magnitude = mantissa ? NAN : INFINITY;
+	else magnitude = ldexpf((float)(mantissa | 0x400), exponent - 25);
+	return (value & 0x8000) ? -magnitude : magnitude;
+}
+
+
+VertexQuantization getVertexQuantization(const VertexQuantizeSettings& settings, uint32_t mask)
+{
+	VertexQuantization quantization;
+	VertexLayout& layout = quantization.layout;
+	if (settings.quantize_positions) layout.add(VERTEX_POSITION, VertexComponentType::UINT16, 3, true);
+	else layout.add(VERTEX_POSITION, VertexComponentType::FLOAT32, 3);
+	if (mask & (1u << VERTEX_NORMAL)) layout.add(VERTEX_NORMAL, VertexComponentType::INT16, 2);
+	if (mask & (1u << VERTEX_TANGENT)) layout.add(VERTEX_TANGENT, VertexComponentType::INT16, 2);
+	if (mask & (1u << VERTEX_COLOR)) layout.add(VERTEX_COLOR, VertexComponentType::UINT8, 4, true);
+	if (mask & (1u << VERTEX_UV))
+	{
+		if (settings.unorm_uvs) layout.add(VERTEX_UV, VertexComponentType::UINT16, 2, true);
+		else layout.add(VERTEX_UV, VertexComponentType::FLOAT16, 2);
+	}
+	if (mask & (1u << VERTEX_JOINTS)) layout.add(VERTEX_JOINTS, VertexComponentType::UINT16, 4);
+	if (mask & (1u << VERTEX_WEIGHTS)) layout.add(VERTEX_WEIGHTS, VertexComponentType::UINT16, 4, true);
+	return quantization;
+}
+
+
+void quantizeVertices(const VertexQuantizeInput& input, const VertexQuantizeSettings& settings,
+	uint8_t* dst, VertexQuantization* quantization, QuantizationError* error)
+{
+	uint32_t mask = (1u << VERTEX_POSITION)
+		| (input.normals ? 1u << VERTEX_NORMAL : 0)
+		| (input.tangents ? 1u << VERTEX_TANGENT : 0)
+		| (input.colors ? 1u << VERTEX_COLOR : 0)
+		| (input.uvs ? 1u << VERTEX_UV : 0)
+		| (input.joints ? 1u << VERTEX_JOINTS : 0)
+		| (input.weights ? 1u << VERTEX_WEIGHTS : 0);
+	*quantization = getVertexQuantization(settings, mask);
+	VertexQuantization& q = *quantization;
+	const VertexLayout& layout = q.layout;
+	const VertexAttributeFormat* formats = layout.attributes;
+	bool unorm_positions = settings.quantize_positions;
+	bool unorm_uvs = settings.unorm_uvs;
+
+	// decode ranges first, the unorm encodings are relative to them
+	float position_min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float position_max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	float uv_min[2] = {FLT_MAX, FLT_MAX};
+	float uv_max[2] = {-FLT_MAX, -FLT_MAX};
+	for (size_t i = 0; i < input.count; ++i)
+	{
+		const float* position = stream(input.positions, input.stride, i);
+		for (int c = 0; c < 3; ++c)
+		{
+			position_min[c] = std::min(position_min[c], position[c]);
+			position_max[c] = std::max(position_max[c], position[c]);
+		}
+		if (!input.uvs) continue;
+		const float* uv = stream(input.uvs, input.stride, i);
+		for (int c = 0; c < 2; ++c)
+		{
+			uv_min[c] = std::min(uv_min[c], uv[c]);
+			uv_max[c] = std::max(uv_max[c], uv[c]);
+		}
+	}
+	if (input.count > 0 && unorm_positions)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			q.position_decode_offset[c] = position_min[c];
+			q.position_decode_scale[c] = position_max[c] - position_min[c];
+		}
+	}
+	if (input.count > 0 && input.uvs && unorm_uvs)
+	{
+		for (int c = 0; c < 2; ++c)
+		{
+			q.uv_decode_offset[c] = uv_min[c];
+			q.uv_decode_scale[c] = uv_max[c] - uv_min[c];
+		}
+	}
+
+	QuantizationError max_error;
+	for (size_t i = 0; i < input.count; ++i)
+	{
+		uint8_t* out = dst + layout.stride * i;
+		const float* position = stream(input.positions, input.stride, i);
+
+		float decoded_position[3];
+		if (unorm_positions)
+		{
+			uint16_t encoded[4] = {0, 0, 0, 0};
+			for (int c = 0; c < 3; ++c)
+			{
+				float scale = q.position_decode_scale[c];
+				encoded[c] = scale > 0.0f ? encodeUnorm16((position[c] - q.position_decode_offset[c]) / scale) : 0;
+				decoded_position[c] = q.position_decode_offset[c] + scale * (encoded[c] / 65535.0f);
+			}
+			memcpy(out + formats[VERTEX_POSITION].offset, encoded, sizeof(encoded));
+		}
+		else
+		{
+			memcpy(out + formats[VERTEX_POSITION].offset, position, 3 * sizeof(float));
+			memcpy(decoded_position, position, sizeof(decoded_position));
+		}
+		float dx = decoded_position[0] - position[0];
+		float dy = decoded_position[1] - position[1];
+		float dz = decoded_position[2] - position[2];
+		max_error.position = std::max(max_error.position, sqrtf(dx * dx + dy * dy + dz * dz));
+
+		if (input.normals)
+		{
+			int16_t encoded[2];
+			float angle = encodeOctahedral(stream(input.normals, input.stride, i), encoded);
+			memcpy(out + formats[VERTEX_NORMAL].offset, encoded, sizeof(encoded));
+			max_error.normal = std::max(max_error.normal, angle * RADIANS_TO_DEGREES);
+		}
+		if (input.tangents)
+		{
+			int16_t encoded[2];
+			float angle = encodeOctahedral(stream(input.tangents, input.stride, i), encoded);
+			memcpy(out + formats[VERTEX_TANGENT].offset, encoded, sizeof(encoded));
+			max_error.tangent = std::max(max_error.tangent, angle * RADIANS_TO_DEGREES);
+		}
+
+		if (input.colors)
+		{
+			const float* color = stream(input.colors, input.stride, i);
+			uint8_t encoded[4];
+			for (int c = 0; c < 4; ++c)
+			{
+				encoded[c] = encodeUnorm8(color[c]);
+				float clamped = std::max(0.0f, std::min(1.0f, color[c]));
+				max_error.color = std::max(max_error.color, fabsf(encoded[c] / 255.0f - clamped));
+			}
+			memcpy(out + formats[VERTEX_COLOR].offset, encoded, sizeof(encoded));
+		}
+
+		if (input.uvs)
+		{
+			const float* uv = stream(input.uvs, input.stride, i);
+			uint16_t encoded[2];
+			for (int c = 0; c < 2; ++c)
+			{
+				float decoded;
+				if (unorm_uvs)
+				{
+					float scale = q.uv_decode_scale[c];
+					encoded[c] = scale > 0.0f ? encodeUnorm16((uv[c] - q.uv_decode_offset[c]) / scale) : 0;
+					decoded = q.uv_decode_offset[c] + scale * (encoded[c] / 65535.0f);
+				}
+				else
+				{
+					encoded[c] = floatToHalf(uv[c]);
+					decoded = halfToFloat(encoded[c]);
+				}
+				max_error.uv = std::max(max_error.uv, fabsf(decoded - uv[c]));
+			}
+			memcpy(out + formats[VERTEX_UV].offset, encoded, sizeof(encoded));
+		}
+
+		if (input.joints)
+		{
+			const float* joints = stream(input.joints, input.stride, i);
+			uint16_t encoded[4];
+			for (int c = 0; c < 4; ++c) encoded[c] = (uint16_t)std::max(0.0f, std::min(65535.0f, joints[c]));
+			memcpy(out + formats[VERTEX_JOINTS].offset, encoded, sizeof(encoded));
+		}
+		if (input.weights)
+		{
+			const float* weights = stream(input.weights, input.stride, i);
+			uint16_t encoded[4];
+			for (int c = 0; c < 4; ++c)
+			{
+				encoded[c] = encodeUnorm16(weights[c]);
+				max_error.weight = std::max(max_error.weight, fabsf(encoded[c] / 65535.0f - weights[c]));
+			}
+			memcpy(out + formats[VERTEX_WEIGHTS].offset, encoded, sizeof(encoded));
+		}
+	}
+	if (error) *error = max_error;
+}
@@ -0,0 +1,225 @@
+#include "vertex-transform.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "simd.hpp"
+
+namespace {
+
+// The kernel below processes LANES vertices per iteration, helpers from simd.hpp.
+using namespace simd;
+
+struct alignas(32) Block
+{
+	float x[LANES];
+	float y[LANES];
+	float z[LANES];
+};
+
+// AoS doubles -> SoA floats. Lanes past the end repeat the last vertex so they
+// cannot affect the bounds.
+inline void gather(Block* block, const double* src, const int* remap, int first, int count, double scale)
+{
+	if (count == LANES)
+	{
+		if (remap)
+		{
+			for (int lane = 0; lane < LANES; ++lane)
+			{
+				const double* v = src + 3 * remap[first + lane];
+				block->x[lane] = (float)(v[0] * scale);
+				block->y[lane] = (float)(v[1] * scale);
+				block->z[lane] = (float)(v[2] * scale);
+			}
+		}
+		else
+		{
+			const double* v = src + 3 * first;
+			for (int lane = 0; lane < LANES; ++lane, v += 3)
+			{
+				block->x[lane] = (float)(v[0] * scale);
+				block->y[lane] = (float)(v[1] * scale);
+				block->z[lane] = (float)(v[2] * scale);
+			}
+		}
+		return;
+	}
+
+	for (int lane = 0; lane < LANES; ++lane)
+	{
+		int i = first + std::min(lane, count - 1);
+		const double* v = src + 3 * (remap ? remap[i] : i);
+		block->x[lane] = (float)(v[0] * scale);
+		block->y[lane] = (float)(v[1] * scale);
+		block->z[lane] = (float)(v[2] * scale);
+	}
+}
+
+inline void scatter(float* dst, size_t stride, int first, int count, const Block& block)
+{
+	char* out = (char*)dst + first * stride;
+	for (int lane = 0; lane < count; ++lane, out += stride)
+	{
+		float* v = (float*)out;
+		v[0] = block.x[lane];
+		v[1] = block.y[lane];
+		v[2] = block.z[lane];
+	}
+}
+
+inline void transformDirections(Block* block, const Lanes m[12])
+{
+	Lanes x = loadAligned(block->x);
+	Lanes y = loadAligned(block->y);
+	Lanes z = loadAligned(block->z);
+	Lanes tx = madd(m[0], x, madd(m[1], y, mul(m[2], z)));
+	Lanes ty = madd(m[4], x, madd(m[5], y, mul(m[6], z)));
+	Lanes tz = madd(m[8], x, madd(m[9], y, mul(m[10], z)));
+	// zero-length directions stay zero instead of turning into NaNs
+	Lanes len2 = madd(tx, tx, madd(ty, ty, mul(tz, tz)));
+	Lanes inv_len = div(splat(1.0f), sqrt(max(len2, splat(FLT_MIN))));
+	storeAligned(block->x, mul(tx, inv_len));
+	storeAligned(block->y, mul(ty, inv_len));
+	storeAligned(block->z, mul(tz, inv_len));
+}
+
+struct Bounds
+{
+	Lanes min_x, min_y, min_z;
+	Lanes max_x, max_y, max_z;
+	// the vertex each lane's minimum and maximum came from, see extreme_vertices
+	Indices min_vx, min_vy, min_vz;
+	Indices max_vx, max_vy, max_vz;
+};
+
+inline void reduceMin(Lanes* bound, Indices* vertex, Lanes value, Indices index)
+{
+	*vertex = selectIndices(less(value, *bound), index, *vertex);
+	*bound = min(*bound, value);
+}
+
+inline void reduceMax(Lanes* bound, Indices* vertex, Lanes value, Indices index)
+{
+	*vertex = selectIndices(less(*bound, value), index, *vertex);
+	*bound = max(*bound, value);
+}
+
+// Attribute presence is a template parameter so the block loop carries no per-stream
+// tests; transformVertices picks the instantiation once per call.
+template <bool HAS_NORMALS, bool HAS_TANGENTS>
+void transformStreams(const VertexTransformInput& input, const Lanes m[12], double scale,
+	VertexTransformOutput* output, Bounds* bounds)
+{
+	Block block;
+	alignas(32) int lane_offsets[LANES];
+	for (int lane = 0; lane < LANES; ++lane) lane_offsets[lane] = lane;
+	Indices offsets = loadIndices(lane_offsets);
+	for (int first = 0; first < input.count; first += LANES)
+	{
+		int count = std::min(LANES, input.count - first);
+		Indices index;
+		if (count == LANES) index = addIndices(splatIndex(first), offsets);
+		else
+		{
+			// like gather, lanes past the end stand for the last vertex
+			alignas(32) int tail[LANES];
+			for (int lane = 0; lane < LANES; ++lane) tail[lane] = first + std::min(lane, count - 1);
+			index = loadIndices(tail);
+		}
+
+		gather(&block, input.positions, input.remap, first, count, scale);
+		Lanes x = loadAligned(block.x);
+		Lanes y = loadAligned(block.y);
+		Lanes z = loadAligned(block.z);
+		Lanes tx = madd(m[0], x, madd(m[1], y, madd(m[2], z, m[3])));
+		Lanes ty = madd(m[4], x, madd(m[5], y, madd(m[6], z, m[7])));
+		Lanes tz = madd(m[8], x, madd(m[9], y, madd(m[10], z, m[11])));
+		reduceMin(&bounds->min_x, &bounds->min_vx, tx, index);
+		reduceMin(&bounds->min_y, &bounds->min_vy, ty, index);
+		reduceMin(&bounds->min_z, &bounds->min_vz, tz, index);
+		reduceMax(&bounds->max_x, &bounds->max_vx, tx, index);
+		reduceMax(&bounds->max_y, &bounds->max_vy, ty, index);
+		reduceMax(&bounds->max_z, &bounds->max_vz, tz, index);
+		storeAligned(block.x, tx);
+		storeAligned(block.y, ty);
+		storeAligned(block.z, tz);
+		scatter(output->positions, output->stride, first, count, block);
+
+		if (HAS_NORMALS)
+		{
+			gather(&block, input.normals, input.remap, first, count, 1.0);
+			transformDirections(&block, m);
+			scatter(output->normals, output->stride, first, count, block);
+		}
+
+		if (HAS_TANGENTS)
+		{
+			gather(&block, input.tangents, input.remap, first, count, 1.0);
+			transformDirections(&block, m);
+			scatter(output->tangents, output->stride, first, count, block);
+		}
+	}
+}
+
+} // anonymous namespace
+
+
+void transformVertices(const VertexTransformInput& input, const float matrix[16], double scale,
+	VertexTransformOutput* output)
+{
+	// rows of the upper 3x4 part, one matrix element per register
+	Lanes m[12];
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int col = 0; col < 4; ++col) m[row * 4 + col] = splat(matrix[col * 4 + row]);
+	}
+
+	Bounds bounds;
+	bounds.min_x = bounds.min_y = bounds.min_z = splat(FLT_MAX);
+	bounds.max_x = bounds.max_y = bounds.max_z = splat(-FLT_MAX);
+	bounds.min_vx = bounds.min_vy = bounds.min_vz = splatIndex(-1);
+	bounds.max_vx = bounds.max_vy = bounds.max_vz = splatIndex(-1);
+
+	typedef void (*TransformFn)(const VertexTransformInput&, const Lanes*, double, VertexTransformOutput*, Bounds*);
+	static const TransformFn transforms[2][2] = {
+		{transformStreams<false, false>, transformStreams<false, true>},
+		{transformStreams<true, false>, transformStreams<true, true>}
+	};
+	transforms[input.normals != nullptr][input.tangents != nullptr](input, m, scale, output, &bounds);
+
+	alignas(32) float lanes[6][LANES];
+	alignas(32) int vertices[6][LANES];
+	storeAligned(lanes[0], bounds.min_x);
+	storeAligned(lanes[1], bounds.max_x);
+	storeAligned(lanes[2], bounds.min_y);
+	storeAligned(lanes[3], bounds.max_y);
+	storeAligned(lanes[4], bounds.min_z);
+	storeAligned(lanes[5], bounds.max_z);
+	storeIndices(vertices[0], bounds.min_vx);
+	storeIndices(vertices[1], bounds.max_vx);
+	storeIndices(vertices[2], bounds.min_vy);
+	storeIndices(vertices[3], bounds.max_vy);
+	storeIndices(vertices[4], bounds.min_vz);
+	storeIndices(vertices[5], bounds.max_vz);
+	for (int i = 0; i < 6; ++i)
+	{
+		// ties go to the first vertex, so every instruction set picks the same one
+		int best = 0;
+		for (int lane = 1; lane < LANES; ++lane)
+		{
+			bool better = i % 2 ? lanes[i][lane] > lanes[i][best] : lanes[i][lane] < lanes[i][best];
+			if (better || (lanes[i][lane] == lanes[i][best] && vertices[i][lane] < vertices[i][best])) best = lane;
+		}
+		if (i % 2) output->bounds_max[i / 2] = lanes[i][best];
+		else output->bounds_min[i / 2] = lanes[i][best];
+		output->extreme_vertices[i] = vertices[i][best];
+	}
+}
+
+
+const char* getVertexTransformISA()
+{
+	return ISA_NAME;
+}
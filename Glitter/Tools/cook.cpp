@@ -0,0 +1,294 @@
+// Headless batch cooker: imports every FBX file of a directory and writes the
+// cooked meshes that Glitter would otherwise build on its first run. Needs no
+// window or GL context.
+//
+//   GlitterCook <input dir> [-o <output dir>] [-j <workers>] [-f] [-l <d1,d2,d3>] [-b]
+//
+// Without -o the cooked files land next to their sources, where Glitter looks
+// for them. Up to date files are skipped unless -f is given. -l sets the LOD
+// draw distances, each one adds a simplified level to every mesh; Glitter must
+// be started with the same --lods to pick the files up. -b also cooks a ray cast
+// BVH per mesh, for Glitter started with --bvh.
+
+#include "arena.hpp"
+#include "fbx-importer.hpp"
+#include "file-source.hpp"
+#include "mesh-cache.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <dirent.h>
+	#include <sys/stat.h>
+#endif
+
+namespace {
+
+struct InputFile
+{
+	std::string path;
+	std::string cooked_path;
+	uint64_t size = 0;
+};
+
+struct CookResult
+{
+	bool ok = false;
+	bool skipped = false;
+	bool parse_failed = false;
+	uint64_t vertex_count = 0;
+	size_t arena_bytes = 0; // the meshes at their largest, before saving
+	double seconds = 0;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool hasFbxExtension(const std::string& name)
+{
+	if (name.size() < 4) return false;
+	std::string ext = name.substr(name.size() - 4);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+	return ext == ".fbx";
+}
+
+std::string getFileName(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// non-recursive, sorted by name so runs are reproducible
+bool listFbxFiles(const std::string& dir, std::vector<InputFile>* files)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return false;
+	do
+	{
+		if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !hasFbxExtension(data.cFileName)) continue;
+		InputFile file;
+		file.path = dir + "\\" + data.cFileName;
+		file.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		files->push_back(file);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR* d = opendir(dir.c_str());
+	if (!d) return false;
+	while (dirent* entry = readdir(d))
+	{
+		if (!hasFbxExtension(entry->d_name)) continue;
+		InputFile file;
+		file.path = dir + "/" + entry->d_name;
+		struct stat st;
+		if (stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+		file.size = (uint64_t)st.st_size;
+		files->push_back(file);
+	}
+	closedir(d);
+#endif
+	std::sort(files->begin(), files->end(), [](const InputFile& a, const InputFile& b) { return a.path < b.path; });
+	return true;
+}
+
+CookResult cookFile(const InputFile& file, const FBXImporter& settings, bool force)
+{
+	CookResult result;
+	Clock::time_point start = Clock::now();
+
+	FileSource source;
+	if (!source.open(file.path.c_str()))
+	{
+		fprintf(stderr, "%s: cannot open\n", file.path.c_str());
+		return result;
+	}
+	uint64_t key = getCookedMeshKey(source.data(), source.size(), settings);
+	if (!force)
+	{
+		CookedMeshFile cooked;
+		if (cooked.open(file.cooked_path.c_str(), key))
+		{
+			result.ok = result.skipped = true;
+			result.seconds = secondsSince(start);
+			return result;
+		}
+	}
+
+	// OpenFBX takes an int size and keeps its own copy of the data
+	ofbx::IScene* scene = source.size() <= INT_MAX ? ofbx::load(source.data(), (int)source.size()) : nullptr;
+	source.close();
+	if (!scene)
+	{
+		// ofbx::getError is one buffer for the whole process, main reports parse errors
+		// once the workers are done
+		result.parse_failed = file.size <= INT_MAX;
+		if (!result.parse_failed) fprintf(stderr, "%s: too large for OpenFBX\n", file.path.c_str());
+		return result;
+	}
+
+	// one arena per worker thread, reset between files: after the first few files mesh
+	// storage stops hitting the heap at all
+	static thread_local Arena arena;
+	FBXImporter importer(settings);
+	importer.arena = &arena;
+	importer.scenes.push_back(scene);
+	importer.gatherMeshes(scene);
+	importer.gatherAnimations(scene);
+	importer.importAnimations();
+	importer.postprocessMeshes();
+	importer.generateLODs();
+	importer.optimizeMeshes();
+	for (const FBXImporter::ImportMesh& mesh : importer.meshes) result.vertex_count += mesh.getVertexCount();
+	result.ok = saveCookedMeshes(file.cooked_path.c_str(), key, importer.meshes);
+	if (!result.ok) fprintf(stderr, "%s: cannot write %s\n", file.path.c_str(), file.cooked_path.c_str());
+	result.arena_bytes = arena.getUsed();
+	importer.clearSources();
+	arena.reset();
+
+	result.seconds = secondsSince(start);
+	return result;
+}
+
+void printUsage()
+{
+	fprintf(stderr, "usage: GlitterCook <input dir> [-o <output dir>] [-j <workers>] [-f] [-l <d1,d2,d3>] [-b]\n");
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+	std::string input_dir;
+	std::string output_dir;
+	int max_workers = 0;
+	bool force = false;
+	const char* lods = nullptr;
+	bool build_bvh = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output_dir = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) max_workers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-f") == 0) force = true;
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) lods = argv[++i];
+		else if (strcmp(argv[i], "-b") == 0) build_bvh = true;
+		else if (argv[i][0] != '-' && input_dir.empty()) input_dir = argv[i];
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (input_dir.empty())
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	std::vector<InputFile> files;
+	if (!listFbxFiles(input_dir, &files))
+	{
+		fprintf(stderr, "Cannot read directory %s\n", input_dir.c_str());
+		return EXIT_FAILURE;
+	}
+	for (InputFile& file : files)
+	{
+		file.cooked_path = output_dir.empty() ? file.path : output_dir + "/" + getFileName(file.path);
+		file.cooked_path += ".cooked";
+	}
+
+	// one file per worker; the importer's own passes run serially so workers do
+	// not oversubscribe the machine, and quietly so the per-file lines stay readable
+	FBXImporter settings;
+	settings.max_threads = 1;
+	settings.verbose = false;
+	settings.build_bvh = build_bvh;
+	if (lods)
+	{
+		float* d = settings.lods_distances;
+		if (sscanf(lods, "%f,%f,%f", &d[0], &d[1], &d[2]) < 1)
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	// largest files first so a big one does not start last and stretch the tail
+	std::vector<int> order(files.size());
+	for (int i = 0; i < (int)order.size(); ++i) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return files[a].size > files[b].size; });
+
+	std::vector<CookResult> results(files.size());
+	Clock::time_point start = Clock::now();
+	parallelFor((int)files.size(), max_workers, [&](int job) {
+		const InputFile& file = files[order[job]];
+		CookResult& result = results[order[job]];
+		result = cookFile(file, settings, force);
+		if (!result.ok || result.skipped)
+		{
+			printf("%-40s %s\n", getFileName(file.path).c_str(), result.ok ? "up to date" : "FAILED");
+			return;
+		}
+		double mb = file.size / (1024.0 * 1024.0);
+		double seconds = std::max(result.seconds, 1e-6);
+		// the process RSS is shared by all workers, a file's own memory is what its meshes took
+		printf("%-40s %8.1f MB %8.1f ms %8.1f MB/s %10.0f vertices/s %8.1f MB meshes\n", getFileName(file.path).c_str(),
+			mb, seconds * 1000.0, mb / seconds, result.vertex_count / seconds, result.arena_bytes / (1024.0 * 1024.0));
+	});
+	double seconds = secondsSince(start);
+
+	// parsing the failed files again, one at a time, keeps other workers from
+	// overwriting the error message before it is read
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		if (!results[i].parse_failed) continue;
+		FileSource source;
+		if (!source.open(files[i].path.c_str()))
+		{
+			fprintf(stderr, "%s: cannot open\n", files[i].path.c_str());
+			continue;
+		}
+		ofbx::IScene* scene = ofbx::load(source.data(), (int)source.size());
+		fprintf(stderr, "%s: %s\n", files[i].path.c_str(), scene ? "did not parse while other files were cooked" : ofbx::getError());
+		if (scene) scene->destroy();
+	}
+
+	int cooked = 0, skipped = 0, failed = 0;
+	uint64_t cooked_bytes = 0, vertex_count = 0;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		if (!results[i].ok) ++failed;
+		else if (results[i].skipped) ++skipped;
+		else
+		{
+			++cooked;
+			cooked_bytes += files[i].size;
+			vertex_count += results[i].vertex_count;
+		}
+	}
+	double mb = cooked_bytes / (1024.0 * 1024.0);
+	printf("%d cooked, %d up to date, %d failed on %d workers in %.2f s: %.1f MB/s, %.0f vertices/s, peak RSS %.1f MB\n",
+		cooked, skipped, failed, workerCount((int)files.size(), max_workers), seconds,
+		seconds > 0 ? mb / seconds : 0.0, seconds > 0 ? vertex_count / seconds : 0.0,
+		getPeakResidentMemory() / (1024.0 * 1024.0));
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}